@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "bench-measure.h"
+
+static GTimer *timer = NULL;
+static gboolean counting = FALSE;
+static gsize n_allocs = 0;
+
+#ifdef __GLIBC__
+
+/* GLib and everything else in the process allocate through these,
+   which glibc lets us wrap */
+#define CAN_COUNT_ALLOCS 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_blocks, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+void *
+malloc (size_t size)
+{
+  if (counting)
+    {
+      n_allocs++;
+    }
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_blocks, size_t size)
+{
+  if (counting)
+    {
+      n_allocs++;
+    }
+  return __libc_calloc (n_blocks, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  if (counting)
+    {
+      n_allocs++;
+    }
+  return __libc_realloc (ptr, size);
+}
+
+#else
+
+#define CAN_COUNT_ALLOCS 0
+
+#endif
+
+void
+bench_init (void)
+{
+  /* Slices would not go through malloc */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+  timer = g_timer_new ();
+}
+
+void
+bench_start (void)
+{
+  n_allocs = 0;
+  counting = CAN_COUNT_ALLOCS;
+  g_timer_start (timer);
+}
+
+void
+bench_stop (const gchar *name, guint n_ops)
+{
+  gsize allocs;
+
+  g_timer_stop (timer);
+  counting = FALSE;
+  allocs = n_allocs;
+
+  if (CAN_COUNT_ALLOCS)
+    {
+      g_print ("%-32s %10.1f ns/op %8.2f allocs/op\n", name,
+               g_timer_elapsed (timer, NULL) * 1e9 / n_ops,
+               (gdouble) allocs / n_ops);
+    }
+  else
+    {
+      g_print ("%-32s %10.1f ns/op %8s allocs/op\n", name,
+               g_timer_elapsed (timer, NULL) * 1e9 / n_ops, "-");
+    }
+}
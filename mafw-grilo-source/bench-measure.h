@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#ifndef BENCH_MEASURE_H
+#define BENCH_MEASURE_H
+
+G_BEGIN_DECLS
+
+/* What the microbenchmarks share, so that every measure is a line
+   with its name, ns/op and allocs/op. Allocations are counted by
+   replacing malloc in the bench binary, with GLib slices going
+   through it too; where that is not possible the column reads "-".
+   bench_init () goes first, before GLib allocates anything. */
+
+void bench_init (void);
+void bench_start (void);
+void bench_stop (const gchar *name, guint n_ops);
+
+G_END_DECLS
+
+#endif /* BENCH_MEASURE_H */
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+/* Measures what serializing and deserializing object ids costs per id
+   on a big listing, with the codec the source uses and with the
+   printf/split one it used before. Run it with "make bench"; every line
+   gives the name of the measure, ns/op and allocs/op. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <libmafw/mafw.h>
+#include <grilo.h>
+
+#include "bench-measure.h"
+#include "mafw-grilo-object-id.h"
+
+#define N_ITEMS 100000
+#define SOURCE_UUID "grl_bench"
+
+static gchar *
+legacy_serialize (GrlMedia *grl_media, const gchar *source_id,
+                  guint pagination_skip)
+{
+  return g_strdup_printf ("%s::%u:%s:%s", source_id, pagination_skip,
+                          G_OBJECT_TYPE_NAME (grl_media),
+                          grl_media_get_id (grl_media));
+}
+
+static void
+legacy_deserialize (const gchar *object_id, GrlMedia **grl_media,
+                    guint *pagination_skip)
+{
+  gchar *serialized_grl_media = NULL;
+
+  if (mafw_source_split_objectid (object_id, NULL, &serialized_grl_media) &&
+      serialized_grl_media[0] != '\0')
+    {
+      gchar *grl_media_type, *grl_media_id;
+      gchar *ptr;
+
+      *pagination_skip = strtoul (serialized_grl_media, &ptr, 10);
+
+      grl_media_type = ptr + 1;
+      grl_media_id = g_strstr_len (grl_media_type, -1, ":");
+      grl_media_type[grl_media_id - grl_media_type] = '\0';
+      grl_media_id++;
+
+      *grl_media = g_object_new (g_type_from_name (grl_media_type), NULL);
+      grl_media_set_id (*grl_media, grl_media_id);
+    }
+
+  g_free (serialized_grl_media);
+}
+
+static void
+free_media (GrlMedia **medias)
+{
+  guint i;
+
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      g_object_unref (medias[i]);
+      medias[i] = NULL;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GrlMedia **medias, **decoded;
+  gchar **object_ids;
+  gchar *prefix;
+  gsize prefix_length;
+  guint skip;
+  guint i;
+
+  bench_init ();
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+
+  medias = g_new0 (GrlMedia *, N_ITEMS);
+  decoded = g_new0 (GrlMedia *, N_ITEMS);
+  object_ids = g_new0 (gchar *, N_ITEMS + 1);
+
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      gchar *media_id;
+
+      media_id =
+        g_strdup_printf ("file:///home/user/MyDocs/Music/Artist %u/"
+                         "Album %u/%05u - Track.mp3", i / 100, i / 10, i);
+      medias[i] = grl_media_audio_new ();
+      grl_media_set_id (medias[i], media_id);
+      g_free (media_id);
+    }
+
+  bench_start ();
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      object_ids[i] = legacy_serialize (medias[i], SOURCE_UUID, 0);
+    }
+  bench_stop ("serialize (printf)", N_ITEMS);
+
+  bench_start ();
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      legacy_deserialize (object_ids[i], &decoded[i], &skip);
+    }
+  bench_stop ("deserialize (split)", N_ITEMS);
+  free_media (decoded);
+  g_strfreev (object_ids);
+  object_ids = g_new0 (gchar *, N_ITEMS + 1);
+
+  bench_start ();
+  prefix = mafw_grilo_object_id_new_prefix (SOURCE_UUID, &prefix_length);
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      object_ids[i] = mafw_grilo_object_id_encode (prefix, prefix_length,
+                                                   medias[i], 0);
+    }
+  bench_stop ("serialize (codec)", N_ITEMS);
+
+  bench_start ();
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      if (!mafw_grilo_object_id_decode (object_ids[i], &decoded[i], &skip))
+        {
+          g_printerr ("could not decode %s\n", object_ids[i]);
+          return 1;
+        }
+    }
+  bench_stop ("deserialize (codec)", N_ITEMS);
+
+  /* Validating is what get_metadata does before anything else */
+  bench_start ();
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      mafw_grilo_object_id_decode (object_ids[i], NULL, NULL);
+    }
+  bench_stop ("validate (codec)", N_ITEMS);
+
+  free_media (decoded);
+  free_media (medias);
+  g_strfreev (object_ids);
+  g_free (prefix);
+  g_free (decoded);
+  g_free (medias);
+
+  return 0;
+}
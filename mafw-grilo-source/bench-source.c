@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+/* Measures the code the source runs for every row it delivers: key
+   translation both ways, object id serialization and the sanitizing
+   of plugin ids. Run it with "make bench"; every line gives the name
+   of the measure, ns/op and allocs/op. */
+
+/* The functions measured are private to the source */
+#include "mafw-grilo-source.c"
+
+#include "bench-measure.h"
+
+#define N_OPS 100000
+#define N_MEDIAS 1000
+
+/* A grilo source that only knows what keys it supports, which is all
+   the wildcard needs */
+typedef GrlMediaSource BenchGrlSource;
+typedef GrlMediaSourceClass BenchGrlSourceClass;
+
+GType bench_grl_source_get_type (void);
+
+G_DEFINE_TYPE (BenchGrlSource, bench_grl_source, GRL_TYPE_MEDIA_SOURCE);
+
+static const GList *
+bench_grl_source_supported_keys (GrlMetadataSource *source)
+{
+  static GList *keys = NULL;
+
+  if (!keys)
+    {
+      keys = grl_metadata_key_list_new (GRL_METADATA_KEY_ID,
+                                        GRL_METADATA_KEY_TITLE,
+                                        GRL_METADATA_KEY_URL,
+                                        GRL_METADATA_KEY_ARTIST,
+                                        GRL_METADATA_KEY_ALBUM,
+                                        GRL_METADATA_KEY_GENRE,
+                                        GRL_METADATA_KEY_THUMBNAIL,
+                                        GRL_METADATA_KEY_DURATION,
+                                        GRL_METADATA_KEY_CHILDCOUNT,
+                                        GRL_METADATA_KEY_MIME,
+                                        GRL_METADATA_KEY_BITRATE,
+                                        NULL);
+    }
+
+  return keys;
+}
+
+static void
+bench_grl_source_class_init (BenchGrlSourceClass *klass)
+{
+  GRL_METADATA_SOURCE_CLASS (klass)->supported_keys =
+    bench_grl_source_supported_keys;
+}
+
+static void
+bench_grl_source_init (BenchGrlSource *source)
+{
+}
+
+/* What a music source usually gives for a track */
+static GrlMedia *
+new_audio (guint i)
+{
+  GrlMedia *grl_media;
+  gchar *text;
+
+  grl_media = grl_media_audio_new ();
+  text = g_strdup_printf ("file:///home/user/MyDocs/Music/Artist %u/"
+                          "Album %u/%05u - Track.mp3", i / 100, i / 10, i);
+  grl_media_set_id (grl_media, text);
+  grl_media_set_url (grl_media, text);
+  g_free (text);
+  text = g_strdup_printf ("Track %u", i);
+  grl_media_set_title (grl_media, text);
+  g_free (text);
+  text = g_strdup_printf ("Artist %u", i / 100);
+  grl_media_audio_set_artist (GRL_MEDIA_AUDIO (grl_media), text);
+  g_free (text);
+  text = g_strdup_printf ("Album %u", i / 10);
+  grl_media_audio_set_album (GRL_MEDIA_AUDIO (grl_media), text);
+  g_free (text);
+  grl_media_audio_set_genre (GRL_MEDIA_AUDIO (grl_media), "Rock");
+  grl_media_audio_set_bitrate (GRL_MEDIA_AUDIO (grl_media), 192);
+  grl_media_set_duration (grl_media, 180 + i % 120);
+  grl_media_set_mime (grl_media, "audio/mpeg");
+
+  return grl_media;
+}
+
+static GrlMedia *
+new_box (guint i)
+{
+  GrlMedia *grl_media;
+  gchar *text;
+
+  grl_media = grl_media_box_new ();
+  text = g_strdup_printf ("Album %u", i);
+  grl_media_set_id (grl_media, text);
+  grl_media_set_title (grl_media, text);
+  g_free (text);
+  grl_media_box_set_childcount (GRL_MEDIA_BOX (grl_media), 10);
+
+  return grl_media;
+}
+
+static void
+measure_keys_to_grl (MafwGriloSource *mafw_source, const gchar *name,
+                     const gchar *const *metadata_keys)
+{
+  gchar *measure;
+  guint i;
+
+  /* What browse and get_metadatas do for each request */
+  measure = g_strdup_printf ("keys_to_grl (%s)", name);
+  bench_start ();
+  for (i = 0; i < N_OPS; i++)
+    {
+      gchar *signature;
+
+      signature = get_metadata_keys_signature (metadata_keys);
+      mafw_keys_to_grl_keys (mafw_source, metadata_keys, signature);
+      g_free (signature);
+    }
+  bench_stop (measure, N_OPS);
+  g_free (measure);
+
+  /* And the first time a key set is seen */
+  measure = g_strdup_printf ("translate_keys (%s)", name);
+  bench_start ();
+  for (i = 0; i < N_OPS; i++)
+    {
+      g_list_free (translate_mafw_keys (mafw_source, metadata_keys));
+    }
+  bench_stop (measure, N_OPS);
+  g_free (measure);
+}
+
+static void
+measure_keys_from_grl_media (MafwGriloSource *mafw_source, const gchar *name,
+                             GrlMedia **medias,
+                             const gchar *const *metadata_keys)
+{
+  const GList *grl_keys;
+  gchar *signature;
+  gchar *measure;
+  guint i;
+
+  signature = get_metadata_keys_signature (metadata_keys);
+  grl_keys = mafw_keys_to_grl_keys (mafw_source, metadata_keys, signature);
+  g_free (signature);
+
+  measure = g_strdup_printf ("keys_from_grl_media (%s)", name);
+  bench_start ();
+  for (i = 0; i < N_OPS; i++)
+    {
+      g_hash_table_unref (mafw_keys_from_grl_media (mafw_source,
+                                                    medias[i % N_MEDIAS],
+                                                    NULL, grl_keys));
+    }
+  bench_stop (measure, N_OPS);
+  g_free (measure);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const gchar *explicit_keys[] = {
+    MAFW_METADATA_KEY_URI,
+    MAFW_METADATA_KEY_TITLE,
+    MAFW_METADATA_KEY_ARTIST,
+    MAFW_METADATA_KEY_ALBUM,
+    MAFW_METADATA_KEY_DURATION,
+    MAFW_METADATA_KEY_MIME,
+    MAFW_METADATA_KEY_THUMBNAIL,
+    MAFW_METADATA_KEY_CHILDCOUNT_1,
+    NULL
+  };
+  static const gchar *title_keys[] = {
+    MAFW_METADATA_KEY_TITLE,
+    NULL
+  };
+  static const gchar *wildcard_keys[] = {
+    MAFW_SOURCE_KEY_WILDCARD,
+    NULL
+  };
+  GrlMedia **audios, **boxes;
+  gchar **object_ids;
+  GObject *grl_source;
+  MafwGriloSource *mafw_source;
+  gchar plugin_id[] = "grl-upnp:uuid:4d696e69-444c-164e-9d41-0018f34a7b1a";
+  gchar buffer[sizeof (plugin_id)];
+  guint i;
+
+  bench_init ();
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+
+  /* Registers the grilo keys */
+  grl_plugin_registry_get_instance ();
+
+  grl_source = g_object_new (bench_grl_source_get_type (), NULL);
+  mafw_source = g_object_new (MAFW_TYPE_GRILO_SOURCE,
+                              "plugin", MAFW_GRILO_SOURCE_PLUGIN_NAME,
+                              "uuid", "grl_bench",
+                              "name", "Bench",
+                              "grl-plugin", grl_source,
+                              NULL);
+  probe_grl_source (mafw_source, GRL_OP_BROWSE);
+  g_object_unref (grl_source);
+
+  audios = g_new0 (GrlMedia *, N_MEDIAS);
+  boxes = g_new0 (GrlMedia *, N_MEDIAS);
+  object_ids = g_new0 (gchar *, N_OPS + 1);
+  for (i = 0; i < N_MEDIAS; i++)
+    {
+      audios[i] = new_audio (i);
+      boxes[i] = new_box (i);
+    }
+
+  measure_keys_to_grl (mafw_source, "explicit", explicit_keys);
+  measure_keys_to_grl (mafw_source, "wildcard", wildcard_keys);
+
+  measure_keys_from_grl_media (mafw_source, "audio", audios,
+                               explicit_keys);
+  measure_keys_from_grl_media (mafw_source, "audio, wildcard", audios,
+                               wildcard_keys);
+  measure_keys_from_grl_media (mafw_source, "audio, title", audios,
+                               title_keys);
+  measure_keys_from_grl_media (mafw_source, "box", boxes, explicit_keys);
+
+  bench_start ();
+  for (i = 0; i < N_OPS; i++)
+    {
+      g_hash_table_unref (get_next_row_metadata_keys ());
+    }
+  bench_stop ("next_row_metadata_keys", N_OPS);
+
+  bench_start ();
+  for (i = 0; i < N_OPS; i++)
+    {
+      object_ids[i] = grl_media_serialize (mafw_source, audios[i % N_MEDIAS],
+                                           i % 2 ? MAX_COUNT : 0);
+    }
+  bench_stop ("serialize", N_OPS);
+
+  bench_start ();
+  for (i = 0; i < N_OPS; i++)
+    {
+      GrlMedia *grl_media;
+      guint skip;
+
+      if (!mafw_grilo_object_id_decode (object_ids[i], &grl_media, &skip))
+        {
+          g_printerr ("could not decode %s\n", object_ids[i]);
+          return 1;
+        }
+      g_object_unref (grl_media);
+    }
+  bench_stop ("deserialize", N_OPS);
+
+  bench_start ();
+  for (i = 0; i < N_OPS; i++)
+    {
+      memcpy (buffer, plugin_id, sizeof (plugin_id));
+      sanitize (buffer);
+    }
+  bench_stop ("sanitize", N_OPS);
+
+  for (i = 0; i < N_MEDIAS; i++)
+    {
+      g_object_unref (audios[i]);
+      g_object_unref (boxes[i]);
+    }
+  g_free (audios);
+  g_free (boxes);
+  g_strfreev (object_ids);
+  g_object_unref (mafw_source);
+
+  return 0;
+}
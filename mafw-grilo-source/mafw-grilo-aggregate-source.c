@@ -0,0 +1,1034 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include "config.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include <libmafw/mafw.h>
+
+#include "mafw-grilo-aggregate-source.h"
+#include "mafw-grilo-filter.h"
+#include "mafw-grilo-object-id.h"
+#include "mafw-grilo-sorter.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+#define MAFW_GRILO_AGGREGATE_SOURCE_UUID "grl_aggregate"
+#define MAFW_GRILO_AGGREGATE_SOURCE_NAME "All media"
+
+/* Rows we give when the client does not set item_count. There is no
+   "More results..." row, as the merged stream cannot be taken up
+   again from a position. */
+#define MAX_COUNT 1024
+
+/* Seconds a member can go without giving a row before the merged
+   stream goes on without it, 0 to wait for it */
+#define DEFAULT_MEMBER_DEADLINE 10
+
+#define MAFW_PROPERTY_GRILO_AGGREGATE_MEMBER_DEADLINE "member-deadline"
+
+G_DEFINE_TYPE (MafwGriloAggregateSource, mafw_grilo_aggregate_source,
+               MAFW_TYPE_SOURCE);
+
+#define MAFW_GRILO_AGGREGATE_SOURCE_GET_PRIVATE(object)			\
+  (G_TYPE_INSTANCE_GET_PRIVATE ((object),				\
+                                MAFW_TYPE_GRILO_AGGREGATE_SOURCE,	\
+                                MafwGriloAggregateSourcePrivate))
+
+struct _MafwGriloAggregateSourcePrivate
+{
+  GList *members;
+  GHashTable *browses;
+  guint next_browse_id;
+  /* The browses of the members we are still listening to */
+  GList *member_browses;
+  guint member_deadline;
+};
+
+typedef struct
+{
+  MafwGriloAggregateSource *aggregate;
+  guint browse_id;
+  MafwSourceBrowseResultCb browse_cb;
+  gpointer user_data;
+  GList *member_browses;
+  /* With a sort criteria the rows are merged in order; the sorter
+     only compares them */
+  MafwGriloSorter *sorter;
+  /* URLs of the rows we took, so that the same item coming from
+     another member is dropped */
+  GHashTable *seen_urls;
+  /* Rows still to skip and to take, and index of the next one */
+  guint skip;
+  guint count;
+  guint index;
+  /* We hold back the last row until we know if it is the last one */
+  gchar *pending_object_id;
+  GHashTable *pending_metadata;
+  /* What we finish with when no member gave anything */
+  GError *error;
+  guint idle_source;
+  /* Below the root we only pass on what the member owning the
+     container gives */
+  gboolean passthrough;
+  gboolean cancelled;
+  gboolean finished;
+} AggregateBrowse;
+
+typedef struct
+{
+  AggregateBrowse *aggregate_browse;
+  MafwSource *member;
+  guint browse_id;
+  /* Rows waiting for their turn, when merging in order */
+  GQueue rows;
+  guint deadline_source;
+  gboolean active;
+  gboolean done;
+} MemberBrowse;
+
+typedef struct
+{
+  gchar *object_id;
+  GHashTable *metadata;
+} MemberRow;
+
+typedef struct
+{
+  MafwGriloAggregateSource *aggregate;
+  gchar *object_id;
+  MafwSourceMetadataResultCb metadata_cb;
+  gpointer user_data;
+} RootMetadata;
+
+static void
+free_row (gchar *object_id, GHashTable *metadata)
+{
+  g_free (object_id);
+  if (metadata)
+    {
+      g_hash_table_unref (metadata);
+    }
+}
+
+static void
+free_member_browse (gpointer data, gpointer user_data)
+{
+  MemberBrowse *member_browse = data;
+  MemberRow *row;
+
+  while ((row = g_queue_pop_head (&member_browse->rows)))
+    {
+      free_row (row->object_id, row->metadata);
+      g_slice_free (MemberRow, row);
+    }
+  g_object_unref (member_browse->member);
+  g_slice_free (MemberBrowse, member_browse);
+}
+
+static void
+free_aggregate_browse (gpointer data)
+{
+  AggregateBrowse *aggregate_browse = data;
+
+  /* Every member is done by now */
+  g_list_foreach (aggregate_browse->member_browses, free_member_browse, NULL);
+  g_list_free (aggregate_browse->member_browses);
+  if (aggregate_browse->idle_source)
+    {
+      g_source_remove (aggregate_browse->idle_source);
+    }
+  if (aggregate_browse->sorter)
+    {
+      mafw_grilo_sorter_free (aggregate_browse->sorter);
+    }
+  if (aggregate_browse->error)
+    {
+      g_error_free (aggregate_browse->error);
+    }
+  free_row (aggregate_browse->pending_object_id,
+            aggregate_browse->pending_metadata);
+  g_hash_table_destroy (aggregate_browse->seen_urls);
+  g_free (aggregate_browse);
+}
+
+static void
+member_done (MemberBrowse *member_browse)
+{
+  MafwGriloAggregateSourcePrivate *priv =
+    member_browse->aggregate_browse->aggregate->priv;
+
+  member_browse->done = TRUE;
+  if (member_browse->deadline_source)
+    {
+      g_source_remove (member_browse->deadline_source);
+      member_browse->deadline_source = 0;
+    }
+
+  /* Whatever the member gives from now on is not for us */
+  priv->member_browses = g_list_remove (priv->member_browses, member_browse);
+}
+
+static void
+stop_members (AggregateBrowse *aggregate_browse)
+{
+  GList *link;
+
+  for (link = aggregate_browse->member_browses; link;
+       link = g_list_next (link))
+    {
+      MemberBrowse *member_browse = link->data;
+
+      if (!member_browse->done)
+        {
+          mafw_source_cancel_browse (member_browse->member,
+                                     member_browse->browse_id, NULL);
+          member_done (member_browse);
+        }
+    }
+}
+
+static void
+deliver_pending_row (AggregateBrowse *aggregate_browse, guint remaining)
+{
+  gchar *object_id = aggregate_browse->pending_object_id;
+  GHashTable *metadata = aggregate_browse->pending_metadata;
+
+  aggregate_browse->pending_object_id = NULL;
+  aggregate_browse->pending_metadata = NULL;
+
+  aggregate_browse->browse_cb (MAFW_SOURCE (aggregate_browse->aggregate),
+                               aggregate_browse->browse_id, remaining,
+                               aggregate_browse->index++, object_id,
+                               metadata, aggregate_browse->user_data, NULL);
+
+  free_row (object_id, metadata);
+}
+
+static gboolean
+deliver_end (gpointer user_data)
+{
+  AggregateBrowse *aggregate_browse = user_data;
+  MafwGriloAggregateSourcePrivate *priv = aggregate_browse->aggregate->priv;
+
+  aggregate_browse->idle_source = 0;
+
+  /* The client that cancelled is not waiting for anything */
+  if (aggregate_browse->cancelled)
+    {
+      g_hash_table_remove (priv->browses, &aggregate_browse->browse_id);
+      return FALSE;
+    }
+
+  if (aggregate_browse->pending_object_id)
+    {
+      deliver_pending_row (aggregate_browse, 0);
+    }
+  else
+    {
+      /* An error only matters if nobody gave anything */
+      aggregate_browse->browse_cb (MAFW_SOURCE (aggregate_browse->aggregate),
+                                   aggregate_browse->browse_id, 0,
+                                   aggregate_browse->index, NULL, NULL,
+                                   aggregate_browse->user_data,
+                                   aggregate_browse->index ? NULL :
+                                   aggregate_browse->error);
+    }
+
+  g_hash_table_remove (priv->browses, &aggregate_browse->browse_id);
+
+  return FALSE;
+}
+
+static void
+finish_aggregate_browse (AggregateBrowse *aggregate_browse)
+{
+  if (aggregate_browse->finished)
+    {
+      return;
+    }
+
+  aggregate_browse->finished = TRUE;
+  stop_members (aggregate_browse);
+
+  /* The end goes from an idle, so that the client can cancel from its
+     callback and members can be cancelled from theirs */
+  aggregate_browse->idle_source = g_idle_add (deliver_end, aggregate_browse);
+}
+
+static gchar *
+get_url (GHashTable *metadata)
+{
+  GValue *value;
+
+  value = metadata ? mafw_metadata_first (metadata, MAFW_METADATA_KEY_URI) :
+    NULL;
+
+  return value ? mafw_grilo_value_dup_string (value) : NULL;
+}
+
+/* Takes the row */
+static void
+add_row (AggregateBrowse *aggregate_browse, gchar *object_id,
+         GHashTable *metadata)
+{
+  gchar *url;
+
+  if (aggregate_browse->finished)
+    {
+      free_row (object_id, metadata);
+      return;
+    }
+
+  /* Containers have no URL, so they are never the same item */
+  url = get_url (metadata);
+  if (url)
+    {
+      if (g_hash_table_lookup (aggregate_browse->seen_urls, url))
+        {
+          g_free (url);
+          free_row (object_id, metadata);
+          return;
+        }
+      g_hash_table_insert (aggregate_browse->seen_urls, url, url);
+    }
+
+  if (aggregate_browse->skip)
+    {
+      aggregate_browse->skip--;
+      free_row (object_id, metadata);
+      return;
+    }
+
+  /* The row we were holding back is not the last one, so it can go
+     now. We tell as remaining what is left of the window. */
+  if (aggregate_browse->pending_object_id)
+    {
+      deliver_pending_row (aggregate_browse, aggregate_browse->count);
+
+      if (aggregate_browse->finished)
+        {
+          /* The client cancelled from the callback */
+          free_row (object_id, metadata);
+          return;
+        }
+    }
+
+  aggregate_browse->pending_object_id = object_id;
+  aggregate_browse->pending_metadata = metadata;
+
+  if (--aggregate_browse->count == 0)
+    {
+      finish_aggregate_browse (aggregate_browse);
+    }
+}
+
+/* Takes the rows that can go in order: the first of all the members,
+   as long as every member still going has given its next one */
+static void
+merge_member_rows (AggregateBrowse *aggregate_browse)
+{
+  while (!aggregate_browse->finished)
+    {
+      MemberBrowse *next = NULL;
+      MemberRow *row;
+      GList *link;
+
+      for (link = aggregate_browse->member_browses; link;
+           link = g_list_next (link))
+        {
+          MemberBrowse *member_browse = link->data;
+
+          row = g_queue_peek_head (&member_browse->rows);
+          if (!row)
+            {
+              if (!member_browse->done)
+                {
+                  return;
+                }
+              continue;
+            }
+
+          /* Among equal rows the first member goes first */
+          if (!next ||
+              mafw_grilo_sorter_compare (aggregate_browse->sorter,
+                                         ((MemberRow *)
+                                          g_queue_peek_head (&next->rows))->
+                                         metadata, row->metadata) > 0)
+            {
+              next = member_browse;
+            }
+        }
+
+      if (!next)
+        {
+          return;
+        }
+
+      row = g_queue_pop_head (&next->rows);
+      add_row (aggregate_browse, row->object_id, row->metadata);
+      g_slice_free (MemberRow, row);
+    }
+}
+
+static void
+check_aggregate_browse (AggregateBrowse *aggregate_browse)
+{
+  GList *link;
+
+  if (aggregate_browse->sorter)
+    {
+      merge_member_rows (aggregate_browse);
+    }
+
+  for (link = aggregate_browse->member_browses; link;
+       link = g_list_next (link))
+    {
+      MemberBrowse *member_browse = link->data;
+
+      if (!member_browse->done ||
+          !g_queue_is_empty (&member_browse->rows))
+        {
+          return;
+        }
+    }
+
+  finish_aggregate_browse (aggregate_browse);
+}
+
+static gboolean
+expire_member (gpointer user_data)
+{
+  MemberBrowse *member_browse = user_data;
+
+  /* It gave something since last time, so it is not stuck */
+  if (member_browse->active)
+    {
+      member_browse->active = FALSE;
+      return TRUE;
+    }
+
+  g_debug ("%s is too slow, going on without it",
+           mafw_extension_get_uuid (MAFW_EXTENSION (member_browse->member)));
+
+  member_browse->deadline_source = 0;
+  mafw_source_cancel_browse (member_browse->member, member_browse->browse_id,
+                             NULL);
+  member_done (member_browse);
+  check_aggregate_browse (member_browse->aggregate_browse);
+
+  return FALSE;
+}
+
+static MemberBrowse *
+find_member_browse (MafwGriloAggregateSource *aggregate, MafwSource *member,
+                    guint browse_id)
+{
+  GList *link;
+
+  for (link = aggregate->priv->member_browses; link;
+       link = g_list_next (link))
+    {
+      MemberBrowse *member_browse = link->data;
+
+      if (member_browse->member == member &&
+          member_browse->browse_id == browse_id)
+        {
+          return member_browse;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+pass_row (MemberBrowse *member_browse, gint remaining, guint index,
+          const gchar *object_id, GHashTable *metadata, const GError *error)
+{
+  AggregateBrowse *aggregate_browse = member_browse->aggregate_browse;
+
+  if (remaining == 0)
+    {
+      member_done (member_browse);
+    }
+
+  /* The member already did the window, so its rows go as they are */
+  aggregate_browse->browse_cb (MAFW_SOURCE (aggregate_browse->aggregate),
+                               aggregate_browse->browse_id, remaining, index,
+                               object_id, metadata,
+                               aggregate_browse->user_data, error);
+
+  /* The client has the end already, unless it cancelled from the
+     callback */
+  if (remaining == 0 && !aggregate_browse->finished)
+    {
+      aggregate_browse->cancelled = TRUE;
+      finish_aggregate_browse (aggregate_browse);
+    }
+}
+
+static void
+member_browse_cb (MafwSource *source, guint browse_id, gint remaining,
+                  guint index, const gchar *object_id, GHashTable *metadata,
+                  gpointer user_data, const GError *error)
+{
+  MemberBrowse *member_browse;
+  AggregateBrowse *aggregate_browse;
+
+  member_browse = find_member_browse (user_data, source, browse_id);
+  if (!member_browse)
+    {
+      /* We gave up on it */
+      return;
+    }
+
+  aggregate_browse = member_browse->aggregate_browse;
+  member_browse->active = TRUE;
+
+  if (aggregate_browse->passthrough)
+    {
+      pass_row (member_browse, remaining, index, object_id, metadata, error);
+      return;
+    }
+
+  if (error)
+    {
+      g_debug ("%s failed: %s",
+               mafw_extension_get_uuid (MAFW_EXTENSION (source)),
+               error->message);
+      if (!aggregate_browse->error)
+        {
+          aggregate_browse->error = g_error_copy (error);
+        }
+    }
+
+  if (remaining == 0)
+    {
+      member_done (member_browse);
+    }
+
+  if (object_id)
+    {
+      if (metadata)
+        {
+          g_hash_table_ref (metadata);
+        }
+
+      if (aggregate_browse->sorter)
+        {
+          MemberRow *row;
+
+          row = g_slice_new (MemberRow);
+          row->object_id = g_strdup (object_id);
+          row->metadata = metadata;
+          g_queue_push_tail (&member_browse->rows, row);
+        }
+      else
+        {
+          add_row (aggregate_browse, g_strdup (object_id), metadata);
+        }
+    }
+
+  check_aggregate_browse (aggregate_browse);
+}
+
+static gboolean
+is_root (MafwGriloAggregateSource *aggregate, const gchar *object_id)
+{
+  const gchar *uuid;
+
+  uuid = mafw_extension_get_uuid (MAFW_EXTENSION (aggregate));
+
+  return object_id && g_str_has_prefix (object_id, uuid) &&
+    strcmp (object_id + strlen (uuid), "::") == 0;
+}
+
+/* The rows we give are the members' own, so their ids tell whose they
+   are */
+static MafwSource *
+find_member (MafwGriloAggregateSource *aggregate, const gchar *object_id)
+{
+  GList *member;
+
+  for (member = aggregate->priv->members; member;
+       member = g_list_next (member))
+    {
+      const gchar *uuid;
+
+      uuid = mafw_extension_get_uuid (MAFW_EXTENSION (member->data));
+      if (object_id && g_str_has_prefix (object_id, uuid) &&
+          g_str_has_prefix (object_id + strlen (uuid), "::"))
+        {
+          return member->data;
+        }
+    }
+
+  return NULL;
+}
+
+/* We need the URL of the rows to tell the same item from different
+   members */
+static gchar **
+add_url_key (const gchar *const *metadata_keys)
+{
+  GPtrArray *keys;
+  gboolean found = FALSE;
+  gint i;
+
+  keys = g_ptr_array_new ();
+
+  for (i = 0; metadata_keys && metadata_keys[i]; i++)
+    {
+      if (strcmp (metadata_keys[i], MAFW_METADATA_KEY_URI) == 0 ||
+          strcmp (metadata_keys[i], MAFW_SOURCE_KEY_WILDCARD) == 0)
+        {
+          found = TRUE;
+        }
+      g_ptr_array_add (keys, g_strdup (metadata_keys[i]));
+    }
+
+  if (!found)
+    {
+      g_ptr_array_add (keys, g_strdup (MAFW_METADATA_KEY_URI));
+    }
+
+  g_ptr_array_add (keys, NULL);
+
+  return (gchar **) g_ptr_array_free (keys, FALSE);
+}
+
+/* Browses the root of the member when there is no object id */
+static void
+start_member_browse (AggregateBrowse *aggregate_browse, MafwSource *member,
+                     const gchar *object_id, gboolean recursive,
+                     const MafwFilter *filter, const gchar *sort_criteria,
+                     const gchar *const *metadata_keys, guint skip,
+                     guint count)
+{
+  MafwGriloAggregateSourcePrivate *priv = aggregate_browse->aggregate->priv;
+  MemberBrowse *member_browse;
+  gchar *prefix, *root_id = NULL;
+  gsize prefix_length;
+
+  member_browse = g_slice_new0 (MemberBrowse);
+  member_browse->aggregate_browse = aggregate_browse;
+  member_browse->member = g_object_ref (member);
+  g_queue_init (&member_browse->rows);
+  aggregate_browse->member_browses =
+    g_list_append (aggregate_browse->member_browses, member_browse);
+
+  if (!object_id)
+    {
+      /* The root as the member itself gives it */
+      prefix =
+        mafw_grilo_object_id_new_prefix (mafw_extension_get_uuid
+                                         (MAFW_EXTENSION (member)),
+                                         &prefix_length);
+      root_id = mafw_grilo_object_id_encode (prefix, prefix_length, NULL, 0);
+      g_free (prefix);
+      object_id = root_id;
+    }
+
+  member_browse->browse_id =
+    mafw_source_browse (member, object_id, recursive, filter, sort_criteria,
+                        metadata_keys, skip, count, member_browse_cb,
+                        aggregate_browse->aggregate);
+  g_free (root_id);
+
+  if (member_browse->browse_id == MAFW_SOURCE_INVALID_BROWSE_ID)
+    {
+      if (!aggregate_browse->error)
+        {
+          g_set_error (&aggregate_browse->error, MAFW_SOURCE_ERROR,
+                       MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+                       "%s could not browse",
+                       mafw_extension_get_uuid (MAFW_EXTENSION (member)));
+        }
+      member_browse->done = TRUE;
+      return;
+    }
+
+  priv->member_browses = g_list_prepend (priv->member_browses, member_browse);
+
+  /* Alone, the member has nobody to hold back, and its own deadlines */
+  if (!aggregate_browse->passthrough && priv->member_deadline)
+    {
+      member_browse->deadline_source =
+        g_timeout_add_seconds (priv->member_deadline, expire_member,
+                               member_browse);
+    }
+}
+
+static guint
+mafw_grilo_aggregate_source_browse (MafwSource *source,
+                                    const gchar *object_id,
+                                    gboolean recursive,
+                                    const MafwFilter *filter,
+                                    const gchar *sort_criteria,
+                                    const gchar *const *metadata_keys,
+                                    guint skip_count,
+                                    guint item_count,
+                                    MafwSourceBrowseResultCb browse_cb,
+                                    gpointer user_data)
+{
+  MafwGriloAggregateSource *aggregate = MAFW_GRILO_AGGREGATE_SOURCE (source);
+  AggregateBrowse *aggregate_browse;
+  MafwSource *owner;
+
+  g_return_val_if_fail (browse_cb, MAFW_SOURCE_INVALID_BROWSE_ID);
+
+  aggregate_browse = g_new0 (AggregateBrowse, 1);
+  aggregate_browse->aggregate = aggregate;
+  aggregate_browse->browse_id = aggregate->priv->next_browse_id++;
+  aggregate_browse->browse_cb = browse_cb;
+  aggregate_browse->user_data = user_data;
+  aggregate_browse->skip = skip_count;
+  aggregate_browse->count = item_count ? item_count : MAX_COUNT;
+  aggregate_browse->seen_urls =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_hash_table_insert (aggregate->priv->browses,
+                       &aggregate_browse->browse_id, aggregate_browse);
+
+  if (!is_root (aggregate, object_id))
+    {
+      owner = find_member (aggregate, object_id);
+      if (owner)
+        {
+          aggregate_browse->passthrough = TRUE;
+          start_member_browse (aggregate_browse, owner, object_id, recursive,
+                               filter, sort_criteria, metadata_keys,
+                               skip_count, item_count);
+        }
+      else
+        {
+          g_set_error (&aggregate_browse->error, MAFW_SOURCE_ERROR,
+                       MAFW_SOURCE_ERROR_INVALID_OBJECT_ID,
+                       "Invalid object id %s", object_id);
+        }
+    }
+  else
+    {
+      gchar **member_metadata_keys;
+      guint count;
+      GList *member;
+
+      aggregate_browse->sorter = mafw_grilo_sorter_new (sort_criteria, 1);
+
+      /* The rows we skip can come from any member */
+      member_metadata_keys = add_url_key (metadata_keys);
+      count = skip_count + MIN (aggregate_browse->count,
+                                G_MAXUINT - skip_count);
+      for (member = aggregate->priv->members; member;
+           member = g_list_next (member))
+        {
+          start_member_browse (aggregate_browse, member->data, NULL,
+                               recursive, filter, sort_criteria,
+                               (const gchar *const *) member_metadata_keys,
+                               0, count);
+        }
+      g_strfreev (member_metadata_keys);
+    }
+
+  /* Members give their rows later, so there is nothing to wait for if
+     none is browsing */
+  check_aggregate_browse (aggregate_browse);
+
+  return aggregate_browse->browse_id;
+}
+
+static gboolean
+mafw_grilo_aggregate_source_cancel_browse (MafwSource *source,
+                                           guint browse_id,
+                                           GError **error)
+{
+  MafwGriloAggregateSource *aggregate = MAFW_GRILO_AGGREGATE_SOURCE (source);
+  AggregateBrowse *aggregate_browse;
+
+  aggregate_browse = g_hash_table_lookup (aggregate->priv->browses,
+                                          &browse_id);
+  if (!aggregate_browse)
+    {
+      g_set_error (error, MAFW_SOURCE_ERROR,
+                   MAFW_SOURCE_ERROR_INVALID_BROWSE_ID,
+                   "Browse not active. Could not cancel.");
+      return FALSE;
+    }
+
+  /* The client gets nothing else, not even the end of the browse */
+  aggregate_browse->cancelled = TRUE;
+  finish_aggregate_browse (aggregate_browse);
+
+  return TRUE;
+}
+
+static gboolean
+answer_root_metadata (gpointer user_data)
+{
+  RootMetadata *root_metadata = user_data;
+  GHashTable *metadata;
+
+  metadata = mafw_metadata_new ();
+  mafw_metadata_add_str (metadata, MAFW_METADATA_KEY_TITLE,
+                         mafw_extension_get_name (MAFW_EXTENSION
+                                                  (root_metadata->
+                                                   aggregate)));
+  mafw_metadata_add_str (metadata, MAFW_METADATA_KEY_MIME,
+                         MAFW_METADATA_VALUE_MIME_CONTAINER);
+
+  root_metadata->metadata_cb (MAFW_SOURCE (root_metadata->aggregate),
+                              root_metadata->object_id, metadata,
+                              root_metadata->user_data, NULL);
+
+  g_hash_table_unref (metadata);
+  g_object_unref (root_metadata->aggregate);
+  g_free (root_metadata->object_id);
+  g_slice_free (RootMetadata, root_metadata);
+
+  return FALSE;
+}
+
+static void
+mafw_grilo_aggregate_source_get_metadata (MafwSource *source,
+                                          const gchar *object_id,
+                                          const gchar *const *metadata_keys,
+                                          MafwSourceMetadataResultCb
+                                          metadata_cb,
+                                          gpointer user_data)
+{
+  MafwGriloAggregateSource *aggregate = MAFW_GRILO_AGGREGATE_SOURCE (source);
+  RootMetadata *root_metadata;
+  MafwSource *owner;
+  GError *error = NULL;
+
+  g_return_if_fail (metadata_cb);
+
+  if (is_root (aggregate, object_id))
+    {
+      root_metadata = g_slice_new (RootMetadata);
+      root_metadata->aggregate = g_object_ref (aggregate);
+      root_metadata->object_id = g_strdup (object_id);
+      root_metadata->metadata_cb = metadata_cb;
+      root_metadata->user_data = user_data;
+      g_idle_add (answer_root_metadata, root_metadata);
+      return;
+    }
+
+  owner = find_member (aggregate, object_id);
+  if (owner)
+    {
+      mafw_source_get_metadata (owner, object_id, metadata_keys, metadata_cb,
+                                user_data);
+      return;
+    }
+
+  g_set_error (&error, MAFW_SOURCE_ERROR,
+               MAFW_SOURCE_ERROR_INVALID_OBJECT_ID,
+               "Invalid object id %s", object_id);
+  metadata_cb (source, object_id, NULL, user_data, error);
+  g_error_free (error);
+}
+
+void
+mafw_grilo_aggregate_source_add_member (MafwGriloAggregateSource *aggregate,
+                                        MafwSource *member)
+{
+  g_return_if_fail (MAFW_IS_GRILO_AGGREGATE_SOURCE (aggregate));
+  g_return_if_fail (MAFW_IS_SOURCE (member));
+
+  /* Browses going on do not get the new member */
+  aggregate->priv->members =
+    g_list_append (aggregate->priv->members, g_object_ref (member));
+}
+
+void
+mafw_grilo_aggregate_source_remove_member (MafwGriloAggregateSource *aggregate,
+                                           MafwSource *member)
+{
+  GList *member_browses = NULL, *link;
+
+  g_return_if_fail (MAFW_IS_GRILO_AGGREGATE_SOURCE (aggregate));
+
+  if (!g_list_find (aggregate->priv->members, member))
+    {
+      return;
+    }
+
+  /* Browses going on finish with what they had from it. Finishing a
+     browse changes the list, so we look first. */
+  for (link = aggregate->priv->member_browses; link;
+       link = g_list_next (link))
+    {
+      MemberBrowse *member_browse = link->data;
+
+      if (member_browse->member == member)
+        {
+          member_browses = g_list_prepend (member_browses, member_browse);
+        }
+    }
+  for (link = member_browses; link; link = g_list_next (link))
+    {
+      MemberBrowse *member_browse = link->data;
+
+      member_done (member_browse);
+      check_aggregate_browse (member_browse->aggregate_browse);
+    }
+  g_list_free (member_browses);
+
+  aggregate->priv->members = g_list_remove (aggregate->priv->members, member);
+  g_object_unref (member);
+}
+
+static void
+mafw_grilo_aggregate_source_get_property (MafwExtension *self,
+                                          const gchar *key,
+                                          MafwExtensionPropertyCallback
+                                          callback,
+                                          gpointer user_data)
+{
+  MafwGriloAggregateSource *aggregate = MAFW_GRILO_AGGREGATE_SOURCE (self);
+  GValue *value = NULL;
+  GError *error = NULL;
+
+  g_return_if_fail (MAFW_IS_GRILO_AGGREGATE_SOURCE (self));
+  g_return_if_fail (callback != NULL);
+  g_return_if_fail (key != NULL);
+
+  if (strcmp (key, MAFW_PROPERTY_GRILO_AGGREGATE_MEMBER_DEADLINE) == 0)
+    {
+      /* Seconds */
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, aggregate->priv->member_deadline);
+    }
+  else
+    {
+      /* Unsupported property */
+      error = g_error_new (MAFW_EXTENSION_ERROR,
+                           MAFW_EXTENSION_ERROR_GET_PROPERTY,
+                           "Unsupported property");
+    }
+
+  callback (self, key, value, user_data, error);
+}
+
+static void
+mafw_grilo_aggregate_source_set_property (MafwExtension *self,
+                                          const gchar *key,
+                                          const GValue *value)
+{
+  MafwGriloAggregateSource *aggregate = MAFW_GRILO_AGGREGATE_SOURCE (self);
+
+  g_return_if_fail (MAFW_IS_GRILO_AGGREGATE_SOURCE (self));
+  g_return_if_fail (key != NULL);
+
+  if (strcmp (key, MAFW_PROPERTY_GRILO_AGGREGATE_MEMBER_DEADLINE) == 0)
+    {
+      /* Applies to the browses started from now on */
+      aggregate->priv->member_deadline = g_value_get_uint (value);
+    }
+  else
+    {
+      return;
+    }
+
+  mafw_extension_emit_property_changed (self, key, value);
+}
+
+static void
+finalize (GObject *object)
+{
+  MafwGriloAggregateSource *aggregate = MAFW_GRILO_AGGREGATE_SOURCE (object);
+  GList *browses, *browse;
+
+  /* The clients do not get the end of their browses anymore */
+  browses = g_hash_table_get_values (aggregate->priv->browses);
+  for (browse = browses; browse; browse = g_list_next (browse))
+    {
+      stop_members (browse->data);
+    }
+  g_list_free (browses);
+
+  g_hash_table_destroy (aggregate->priv->browses);
+  g_list_foreach (aggregate->priv->members, (GFunc) g_object_unref, NULL);
+  g_list_free (aggregate->priv->members);
+
+  G_OBJECT_CLASS (mafw_grilo_aggregate_source_parent_class)->finalize (object);
+}
+
+static void
+mafw_grilo_aggregate_source_class_init (MafwGriloAggregateSourceClass *klass)
+{
+  GObjectClass *gobject_class;
+  MafwSourceClass *source_class;
+
+  g_return_if_fail (klass != NULL);
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  source_class = MAFW_SOURCE_CLASS (klass);
+
+  g_type_class_add_private (gobject_class,
+                            sizeof (MafwGriloAggregateSourcePrivate));
+
+  source_class->browse = mafw_grilo_aggregate_source_browse;
+  source_class->cancel_browse = mafw_grilo_aggregate_source_cancel_browse;
+  source_class->get_metadata = mafw_grilo_aggregate_source_get_metadata;
+
+  gobject_class->finalize = finalize;
+
+  MAFW_EXTENSION_CLASS (klass)->get_extension_property =
+    mafw_grilo_aggregate_source_get_property;
+  MAFW_EXTENSION_CLASS (klass)->set_extension_property =
+    mafw_grilo_aggregate_source_set_property;
+}
+
+static void
+mafw_grilo_aggregate_source_init (MafwGriloAggregateSource *self)
+{
+  MafwGriloAggregateSourcePrivate *priv;
+
+  priv = self->priv = MAFW_GRILO_AGGREGATE_SOURCE_GET_PRIVATE (self);
+
+  priv->members = NULL;
+  priv->member_browses = NULL;
+  priv->next_browse_id = 1;
+  priv->member_deadline = DEFAULT_MEMBER_DEADLINE;
+  priv->browses = g_hash_table_new_full (g_int_hash, g_int_equal, NULL,
+                                         free_aggregate_browse);
+
+  mafw_extension_add_property (MAFW_EXTENSION (self),
+                               MAFW_PROPERTY_GRILO_AGGREGATE_MEMBER_DEADLINE,
+                               G_TYPE_UINT);
+}
+
+MafwGriloAggregateSource *
+mafw_grilo_aggregate_source_new (const gchar *plugin_name)
+{
+  return g_object_new (MAFW_TYPE_GRILO_AGGREGATE_SOURCE,
+                       "plugin", plugin_name,
+                       "uuid", MAFW_GRILO_AGGREGATE_SOURCE_UUID,
+                       "name", MAFW_GRILO_AGGREGATE_SOURCE_NAME,
+                       NULL);
+}
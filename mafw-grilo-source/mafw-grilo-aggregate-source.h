@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include <libmafw/mafw-source.h>
+
+#ifndef MAFW_GRILO_AGGREGATE_SOURCE_H
+#define MAFW_GRILO_AGGREGATE_SOURCE_H
+
+G_BEGIN_DECLS
+
+/* A source whose root gives the rows of the roots of all its members
+   at once. Browses and searches go to every member in parallel and
+   their rows are merged as they come, in order when there is a sort
+   criteria. The rows keep the object ids of their members, and
+   browses below the root go to the member owning the container. */
+
+#define MAFW_TYPE_GRILO_AGGREGATE_SOURCE		\
+	(mafw_grilo_aggregate_source_get_type ())
+
+#define MAFW_GRILO_AGGREGATE_SOURCE(obj)				\
+	(G_TYPE_CHECK_INSTANCE_CAST ((obj),				\
+				     MAFW_TYPE_GRILO_AGGREGATE_SOURCE,	\
+				     MafwGriloAggregateSource))
+#define MAFW_IS_GRILO_AGGREGATE_SOURCE(obj)				\
+	(G_TYPE_CHECK_INSTANCE_TYPE ((obj),				\
+				     MAFW_TYPE_GRILO_AGGREGATE_SOURCE))
+
+#define MAFW_GRILO_AGGREGATE_SOURCE_CLASS(klass)			\
+	(G_TYPE_CHECK_CLASS_CAST((klass),				\
+				 MAFW_TYPE_GRILO_AGGREGATE_SOURCE,	\
+				 MafwGriloAggregateSourceClass))
+
+#define MAFW_IS_GRILO_AGGREGATE_SOURCE_CLASS(klass)			\
+	(G_TYPE_CHECK_CLASS_TYPE((klass),				\
+				 MAFW_TYPE_GRILO_AGGREGATE_SOURCE))
+
+#define MAFW_GRILO_AGGREGATE_SOURCE_GET_CLASS(obj)			\
+	(G_TYPE_INSTANCE_GET_CLASS ((obj),				\
+				    MAFW_TYPE_GRILO_AGGREGATE_SOURCE,	\
+				    MafwGriloAggregateSourceClass))
+
+typedef struct _MafwGriloAggregateSource MafwGriloAggregateSource;
+typedef struct _MafwGriloAggregateSourceClass MafwGriloAggregateSourceClass;
+typedef struct _MafwGriloAggregateSourcePrivate MafwGriloAggregateSourcePrivate;
+
+struct _MafwGriloAggregateSource {
+	MafwSource parent;
+	MafwGriloAggregateSourcePrivate *priv;
+};
+
+struct _MafwGriloAggregateSourceClass {
+	MafwSourceClass parent_class;
+};
+
+GType mafw_grilo_aggregate_source_get_type(void);
+
+MafwGriloAggregateSource *
+mafw_grilo_aggregate_source_new (const gchar *plugin_name);
+void mafw_grilo_aggregate_source_add_member (MafwGriloAggregateSource *aggregate,
+                                             MafwSource *member);
+void
+mafw_grilo_aggregate_source_remove_member (MafwGriloAggregateSource *aggregate,
+                                           MafwSource *member);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_AGGREGATE_SOURCE_H */
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+
+#include <libmafw/mafw.h>
+
+#include "mafw-grilo-filter.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+gboolean
+mafw_grilo_value_get_number (const GValue *value, gdouble *number)
+{
+  GValue double_value = { 0 };
+
+  if (!G_VALUE_HOLDS_STRING (value) &&
+      g_value_type_transformable (G_VALUE_TYPE (value), G_TYPE_DOUBLE))
+    {
+      g_value_init (&double_value, G_TYPE_DOUBLE);
+      g_value_transform (value, &double_value);
+      *number = g_value_get_double (&double_value);
+      g_value_unset (&double_value);
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+gchar *
+mafw_grilo_value_dup_string (const GValue *value)
+{
+  GValue string_value = { 0 };
+  gchar *string = NULL;
+
+  if (G_VALUE_HOLDS_STRING (value))
+    {
+      return g_value_dup_string (value);
+    }
+
+  if (g_value_type_transformable (G_VALUE_TYPE (value), G_TYPE_STRING))
+    {
+      g_value_init (&string_value, G_TYPE_STRING);
+      g_value_transform (value, &string_value);
+      string = g_value_dup_string (&string_value);
+      g_value_unset (&string_value);
+    }
+
+  return string;
+}
+
+static gboolean
+value_matches (const MafwFilter *filter, const GValue *value)
+{
+  gdouble number;
+  gchar *string;
+  gboolean matches = FALSE;
+
+  /* Numbers are compared as numbers, so that "lt" and "gt" make
+     sense for durations, ratings... */
+  if (filter->type != mafw_f_approx && mafw_grilo_value_get_number (value, &number))
+    {
+      gchar *end;
+      gdouble filter_number = g_ascii_strtod (filter->value, &end);
+
+      if (end != filter->value && *end == '\0')
+        {
+          switch (filter->type)
+            {
+            case mafw_f_eq:
+              return number == filter_number;
+            case mafw_f_lt:
+              return number < filter_number;
+            case mafw_f_gt:
+              return number > filter_number;
+            default:
+              return FALSE;
+            }
+        }
+    }
+
+  string = mafw_grilo_value_dup_string (value);
+  if (!string)
+    {
+      return FALSE;
+    }
+
+  switch (filter->type)
+    {
+    case mafw_f_eq:
+      matches = strcmp (string, filter->value) == 0;
+      break;
+    case mafw_f_lt:
+      matches = strcmp (string, filter->value) < 0;
+      break;
+    case mafw_f_gt:
+      matches = strcmp (string, filter->value) > 0;
+      break;
+    case mafw_f_approx:
+      {
+        gchar *folded_string, *folded_value;
+
+        folded_string = g_utf8_casefold (string, -1);
+        folded_value = g_utf8_casefold (filter->value, -1);
+        matches = strstr (folded_string, folded_value) != NULL;
+        g_free (folded_string);
+        g_free (folded_value);
+      }
+      break;
+    default:
+      break;
+    }
+
+  g_free (string);
+
+  return matches;
+}
+
+gboolean
+mafw_grilo_filter_matches (const MafwFilter *filter, GHashTable *metadata)
+{
+  gpointer value;
+  gint i;
+
+  if (!filter)
+    {
+      return TRUE;
+    }
+
+  switch (filter->type)
+    {
+    case mafw_f_and:
+      for (i = 0; filter->parts[i]; i++)
+        {
+          if (!mafw_grilo_filter_matches (filter->parts[i], metadata))
+            {
+              return FALSE;
+            }
+        }
+      return TRUE;
+    case mafw_f_or:
+      for (i = 0; filter->parts[i]; i++)
+        {
+          if (mafw_grilo_filter_matches (filter->parts[i], metadata))
+            {
+              return TRUE;
+            }
+        }
+      return FALSE;
+    case mafw_f_not:
+      return !mafw_grilo_filter_matches (filter->parts[0], metadata);
+    default:
+      break;
+    }
+
+  value = metadata ? g_hash_table_lookup (metadata, filter->key) : NULL;
+
+  if (filter->type == mafw_f_exists)
+    {
+      return value != NULL;
+    }
+
+  if (!value)
+    {
+      return FALSE;
+    }
+
+  /* Any of the values of the key is enough */
+  if (mafw_metadata_nvalues (value) == 1)
+    {
+      return value_matches (filter, value);
+    }
+  else
+    {
+      GValueArray *array = value;
+      guint n;
+
+      for (n = 0; n < array->n_values; n++)
+        {
+          if (value_matches (filter, &array->values[n]))
+            {
+              return TRUE;
+            }
+        }
+    }
+
+  return FALSE;
+}
+
+/* Grilo plugins match the search text against these keys, for the
+   rest a search could leave out rows the filter accepts */
+static gboolean
+is_search_key (const gchar *key)
+{
+  return strcmp (key, MAFW_METADATA_KEY_TITLE) == 0 ||
+    strcmp (key, MAFW_METADATA_KEY_ARTIST) == 0 ||
+    strcmp (key, MAFW_METADATA_KEY_ALBUM) == 0;
+}
+
+gchar *
+mafw_grilo_filter_get_search_text (const MafwFilter *filter)
+{
+  gchar *text = NULL;
+  gint i;
+
+  if (!filter)
+    {
+      return NULL;
+    }
+
+  /* Grilo searches are plain text, so they can only narrow the results
+     down. The filter is always checked on what comes back. */
+  switch (filter->type)
+    {
+    case mafw_f_eq:
+    case mafw_f_approx:
+      if (is_search_key (filter->key) &&
+          filter->value && filter->value[0] != '\0')
+        {
+          text = g_strdup (filter->value);
+        }
+      break;
+    case mafw_f_and:
+      /* Any of the conditions will do */
+      for (i = 0; !text && filter->parts[i]; i++)
+        {
+          text = mafw_grilo_filter_get_search_text (filter->parts[i]);
+        }
+      break;
+    case mafw_f_or:
+      /* Only when all the alternatives look for the same text, as in
+         "title or artist contain X" */
+      for (i = 0; filter->parts[i]; i++)
+        {
+          gchar *part_text;
+
+          part_text = mafw_grilo_filter_get_search_text (filter->parts[i]);
+
+          if (!part_text || (text && strcmp (text, part_text) != 0))
+            {
+              g_free (part_text);
+              g_free (text);
+              return NULL;
+            }
+
+          g_free (text);
+          text = part_text;
+        }
+      break;
+    default:
+      break;
+    }
+
+  return text;
+}
+
+static void
+collect_filter_keys (const MafwFilter *filter, GPtrArray *keys)
+{
+  gint i;
+
+  switch (filter->type)
+    {
+    case mafw_f_and:
+    case mafw_f_or:
+    case mafw_f_not:
+      for (i = 0; filter->parts[i]; i++)
+        {
+          collect_filter_keys (filter->parts[i], keys);
+        }
+      break;
+    default:
+      for (i = 0; i < keys->len; i++)
+        {
+          if (strcmp (g_ptr_array_index (keys, i), filter->key) == 0 ||
+              strcmp (g_ptr_array_index (keys, i),
+                      MAFW_SOURCE_KEY_WILDCARD) == 0)
+            {
+              return;
+            }
+        }
+      g_ptr_array_add (keys, g_strdup (filter->key));
+      break;
+    }
+}
+
+gchar **
+mafw_grilo_filter_add_keys (const MafwFilter *filter,
+                            const gchar *const *metadata_keys)
+{
+  GPtrArray *keys;
+  gint i;
+
+  /* To check the filter we need the keys it talks about */
+  keys = g_ptr_array_new ();
+
+  for (i = 0; metadata_keys && metadata_keys[i]; i++)
+    {
+      g_ptr_array_add (keys, g_strdup (metadata_keys[i]));
+    }
+
+  if (filter)
+    {
+      collect_filter_keys (filter, keys);
+    }
+
+  g_ptr_array_add (keys, NULL);
+
+  return (gchar **) g_ptr_array_free (keys, FALSE);
+}
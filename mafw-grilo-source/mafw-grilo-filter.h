@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <libmafw/mafw.h>
+
+#ifndef MAFW_GRILO_FILTER_H
+#define MAFW_GRILO_FILTER_H
+
+G_BEGIN_DECLS
+
+gboolean mafw_grilo_filter_matches (const MafwFilter *filter,
+                                    GHashTable *metadata);
+gchar *mafw_grilo_filter_get_search_text (const MafwFilter *filter);
+gchar **mafw_grilo_filter_add_keys (const MafwFilter *filter,
+                                    const gchar *const *metadata_keys);
+
+gboolean mafw_grilo_value_get_number (const GValue *value, gdouble *number);
+gchar *mafw_grilo_value_dup_string (const GValue *value);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_FILTER_H */
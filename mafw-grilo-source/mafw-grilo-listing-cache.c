@@ -0,0 +1,701 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+
+#include <libmafw/mafw.h>
+
+#include "mafw-grilo-listing-cache.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+/* Upper bound of rows kept for a single listing, so that a huge
+   container cannot eat all the memory by itself */
+#define MAX_LISTING_ROWS 65536
+
+#define STRING_CHUNK_SIZE 4096
+
+typedef struct
+{
+  const gchar *object_id;
+  guint first_value;
+  guint n_values;
+} ListingRow;
+
+typedef struct
+{
+  const gchar *key;
+  GType type;
+  union
+  {
+    gint v_int;
+    guint v_uint;
+    glong v_long;
+    gint64 v_int64;
+    gfloat v_float;
+    gdouble v_double;
+    gboolean v_boolean;
+    const gchar *v_string;
+  } data;
+} ListingValue;
+
+struct _MafwGriloListing
+{
+  gint ref_count;
+  gchar *key;
+  glong created;
+  guint base;
+  gboolean end_known;
+  gboolean sealed;
+  /* The rows come from an earlier run and might be outdated, and the
+     run replacing them if we are fetching them again */
+  gboolean stale;
+  MafwGriloListing *refresh;
+  GArray *rows;
+  GArray *values;
+  GStringChunk *strings;
+  GList *lru_link;
+};
+
+struct _MafwGriloListingCache
+{
+  guint ttl;
+  guint max_entries;
+  GHashTable *listings;
+  GQueue lru;
+};
+
+static glong
+get_current_seconds (void)
+{
+  GTimeVal now;
+
+  g_get_current_time (&now);
+
+  return now.tv_sec;
+}
+
+static MafwGriloListing *
+listing_new (const gchar *key, guint base)
+{
+  MafwGriloListing *listing;
+
+  listing = g_slice_new0 (MafwGriloListing);
+  listing->ref_count = 1;
+  listing->key = g_strdup (key);
+  listing->created = get_current_seconds ();
+  listing->base = base;
+  listing->rows = g_array_new (FALSE, FALSE, sizeof (ListingRow));
+  listing->values = g_array_new (FALSE, FALSE, sizeof (ListingValue));
+  listing->strings = g_string_chunk_new (STRING_CHUNK_SIZE);
+
+  return listing;
+}
+
+MafwGriloListing *
+mafw_grilo_listing_ref (MafwGriloListing *listing)
+{
+  g_return_val_if_fail (listing != NULL, NULL);
+
+  listing->ref_count++;
+
+  return listing;
+}
+
+void
+mafw_grilo_listing_unref (MafwGriloListing *listing)
+{
+  g_return_if_fail (listing != NULL);
+
+  if (--listing->ref_count > 0)
+    {
+      return;
+    }
+
+  if (listing->refresh)
+    {
+      mafw_grilo_listing_unref (listing->refresh);
+    }
+  g_free (listing->key);
+  g_array_free (listing->rows, TRUE);
+  g_array_free (listing->values, TRUE);
+  g_string_chunk_free (listing->strings);
+  g_slice_free (MafwGriloListing, listing);
+}
+
+static const gchar *
+intern_value_string (MafwGriloListing *listing, const gchar *key,
+                     const gchar *string)
+{
+  /* Artists, albums, genres and mimes repeat a lot along a listing,
+     so we only keep one copy of them. The rest of strings are usually
+     unique and hashing them would be a waste. */
+  if (strcmp (key, MAFW_METADATA_KEY_ARTIST) == 0 ||
+      strcmp (key, MAFW_METADATA_KEY_ALBUM) == 0 ||
+      strcmp (key, MAFW_METADATA_KEY_GENRE) == 0 ||
+      strcmp (key, MAFW_METADATA_KEY_MIME) == 0)
+    {
+      return g_string_chunk_insert_const (listing->strings, string);
+    }
+
+  return g_string_chunk_insert (listing->strings, string);
+}
+
+static gboolean
+listing_append_value (MafwGriloListing *listing, const gchar *key,
+                      const GValue *value)
+{
+  ListingValue listing_value;
+
+  listing_value.key = g_string_chunk_insert_const (listing->strings, key);
+  listing_value.type = G_VALUE_TYPE (value);
+
+  switch (G_TYPE_FUNDAMENTAL (listing_value.type))
+    {
+    case G_TYPE_INT:
+      listing_value.data.v_int = g_value_get_int (value);
+      break;
+    case G_TYPE_UINT:
+      listing_value.data.v_uint = g_value_get_uint (value);
+      break;
+    case G_TYPE_LONG:
+      listing_value.data.v_long = g_value_get_long (value);
+      break;
+    case G_TYPE_INT64:
+      listing_value.data.v_int64 = g_value_get_int64 (value);
+      break;
+    case G_TYPE_FLOAT:
+      listing_value.data.v_float = g_value_get_float (value);
+      break;
+    case G_TYPE_DOUBLE:
+      listing_value.data.v_double = g_value_get_double (value);
+      break;
+    case G_TYPE_BOOLEAN:
+      listing_value.data.v_boolean = g_value_get_boolean (value);
+      break;
+    case G_TYPE_STRING:
+      if (!g_value_get_string (value))
+        {
+          return TRUE;
+        }
+      listing_value.data.v_string =
+        intern_value_string (listing, key, g_value_get_string (value));
+      break;
+    default:
+      g_debug ("Cannot cache values of type %s",
+               g_type_name (listing_value.type));
+      return FALSE;
+    }
+
+  g_array_append_val (listing->values, listing_value);
+
+  return TRUE;
+}
+
+static gboolean
+listing_append_row (MafwGriloListing *listing, const gchar *object_id,
+                    GHashTable *metadata)
+{
+  ListingRow row;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  row.object_id = g_string_chunk_insert (listing->strings, object_id);
+  row.first_value = listing->values->len;
+
+  if (metadata)
+    {
+      g_hash_table_iter_init (&iter, metadata);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          if (mafw_metadata_nvalues (value) == 1)
+            {
+              if (!listing_append_value (listing, key, value))
+                {
+                  goto failed;
+                }
+            }
+          else
+            {
+              GValueArray *array = value;
+              guint i;
+
+              for (i = 0; i < array->n_values; i++)
+                {
+                  if (!listing_append_value (listing, key,
+                                             &array->values[i]))
+                    {
+                      goto failed;
+                    }
+                }
+            }
+        }
+    }
+
+  row.n_values = listing->values->len - row.first_value;
+  g_array_append_val (listing->rows, row);
+
+  return TRUE;
+
+ failed:
+  g_array_set_size (listing->values, row.first_value);
+  return FALSE;
+}
+
+static GHashTable *
+listing_row_to_metadata (MafwGriloListing *listing, ListingRow *row)
+{
+  GHashTable *metadata;
+  guint i;
+
+  metadata = mafw_metadata_new ();
+
+  for (i = row->first_value; i < row->first_value + row->n_values; i++)
+    {
+      ListingValue *listing_value;
+      GValue value = { 0, };
+
+      listing_value = &g_array_index (listing->values, ListingValue, i);
+      g_value_init (&value, listing_value->type);
+
+      switch (G_TYPE_FUNDAMENTAL (listing_value->type))
+        {
+        case G_TYPE_INT:
+          g_value_set_int (&value, listing_value->data.v_int);
+          break;
+        case G_TYPE_UINT:
+          g_value_set_uint (&value, listing_value->data.v_uint);
+          break;
+        case G_TYPE_LONG:
+          g_value_set_long (&value, listing_value->data.v_long);
+          break;
+        case G_TYPE_INT64:
+          g_value_set_int64 (&value, listing_value->data.v_int64);
+          break;
+        case G_TYPE_FLOAT:
+          g_value_set_float (&value, listing_value->data.v_float);
+          break;
+        case G_TYPE_DOUBLE:
+          g_value_set_double (&value, listing_value->data.v_double);
+          break;
+        case G_TYPE_BOOLEAN:
+          g_value_set_boolean (&value, listing_value->data.v_boolean);
+          break;
+        case G_TYPE_STRING:
+          g_value_set_static_string (&value, listing_value->data.v_string);
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+
+      mafw_metadata_add_val (metadata, (gchar *) listing_value->key, &value);
+      g_value_unset (&value);
+    }
+
+  return metadata;
+}
+
+guint
+mafw_grilo_listing_get_base (MafwGriloListing *listing)
+{
+  g_return_val_if_fail (listing != NULL, 0);
+
+  return listing->base;
+}
+
+gboolean
+mafw_grilo_listing_is_stale (MafwGriloListing *listing)
+{
+  g_return_val_if_fail (listing != NULL, FALSE);
+
+  return listing->stale;
+}
+
+guint
+mafw_grilo_listing_get_available (MafwGriloListing *listing, guint position)
+{
+  g_return_val_if_fail (listing != NULL, 0);
+
+  if (position < listing->base ||
+      position >= listing->base + listing->rows->len)
+    {
+      return 0;
+    }
+
+  return listing->base + listing->rows->len - position;
+}
+
+gboolean
+mafw_grilo_listing_is_end (MafwGriloListing *listing, guint position)
+{
+  g_return_val_if_fail (listing != NULL, FALSE);
+
+  return listing->end_known &&
+    position == listing->base + listing->rows->len;
+}
+
+const gchar *
+mafw_grilo_listing_get_row (MafwGriloListing *listing, guint position,
+                            GHashTable **metadata)
+{
+  ListingRow *row;
+
+  g_return_val_if_fail (listing != NULL, NULL);
+
+  if (!mafw_grilo_listing_get_available (listing, position))
+    {
+      return NULL;
+    }
+
+  row = &g_array_index (listing->rows, ListingRow, position - listing->base);
+
+  if (metadata)
+    {
+      *metadata = listing_row_to_metadata (listing, row);
+    }
+
+  return row->object_id;
+}
+
+MafwGriloListingCache *
+mafw_grilo_listing_cache_new (guint ttl, guint max_entries)
+{
+  MafwGriloListingCache *cache;
+
+  cache = g_new0 (MafwGriloListingCache, 1);
+  cache->ttl = ttl;
+  cache->max_entries = max_entries;
+  cache->listings =
+    g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                           (GDestroyNotify) mafw_grilo_listing_unref);
+  g_queue_init (&cache->lru);
+
+  return cache;
+}
+
+void
+mafw_grilo_listing_cache_clear (MafwGriloListingCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  g_queue_clear (&cache->lru);
+  g_hash_table_remove_all (cache->listings);
+}
+
+void
+mafw_grilo_listing_cache_free (MafwGriloListingCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  mafw_grilo_listing_cache_clear (cache);
+  g_hash_table_destroy (cache->listings);
+  g_free (cache);
+}
+
+static void
+listing_cache_remove (MafwGriloListingCache *cache,
+                      MafwGriloListing *listing)
+{
+  g_queue_delete_link (&cache->lru, listing->lru_link);
+  listing->lru_link = NULL;
+  g_hash_table_remove (cache->listings, listing->key);
+}
+
+static void
+listing_cache_trim (MafwGriloListingCache *cache, guint max_entries)
+{
+  while (g_hash_table_size (cache->listings) > max_entries)
+    {
+      listing_cache_remove (cache, g_queue_peek_head (&cache->lru));
+    }
+}
+
+void
+mafw_grilo_listing_cache_set_ttl (MafwGriloListingCache *cache, guint ttl)
+{
+  g_return_if_fail (cache != NULL);
+
+  cache->ttl = ttl;
+  if (!ttl)
+    {
+      mafw_grilo_listing_cache_clear (cache);
+    }
+}
+
+guint
+mafw_grilo_listing_cache_get_ttl (MafwGriloListingCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, 0);
+
+  return cache->ttl;
+}
+
+void
+mafw_grilo_listing_cache_set_max_entries (MafwGriloListingCache *cache,
+                                          guint max_entries)
+{
+  g_return_if_fail (cache != NULL);
+
+  cache->max_entries = max_entries;
+  listing_cache_trim (cache, max_entries);
+}
+
+guint
+mafw_grilo_listing_cache_get_max_entries (MafwGriloListingCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, 0);
+
+  return cache->max_entries;
+}
+
+MafwGriloListing *
+mafw_grilo_listing_cache_lookup (MafwGriloListingCache *cache,
+                                 const gchar *key)
+{
+  MafwGriloListing *listing;
+
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  listing = g_hash_table_lookup (cache->listings, key);
+
+  if (!listing)
+    {
+      return NULL;
+    }
+
+  if (get_current_seconds () - listing->created >= (glong) cache->ttl)
+    {
+      g_debug ("Listing for %s expired", key);
+      listing_cache_remove (cache, listing);
+      return NULL;
+    }
+
+  g_queue_unlink (&cache->lru, listing->lru_link);
+  g_queue_push_tail_link (&cache->lru, listing->lru_link);
+
+  return listing;
+}
+
+static MafwGriloListing *
+listing_cache_ensure (MafwGriloListingCache *cache, const gchar *key,
+                      guint position)
+{
+  MafwGriloListing *listing;
+
+  listing = mafw_grilo_listing_cache_lookup (cache, key);
+
+  /* We only keep one contiguous run of rows per listing. When the new
+     position does not continue it we start over, but listings being
+     replayed keep their own reference to the old run. */
+  if (listing &&
+      (position < listing->base ||
+       position > listing->base + listing->rows->len))
+    {
+      listing_cache_remove (cache, listing);
+      listing = NULL;
+    }
+
+  if (!listing)
+    {
+      listing_cache_trim (cache, cache->max_entries - 1);
+
+      listing = listing_new (key, position);
+      g_hash_table_insert (cache->listings, listing->key, listing);
+      g_queue_push_tail (&cache->lru, listing);
+      listing->lru_link = g_queue_peek_tail_link (&cache->lru);
+    }
+
+  return listing;
+}
+
+static void
+listing_store_row (MafwGriloListing *listing, const gchar *key,
+                   guint position, const gchar *object_id,
+                   GHashTable *metadata)
+{
+  /* Rows we already have are not stored again */
+  if (listing->sealed ||
+      position != listing->base + listing->rows->len)
+    {
+      return;
+    }
+
+  if (listing->rows->len >= MAX_LISTING_ROWS ||
+      !listing_append_row (listing, object_id, metadata))
+    {
+      g_debug ("Listing for %s sealed at %u rows", key, listing->rows->len);
+      listing->sealed = TRUE;
+    }
+}
+
+void
+mafw_grilo_listing_cache_store_row (MafwGriloListingCache *cache,
+                                    const gchar *key,
+                                    guint position,
+                                    const gchar *object_id,
+                                    GHashTable *metadata)
+{
+  MafwGriloListing *listing;
+
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (object_id != NULL);
+
+  if (!cache->ttl || !cache->max_entries)
+    {
+      return;
+    }
+
+  listing = g_hash_table_lookup (cache->listings, key);
+  if (listing && listing->refresh)
+    {
+      listing_store_row (listing->refresh, key, position, object_id,
+                         metadata);
+      return;
+    }
+
+  listing = listing_cache_ensure (cache, key, position);
+  listing_store_row (listing, key, position, object_id, metadata);
+}
+
+void
+mafw_grilo_listing_cache_store_end (MafwGriloListingCache *cache,
+                                    const gchar *key,
+                                    guint position)
+{
+  MafwGriloListing *listing;
+
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (key != NULL);
+
+  if (!cache->ttl || !cache->max_entries)
+    {
+      return;
+    }
+
+  listing = g_hash_table_lookup (cache->listings, key);
+  if (!listing || !listing->refresh)
+    {
+      listing = listing_cache_ensure (cache, key, position);
+    }
+  else
+    {
+      listing = listing->refresh;
+    }
+
+  if (!listing->sealed && position == listing->base + listing->rows->len)
+    {
+      listing->end_known = TRUE;
+    }
+}
+
+void
+mafw_grilo_listing_cache_set_stale (MafwGriloListingCache *cache,
+                                    const gchar *key)
+{
+  MafwGriloListing *listing;
+
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (key != NULL);
+
+  listing = g_hash_table_lookup (cache->listings, key);
+
+  if (listing)
+    {
+      listing->stale = TRUE;
+    }
+}
+
+void
+mafw_grilo_listing_cache_start_refresh (MafwGriloListingCache *cache,
+                                        const gchar *key)
+{
+  MafwGriloListing *listing;
+
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (key != NULL);
+
+  listing = g_hash_table_lookup (cache->listings, key);
+
+  if (listing && !listing->refresh)
+    {
+      listing->refresh = listing_new (key, listing->base);
+    }
+}
+
+void
+mafw_grilo_listing_cache_finish_refresh (MafwGriloListingCache *cache,
+                                         const gchar *key,
+                                         gboolean completed)
+{
+  MafwGriloListing *listing, *refresh;
+
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (key != NULL);
+
+  listing = g_hash_table_lookup (cache->listings, key);
+
+  if (!listing || !listing->refresh)
+    {
+      return;
+    }
+
+  refresh = listing->refresh;
+  listing->refresh = NULL;
+
+  /* Half a refresh is worth less than the whole stale run */
+  if (!completed || !refresh->rows->len)
+    {
+      mafw_grilo_listing_unref (refresh);
+      return;
+    }
+
+  /* The fresh run takes the place of the stale one, also in the LRU;
+     those replaying the stale one keep their reference */
+  refresh->lru_link = listing->lru_link;
+  refresh->lru_link->data = refresh;
+  listing->lru_link = NULL;
+  g_hash_table_replace (cache->listings, refresh->key, refresh);
+}
+
+void
+mafw_grilo_listing_cache_remove (MafwGriloListingCache *cache,
+                                 const gchar *key)
+{
+  MafwGriloListing *listing;
+
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (key != NULL);
+
+  listing = g_hash_table_lookup (cache->listings, key);
+
+  if (listing)
+    {
+      listing_cache_remove (cache, listing);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#ifndef MAFW_GRILO_LISTING_CACHE_H
+#define MAFW_GRILO_LISTING_CACHE_H
+
+G_BEGIN_DECLS
+
+/* A listing is the contiguous run of rows we have seen for one
+   container and one key set, starting at some position of the
+   container. Rows are kept in a single array and their values share a
+   string chunk, so that big listings stay cheap.
+
+   A stale listing being refreshed is still given to whoever looks it
+   up. The rows stored meanwhile go to a new run, which takes its place
+   once the refresh is completed. */
+
+typedef struct _MafwGriloListingCache MafwGriloListingCache;
+typedef struct _MafwGriloListing MafwGriloListing;
+
+MafwGriloListingCache *mafw_grilo_listing_cache_new (guint ttl,
+                                                     guint max_entries);
+void mafw_grilo_listing_cache_free (MafwGriloListingCache *cache);
+void mafw_grilo_listing_cache_clear (MafwGriloListingCache *cache);
+
+void mafw_grilo_listing_cache_set_ttl (MafwGriloListingCache *cache,
+                                       guint ttl);
+guint mafw_grilo_listing_cache_get_ttl (MafwGriloListingCache *cache);
+void mafw_grilo_listing_cache_set_max_entries (MafwGriloListingCache *cache,
+                                               guint max_entries);
+guint mafw_grilo_listing_cache_get_max_entries (MafwGriloListingCache *cache);
+
+MafwGriloListing *mafw_grilo_listing_cache_lookup (MafwGriloListingCache *cache,
+                                                   const gchar *key);
+void mafw_grilo_listing_cache_store_row (MafwGriloListingCache *cache,
+                                         const gchar *key,
+                                         guint position,
+                                         const gchar *object_id,
+                                         GHashTable *metadata);
+void mafw_grilo_listing_cache_store_end (MafwGriloListingCache *cache,
+                                         const gchar *key,
+                                         guint position);
+void mafw_grilo_listing_cache_set_stale (MafwGriloListingCache *cache,
+                                         const gchar *key);
+void mafw_grilo_listing_cache_start_refresh (MafwGriloListingCache *cache,
+                                             const gchar *key);
+void mafw_grilo_listing_cache_finish_refresh (MafwGriloListingCache *cache,
+                                              const gchar *key,
+                                              gboolean completed);
+void mafw_grilo_listing_cache_remove (MafwGriloListingCache *cache,
+                                      const gchar *key);
+
+MafwGriloListing *mafw_grilo_listing_ref (MafwGriloListing *listing);
+void mafw_grilo_listing_unref (MafwGriloListing *listing);
+
+guint mafw_grilo_listing_get_base (MafwGriloListing *listing);
+gboolean mafw_grilo_listing_is_stale (MafwGriloListing *listing);
+guint mafw_grilo_listing_get_available (MafwGriloListing *listing,
+                                        guint position);
+gboolean mafw_grilo_listing_is_end (MafwGriloListing *listing,
+                                    guint position);
+const gchar *mafw_grilo_listing_get_row (MafwGriloListing *listing,
+                                         guint position,
+                                         GHashTable **metadata);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_LISTING_CACHE_H */
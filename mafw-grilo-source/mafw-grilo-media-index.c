@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+
+#include <libmafw/mafw.h>
+
+#include "mafw-grilo-media-index.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+/* Metadata can change behind our back (play counts, ratings...), so
+   we do not trust it forever. Errors are kept even less time, just to
+   avoid asking again and again for an object that is not there. */
+#define MEDIA_INDEX_TTL 300
+#define MEDIA_INDEX_ERROR_TTL 10
+
+typedef struct
+{
+  gchar *object_id;
+  GHashTable *metadata;
+  GHashTable *known_keys;
+  GHashTable *guessed_keys;
+  gboolean complete;
+  GError *error;
+  glong created;
+  GList *lru_link;
+} MediaIndexEntry;
+
+struct _MafwGriloMediaIndex
+{
+  guint max_entries;
+  GHashTable *entries;
+  GQueue lru;
+};
+
+static glong
+get_current_seconds (void)
+{
+  GTimeVal now;
+
+  g_get_current_time (&now);
+
+  return now.tv_sec;
+}
+
+static void
+free_media_index_entry (gpointer data)
+{
+  MediaIndexEntry *entry = data;
+
+  g_free (entry->object_id);
+  if (entry->metadata)
+    {
+      g_hash_table_unref (entry->metadata);
+    }
+  if (entry->known_keys)
+    {
+      g_hash_table_destroy (entry->known_keys);
+    }
+  if (entry->guessed_keys)
+    {
+      g_hash_table_destroy (entry->guessed_keys);
+    }
+  if (entry->error)
+    {
+      g_error_free (entry->error);
+    }
+  g_slice_free (MediaIndexEntry, entry);
+}
+
+void
+mafw_grilo_metadata_add_value (GHashTable *metadata, const gchar *key,
+                               gpointer value)
+{
+  /* MAFW keeps a GValue for keys with one value and a GValueArray for
+     the ones with several */
+  if (mafw_metadata_nvalues (value) == 1)
+    {
+      mafw_metadata_add_val (metadata, (gchar *) key, value);
+    }
+  else
+    {
+      GValueArray *array = value;
+      guint i;
+
+      for (i = 0; i < array->n_values; i++)
+        {
+          mafw_metadata_add_val (metadata, (gchar *) key,
+                                 &array->values[i]);
+        }
+    }
+}
+
+MafwGriloMediaIndex *
+mafw_grilo_media_index_new (guint max_entries)
+{
+  MafwGriloMediaIndex *index;
+
+  index = g_new0 (MafwGriloMediaIndex, 1);
+  index->max_entries = max_entries;
+  index->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                          free_media_index_entry);
+  g_queue_init (&index->lru);
+
+  return index;
+}
+
+void
+mafw_grilo_media_index_clear (MafwGriloMediaIndex *index)
+{
+  g_return_if_fail (index != NULL);
+
+  g_queue_clear (&index->lru);
+  g_hash_table_remove_all (index->entries);
+}
+
+void
+mafw_grilo_media_index_free (MafwGriloMediaIndex *index)
+{
+  g_return_if_fail (index != NULL);
+
+  mafw_grilo_media_index_clear (index);
+  g_hash_table_destroy (index->entries);
+  g_free (index);
+}
+
+static void
+media_index_remove (MafwGriloMediaIndex *index, MediaIndexEntry *entry)
+{
+  g_queue_delete_link (&index->lru, entry->lru_link);
+  g_hash_table_remove (index->entries, entry->object_id);
+}
+
+static void
+media_index_trim (MafwGriloMediaIndex *index, guint max_entries)
+{
+  while (g_hash_table_size (index->entries) > max_entries)
+    {
+      media_index_remove (index, g_queue_peek_head (&index->lru));
+    }
+}
+
+void
+mafw_grilo_media_index_set_max_entries (MafwGriloMediaIndex *index,
+                                        guint max_entries)
+{
+  g_return_if_fail (index != NULL);
+
+  index->max_entries = max_entries;
+  media_index_trim (index, max_entries);
+}
+
+guint
+mafw_grilo_media_index_get_max_entries (MafwGriloMediaIndex *index)
+{
+  g_return_val_if_fail (index != NULL, 0);
+
+  return index->max_entries;
+}
+
+static MediaIndexEntry *
+media_index_get (MafwGriloMediaIndex *index, const gchar *object_id)
+{
+  MediaIndexEntry *entry;
+
+  entry = g_hash_table_lookup (index->entries, object_id);
+
+  if (!entry)
+    {
+      return NULL;
+    }
+
+  if (get_current_seconds () - entry->created >=
+      (entry->error ? MEDIA_INDEX_ERROR_TTL : MEDIA_INDEX_TTL))
+    {
+      media_index_remove (index, entry);
+      return NULL;
+    }
+
+  g_queue_unlink (&index->lru, entry->lru_link);
+  g_queue_push_tail_link (&index->lru, entry->lru_link);
+
+  return entry;
+}
+
+static MediaIndexEntry *
+media_index_ensure (MafwGriloMediaIndex *index, const gchar *object_id)
+{
+  MediaIndexEntry *entry;
+
+  entry = media_index_get (index, object_id);
+
+  /* What we learn now is better than a previous error */
+  if (entry && entry->error)
+    {
+      media_index_remove (index, entry);
+      entry = NULL;
+    }
+
+  if (!entry)
+    {
+      media_index_trim (index, index->max_entries - 1);
+
+      entry = g_slice_new0 (MediaIndexEntry);
+      entry->object_id = g_strdup (object_id);
+      entry->metadata = mafw_metadata_new ();
+      entry->known_keys = g_hash_table_new (g_direct_hash, g_direct_equal);
+      entry->created = get_current_seconds ();
+
+      g_hash_table_insert (index->entries, entry->object_id, entry);
+      g_queue_push_tail (&index->lru, entry);
+      entry->lru_link = g_queue_peek_tail_link (&index->lru);
+    }
+
+  return entry;
+}
+
+static void
+media_index_add_known_key (MediaIndexEntry *entry, const gchar *key)
+{
+  /* There are only a few different keys, so interning them is cheap
+     and it saves a copy per entry */
+  const gchar *interned_key = g_intern_string (key);
+
+  g_hash_table_insert (entry->known_keys, (gpointer) interned_key,
+                       (gpointer) interned_key);
+}
+
+void
+mafw_grilo_media_index_add (MafwGriloMediaIndex *index,
+                            const gchar *object_id,
+                            GHashTable *metadata,
+                            const gchar *const *known_keys)
+{
+  MediaIndexEntry *entry;
+  GHashTableIter iter;
+  gpointer key, value;
+  gint i;
+
+  g_return_if_fail (index != NULL);
+  g_return_if_fail (object_id != NULL);
+
+  if (!index->max_entries)
+    {
+      return;
+    }
+
+  entry = media_index_ensure (index, object_id);
+
+  if (metadata)
+    {
+      g_hash_table_iter_init (&iter, metadata);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          g_hash_table_remove (entry->metadata, key);
+          mafw_grilo_metadata_add_value (entry->metadata, key, value);
+          media_index_add_known_key (entry, key);
+          if (entry->guessed_keys)
+            {
+              g_hash_table_remove (entry->guessed_keys,
+                                   g_intern_string (key));
+            }
+        }
+    }
+
+  /* The keys that were asked for and did not come are known too, the
+     object just does not have them */
+  for (i = 0; known_keys && known_keys[i]; i++)
+    {
+      if (strcmp (known_keys[i], MAFW_SOURCE_KEY_WILDCARD) == 0)
+        {
+          entry->complete = TRUE;
+        }
+      else
+        {
+          media_index_add_known_key (entry, known_keys[i]);
+        }
+    }
+
+  entry->created = get_current_seconds ();
+}
+
+void
+mafw_grilo_media_index_set_guessed (MafwGriloMediaIndex *index,
+                                    const gchar *object_id,
+                                    const gchar *key)
+{
+  MediaIndexEntry *entry;
+  const gchar *interned_key;
+
+  g_return_if_fail (index != NULL);
+  g_return_if_fail (object_id != NULL);
+  g_return_if_fail (key != NULL);
+
+  entry = media_index_get (index, object_id);
+  if (!entry || entry->error)
+    {
+      return;
+    }
+
+  interned_key = g_intern_string (key);
+  g_hash_table_remove (entry->known_keys, interned_key);
+  if (!entry->guessed_keys)
+    {
+      entry->guessed_keys = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+  g_hash_table_insert (entry->guessed_keys, (gpointer) interned_key,
+                       (gpointer) interned_key);
+}
+
+void
+mafw_grilo_media_index_add_error (MafwGriloMediaIndex *index,
+                                  const gchar *object_id,
+                                  const GError *error)
+{
+  MediaIndexEntry *entry;
+
+  g_return_if_fail (index != NULL);
+  g_return_if_fail (object_id != NULL);
+  g_return_if_fail (error != NULL);
+
+  if (!index->max_entries)
+    {
+      return;
+    }
+
+  entry = media_index_ensure (index, object_id);
+
+  g_hash_table_unref (entry->metadata);
+  entry->metadata = NULL;
+  g_hash_table_destroy (entry->known_keys);
+  entry->known_keys = NULL;
+  entry->complete = FALSE;
+  entry->error = g_error_copy (error);
+  entry->created = get_current_seconds ();
+}
+
+gboolean
+mafw_grilo_media_index_lookup (MafwGriloMediaIndex *index,
+                               const gchar *object_id,
+                               const gchar *const *metadata_keys,
+                               GHashTable **metadata,
+                               gchar ***missing_keys,
+                               GError **error)
+{
+  MediaIndexEntry *entry;
+  GPtrArray *missing;
+  gint i;
+
+  g_return_val_if_fail (index != NULL, FALSE);
+  g_return_val_if_fail (object_id != NULL, FALSE);
+  g_return_val_if_fail (metadata != NULL, FALSE);
+  g_return_val_if_fail (missing_keys != NULL, FALSE);
+
+  *metadata = NULL;
+  *missing_keys = NULL;
+
+  entry = media_index_get (index, object_id);
+
+  if (!entry)
+    {
+      return FALSE;
+    }
+
+  if (entry->error)
+    {
+      g_propagate_error (error, g_error_copy (entry->error));
+      return TRUE;
+    }
+
+  *metadata = mafw_metadata_new ();
+  missing = g_ptr_array_new ();
+
+  for (i = 0; metadata_keys && metadata_keys[i]; i++)
+    {
+      gpointer value;
+
+      if (strcmp (metadata_keys[i], MAFW_SOURCE_KEY_WILDCARD) == 0)
+        {
+          GHashTableIter iter;
+          gpointer key;
+
+          g_hash_table_iter_init (&iter, entry->metadata);
+          while (g_hash_table_iter_next (&iter, &key, &value))
+            {
+              g_hash_table_remove (*metadata, key);
+              mafw_grilo_metadata_add_value (*metadata, key, value);
+            }
+
+          if (!entry->complete)
+            {
+              g_ptr_array_add (missing, g_strdup (metadata_keys[i]));
+            }
+          else if (entry->guessed_keys)
+            {
+              g_hash_table_iter_init (&iter, entry->guessed_keys);
+              while (g_hash_table_iter_next (&iter, &key, NULL))
+                {
+                  g_ptr_array_add (missing, g_strdup (key));
+                }
+            }
+        }
+      else if (g_hash_table_lookup (entry->known_keys,
+                                    g_intern_string (metadata_keys[i])))
+        {
+          value = g_hash_table_lookup (entry->metadata, metadata_keys[i]);
+          if (value && !g_hash_table_lookup (*metadata, metadata_keys[i]))
+            {
+              mafw_grilo_metadata_add_value (*metadata, metadata_keys[i],
+                                             value);
+            }
+        }
+      else if (!entry->complete ||
+               (entry->guessed_keys &&
+                g_hash_table_lookup (entry->guessed_keys,
+                                     g_intern_string (metadata_keys[i]))))
+        {
+          g_ptr_array_add (missing, g_strdup (metadata_keys[i]));
+        }
+    }
+
+  if (missing->len)
+    {
+      g_ptr_array_add (missing, NULL);
+      *missing_keys = (gchar **) g_ptr_array_free (missing, FALSE);
+    }
+  else
+    {
+      g_ptr_array_free (missing, TRUE);
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#ifndef MAFW_GRILO_MEDIA_INDEX_H
+#define MAFW_GRILO_MEDIA_INDEX_H
+
+G_BEGIN_DECLS
+
+/* The media index keeps the metadata we already know for each object
+   id, coming either from browse or metadata results, together with
+   the keys we know about, even if the object does not have them.
+   Values we made up ourselves are kept apart, clients get them but
+   they are asked for again. */
+
+typedef struct _MafwGriloMediaIndex MafwGriloMediaIndex;
+
+MafwGriloMediaIndex *mafw_grilo_media_index_new (guint max_entries);
+void mafw_grilo_media_index_free (MafwGriloMediaIndex *index);
+void mafw_grilo_media_index_clear (MafwGriloMediaIndex *index);
+
+void mafw_grilo_media_index_set_max_entries (MafwGriloMediaIndex *index,
+                                             guint max_entries);
+guint mafw_grilo_media_index_get_max_entries (MafwGriloMediaIndex *index);
+
+void mafw_grilo_media_index_add (MafwGriloMediaIndex *index,
+                                 const gchar *object_id,
+                                 GHashTable *metadata,
+                                 const gchar *const *known_keys);
+void mafw_grilo_media_index_set_guessed (MafwGriloMediaIndex *index,
+                                         const gchar *object_id,
+                                         const gchar *key);
+void mafw_grilo_media_index_add_error (MafwGriloMediaIndex *index,
+                                       const gchar *object_id,
+                                       const GError *error);
+gboolean mafw_grilo_media_index_lookup (MafwGriloMediaIndex *index,
+                                        const gchar *object_id,
+                                        const gchar *const *metadata_keys,
+                                        GHashTable **metadata,
+                                        gchar ***missing_keys,
+                                        GError **error);
+
+void mafw_grilo_metadata_add_value (GHashTable *metadata, const gchar *key,
+                                    gpointer value);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_MEDIA_INDEX_H */
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include "mafw-grilo-object-id.h"
+
+/* Largest number of digits of a guint */
+#define MAX_SKIP_DIGITS 10
+
+typedef struct
+{
+  const gchar *name;
+  gsize length;
+  GType type;
+} MediaType;
+
+/* The types grilo plugins give us. Anything else goes through the
+   GType registry. */
+static MediaType media_types[] = {
+  { "GrlMediaBox", sizeof ("GrlMediaBox") - 1, 0 },
+  { "GrlMediaAudio", sizeof ("GrlMediaAudio") - 1, 0 },
+  { "GrlMediaVideo", sizeof ("GrlMediaVideo") - 1, 0 },
+  { "GrlMediaImage", sizeof ("GrlMediaImage") - 1, 0 },
+  { "GrlMedia", sizeof ("GrlMedia") - 1, 0 },
+};
+
+static void
+init_media_types (void)
+{
+  static gboolean initialized = FALSE;
+
+  if (G_UNLIKELY (!initialized))
+    {
+      media_types[0].type = GRL_TYPE_MEDIA_BOX;
+      media_types[1].type = GRL_TYPE_MEDIA_AUDIO;
+      media_types[2].type = GRL_TYPE_MEDIA_VIDEO;
+      media_types[3].type = GRL_TYPE_MEDIA_IMAGE;
+      media_types[4].type = GRL_TYPE_MEDIA;
+      initialized = TRUE;
+    }
+}
+
+static GType
+get_media_type (const gchar *name, gsize length)
+{
+  GType type;
+  gchar *type_name;
+  guint i;
+
+  init_media_types ();
+
+  for (i = 0; i < G_N_ELEMENTS (media_types); i++)
+    {
+      if (media_types[i].length == length &&
+          memcmp (media_types[i].name, name, length) == 0)
+        {
+          return media_types[i].type;
+        }
+    }
+
+  type_name = g_strndup (name, length);
+  type = g_type_from_name (type_name);
+  g_free (type_name);
+
+  /* We are not going to instantiate whatever the id says */
+  if (type == 0 || !g_type_is_a (type, GRL_TYPE_MEDIA) ||
+      G_TYPE_IS_ABSTRACT (type))
+    {
+      return 0;
+    }
+
+  return type;
+}
+
+static guint
+count_digits (guint value)
+{
+  guint digits = 1;
+
+  while (value >= 10)
+    {
+      value /= 10;
+      digits++;
+    }
+
+  return digits;
+}
+
+gchar *
+mafw_grilo_object_id_new_prefix (const gchar *uuid, gsize *length)
+{
+  gchar *prefix;
+
+  prefix = g_strconcat (uuid, "::", NULL);
+
+  if (length)
+    {
+      *length = strlen (prefix);
+    }
+
+  return prefix;
+}
+
+gchar *
+mafw_grilo_object_id_encode (const gchar *prefix,
+                             gsize prefix_length,
+                             GrlMedia *grl_media,
+                             guint pagination_skip)
+{
+  const gchar *type = NULL, *media_id = NULL;
+  gsize type_length = 0, media_id_length = 0;
+  guint digits;
+  gsize length;
+  gchar *object_id, *ptr;
+
+  digits = count_digits (pagination_skip);
+  length = prefix_length + digits + 1;
+
+  if (grl_media)
+    {
+      type = G_OBJECT_TYPE_NAME (grl_media);
+      type_length = strlen (type);
+      media_id = grl_media_get_id (grl_media);
+      media_id_length = media_id ? strlen (media_id) : 0;
+      length += type_length + 1 + media_id_length;
+    }
+
+  object_id = g_malloc (length + 1);
+
+  memcpy (object_id, prefix, prefix_length);
+  ptr = object_id + prefix_length + digits;
+  do
+    {
+      *--ptr = '0' + pagination_skip % 10;
+      pagination_skip /= 10;
+    }
+  while (pagination_skip);
+  ptr = object_id + prefix_length + digits;
+  *ptr++ = ':';
+
+  if (grl_media)
+    {
+      memcpy (ptr, type, type_length);
+      ptr += type_length;
+      *ptr++ = ':';
+      memcpy (ptr, media_id, media_id_length);
+      ptr += media_id_length;
+    }
+
+  *ptr = '\0';
+
+  return object_id;
+}
+
+gboolean
+mafw_grilo_object_id_decode (const gchar *object_id,
+                             GrlMedia **grl_media,
+                             guint *pagination_skip)
+{
+  const gchar *ptr, *type_name;
+  guint64 skip = 0;
+  GType type;
+
+  if (grl_media)
+    {
+      *grl_media = NULL;
+    }
+
+  if (!object_id)
+    {
+      return FALSE;
+    }
+
+  ptr = strstr (object_id, "::");
+  if (!ptr || ptr == object_id)
+    {
+      return FALSE;
+    }
+  ptr += 2;
+
+  /* "<uuid>::" is the root too, as MAFW builds it */
+  if (*ptr == '\0')
+    {
+      if (pagination_skip)
+        {
+          *pagination_skip = 0;
+        }
+      return TRUE;
+    }
+
+  /* Otherwise the skip, nothing but digits */
+  if (!g_ascii_isdigit (*ptr))
+    {
+      return FALSE;
+    }
+  for (; g_ascii_isdigit (*ptr); ptr++)
+    {
+      skip = skip * 10 + (*ptr - '0');
+      if (skip > G_MAXUINT)
+        {
+          return FALSE;
+        }
+    }
+
+  if (*ptr++ != ':')
+    {
+      return FALSE;
+    }
+
+  if (pagination_skip)
+    {
+      *pagination_skip = skip;
+    }
+
+  /* The root */
+  if (*ptr == '\0')
+    {
+      return TRUE;
+    }
+
+  type_name = ptr;
+  ptr = strchr (type_name, ':');
+  if (!ptr || ptr == type_name)
+    {
+      return FALSE;
+    }
+
+  type = get_media_type (type_name, ptr - type_name);
+  if (!type)
+    {
+      return FALSE;
+    }
+
+  if (grl_media)
+    {
+      /* The media id is the rest and it can have ':' of its own */
+      ptr++;
+      *grl_media = g_object_new (type, NULL);
+      grl_media_set_id (*grl_media, *ptr != '\0' ? ptr : NULL);
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include <grilo.h>
+
+#ifndef MAFW_GRILO_OBJECT_ID_H
+#define MAFW_GRILO_OBJECT_ID_H
+
+G_BEGIN_DECLS
+
+/* Object ids of the source look like "<uuid>::<skip>:<type>:<media id>",
+   or "<uuid>::<skip>:" for the root, which can also come as "<uuid>::".
+   The skip is the pagination of the
+   "More results..." rows and the type is the name of the GrlMedia
+   subclass. The prefix is "<uuid>::" and it is the same for every id
+   of a source, so callers build it once and keep it. */
+
+gchar *mafw_grilo_object_id_new_prefix (const gchar *uuid, gsize *length);
+
+gchar *mafw_grilo_object_id_encode (const gchar *prefix,
+                                    gsize prefix_length,
+                                    GrlMedia *grl_media,
+                                    guint pagination_skip);
+gboolean mafw_grilo_object_id_decode (const gchar *object_id,
+                                      GrlMedia **grl_media,
+                                      guint *pagination_skip);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_OBJECT_ID_H */
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "mafw-grilo-page-sizer.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+/* We want a page to take about this long to come, in seconds, so that
+   slow sources give something to show soon and fast ones are not
+   asked too often */
+#define TARGET_PAGE_TIME 1.0
+
+/* Weight of a new sample in the averages */
+#define SAMPLE_WEIGHT 0.25
+
+struct _MafwGriloPageSizer
+{
+  guint min_page_size;
+  guint max_page_size;
+  guint page_size;
+  gboolean measured;
+  /* Averages, in seconds */
+  gdouble item_latency;
+  gdouble first_item_latency;
+};
+
+MafwGriloPageSizer *
+mafw_grilo_page_sizer_new (guint min_page_size, guint max_page_size)
+{
+  MafwGriloPageSizer *sizer;
+
+  g_return_val_if_fail (min_page_size > 0, NULL);
+  g_return_val_if_fail (min_page_size <= max_page_size, NULL);
+
+  sizer = g_new0 (MafwGriloPageSizer, 1);
+  sizer->min_page_size = min_page_size;
+  sizer->max_page_size = max_page_size;
+  /* Until we know better, we assume the source is fast */
+  sizer->page_size = max_page_size;
+
+  return sizer;
+}
+
+void
+mafw_grilo_page_sizer_free (MafwGriloPageSizer *sizer)
+{
+  g_return_if_fail (sizer != NULL);
+
+  g_free (sizer);
+}
+
+guint
+mafw_grilo_page_sizer_get_first_page_size (MafwGriloPageSizer *sizer)
+{
+  g_return_val_if_fail (sizer != NULL, 0);
+
+  /* The first page of a browse is what fills the first screen, so it
+     is kept small */
+  return sizer->min_page_size;
+}
+
+guint
+mafw_grilo_page_sizer_get_page_size (MafwGriloPageSizer *sizer)
+{
+  g_return_val_if_fail (sizer != NULL, 0);
+
+  return sizer->page_size;
+}
+
+void
+mafw_grilo_page_sizer_add_sample (MafwGriloPageSizer *sizer,
+                                  guint items,
+                                  gdouble first_item_time,
+                                  gdouble page_time)
+{
+  gdouble item_latency;
+  guint page_size;
+
+  g_return_if_fail (sizer != NULL);
+
+  if (!items)
+    {
+      return;
+    }
+
+  /* The first item also pays for the request itself, so it is
+     measured on its own */
+  item_latency = items > 1 ?
+    MAX (page_time - first_item_time, 0) / (items - 1) :
+    page_time;
+
+  if (sizer->measured)
+    {
+      sizer->item_latency += (item_latency - sizer->item_latency) *
+        SAMPLE_WEIGHT;
+      sizer->first_item_latency +=
+        (first_item_time - sizer->first_item_latency) * SAMPLE_WEIGHT;
+    }
+  else
+    {
+      sizer->item_latency = item_latency;
+      sizer->first_item_latency = first_item_time;
+      sizer->measured = TRUE;
+    }
+
+  if (sizer->item_latency > 0)
+    {
+      gdouble items_in_time = (TARGET_PAGE_TIME - sizer->first_item_latency) /
+        sizer->item_latency;
+
+      page_size = items_in_time < sizer->min_page_size ?
+        sizer->min_page_size :
+        items_in_time > sizer->max_page_size ?
+        sizer->max_page_size : (guint) items_in_time;
+    }
+  else
+    {
+      page_size = sizer->max_page_size;
+    }
+
+  /* We do not move too fast in either direction, and we keep pages
+     aligned to the smallest one so that they match the listing
+     cache */
+  page_size = CLAMP (page_size, sizer->page_size / 2, sizer->page_size * 2);
+  page_size = page_size / sizer->min_page_size * sizer->min_page_size;
+  page_size = CLAMP (page_size, sizer->min_page_size, sizer->max_page_size);
+
+  if (page_size != sizer->page_size)
+    {
+      g_debug ("Page size changed from %u to %u", sizer->page_size,
+               page_size);
+      sizer->page_size = page_size;
+    }
+}
+
+guint
+mafw_grilo_page_sizer_get_item_latency (MafwGriloPageSizer *sizer)
+{
+  g_return_val_if_fail (sizer != NULL, 0);
+
+  /* In microseconds */
+  return (guint) (sizer->item_latency * G_USEC_PER_SEC);
+}
+
+guint
+mafw_grilo_page_sizer_get_first_item_latency (MafwGriloPageSizer *sizer)
+{
+  g_return_val_if_fail (sizer != NULL, 0);
+
+  /* In milliseconds */
+  return (guint) (sizer->first_item_latency * 1000);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#ifndef MAFW_GRILO_PAGE_SIZER_H
+#define MAFW_GRILO_PAGE_SIZER_H
+
+G_BEGIN_DECLS
+
+/* The page sizer chooses how many items we ask grilo for at once,
+   from how long the source took to give us the previous pages. */
+
+typedef struct _MafwGriloPageSizer MafwGriloPageSizer;
+
+MafwGriloPageSizer *mafw_grilo_page_sizer_new (guint min_page_size,
+                                               guint max_page_size);
+void mafw_grilo_page_sizer_free (MafwGriloPageSizer *sizer);
+
+guint mafw_grilo_page_sizer_get_first_page_size (MafwGriloPageSizer *sizer);
+guint mafw_grilo_page_sizer_get_page_size (MafwGriloPageSizer *sizer);
+
+void mafw_grilo_page_sizer_add_sample (MafwGriloPageSizer *sizer,
+                                       guint items,
+                                       gdouble first_item_time,
+                                       gdouble page_time);
+
+guint mafw_grilo_page_sizer_get_item_latency (MafwGriloPageSizer *sizer);
+guint mafw_grilo_page_sizer_get_first_item_latency (MafwGriloPageSizer *sizer);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_PAGE_SIZER_H */
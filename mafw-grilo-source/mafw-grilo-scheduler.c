@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "mafw-grilo-scheduler.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+typedef struct
+{
+  gconstpointer client;
+  gconstpointer client_data;
+  MafwGriloSchedulerPriority priority;
+  GQueue jobs;
+} SchedulerClient;
+
+typedef struct
+{
+  guint id;
+  SchedulerClient *client;
+  MafwGriloSchedulerFunc func;
+  gpointer user_data;
+} SchedulerJob;
+
+struct _MafwGriloScheduler
+{
+  guint max_running;
+  guint running;
+  guint next_job_id;
+  GHashTable *jobs;
+  /* For each priority, the clients with waiting jobs, in turn order,
+     and the same clients by what tells them apart */
+  GQueue turns[MAFW_GRILO_SCHEDULER_N_PRIORITIES];
+  GHashTable *clients[MAFW_GRILO_SCHEDULER_N_PRIORITIES];
+  guint dispatch_source;
+};
+
+static guint
+scheduler_client_hash (gconstpointer key)
+{
+  const SchedulerClient *client = key;
+
+  return g_direct_hash (client->client) * 31 +
+    g_direct_hash (client->client_data);
+}
+
+static gboolean
+scheduler_client_equal (gconstpointer a, gconstpointer b)
+{
+  const SchedulerClient *client_a = a;
+  const SchedulerClient *client_b = b;
+
+  return client_a->client == client_b->client &&
+    client_a->client_data == client_b->client_data;
+}
+
+MafwGriloScheduler *
+mafw_grilo_scheduler_new (guint max_running)
+{
+  MafwGriloScheduler *scheduler;
+  gint i;
+
+  scheduler = g_new0 (MafwGriloScheduler, 1);
+  scheduler->max_running = max_running;
+  scheduler->next_job_id = 1;
+  scheduler->jobs = g_hash_table_new_full (g_int_hash, g_int_equal, NULL,
+                                           g_free);
+
+  for (i = 0; i < MAFW_GRILO_SCHEDULER_N_PRIORITIES; i++)
+    {
+      g_queue_init (&scheduler->turns[i]);
+      scheduler->clients[i] =
+        g_hash_table_new_full (scheduler_client_hash, scheduler_client_equal,
+                               NULL, g_free);
+    }
+
+  return scheduler;
+}
+
+void
+mafw_grilo_scheduler_free (MafwGriloScheduler *scheduler)
+{
+  gint i;
+
+  g_return_if_fail (scheduler != NULL);
+
+  /* Jobs still waiting are just forgotten, their owners are going
+     away too */
+  if (scheduler->dispatch_source)
+    {
+      g_source_remove (scheduler->dispatch_source);
+    }
+  for (i = 0; i < MAFW_GRILO_SCHEDULER_N_PRIORITIES; i++)
+    {
+      GList *link;
+
+      for (link = scheduler->turns[i].head; link; link = g_list_next (link))
+        {
+          SchedulerClient *client = link->data;
+
+          g_queue_clear (&client->jobs);
+        }
+      g_queue_clear (&scheduler->turns[i]);
+      g_hash_table_destroy (scheduler->clients[i]);
+    }
+  g_hash_table_destroy (scheduler->jobs);
+  g_free (scheduler);
+}
+
+static gboolean
+dispatch_jobs (gpointer user_data)
+{
+  MafwGriloScheduler *scheduler = user_data;
+  gint i;
+
+  scheduler->dispatch_source = 0;
+
+  for (i = 0; i < MAFW_GRILO_SCHEDULER_N_PRIORITIES; i++)
+    {
+      while ((!scheduler->max_running ||
+              scheduler->running < scheduler->max_running) &&
+             !g_queue_is_empty (&scheduler->turns[i]))
+        {
+          SchedulerClient *client;
+          SchedulerJob *job;
+          MafwGriloSchedulerFunc func;
+          gpointer job_data;
+
+          /* The client goes to the end of the line if it still has
+             jobs waiting */
+          client = g_queue_pop_head (&scheduler->turns[i]);
+          job = g_queue_pop_head (&client->jobs);
+          if (g_queue_is_empty (&client->jobs))
+            {
+              g_hash_table_remove (scheduler->clients[i], client);
+            }
+          else
+            {
+              g_queue_push_tail (&scheduler->turns[i], client);
+            }
+
+          func = job->func;
+          job_data = job->user_data;
+          g_hash_table_remove (scheduler->jobs, &job->id);
+
+          scheduler->running++;
+          func (job_data);
+        }
+    }
+
+  return FALSE;
+}
+
+static void
+schedule_dispatch (MafwGriloScheduler *scheduler)
+{
+  /* Jobs are always started from an idle, so that they never run
+     inside the callbacks of other operations */
+  if (!scheduler->dispatch_source)
+    {
+      scheduler->dispatch_source = g_idle_add (dispatch_jobs, scheduler);
+    }
+}
+
+void
+mafw_grilo_scheduler_set_max_running (MafwGriloScheduler *scheduler,
+                                      guint max_running)
+{
+  g_return_if_fail (scheduler != NULL);
+
+  scheduler->max_running = max_running;
+  schedule_dispatch (scheduler);
+}
+
+guint
+mafw_grilo_scheduler_get_max_running (MafwGriloScheduler *scheduler)
+{
+  g_return_val_if_fail (scheduler != NULL, 0);
+
+  return scheduler->max_running;
+}
+
+guint
+mafw_grilo_scheduler_get_running (MafwGriloScheduler *scheduler)
+{
+  g_return_val_if_fail (scheduler != NULL, 0);
+
+  return scheduler->running;
+}
+
+guint
+mafw_grilo_scheduler_get_waiting (MafwGriloScheduler *scheduler)
+{
+  g_return_val_if_fail (scheduler != NULL, 0);
+
+  return g_hash_table_size (scheduler->jobs);
+}
+
+guint
+mafw_grilo_scheduler_push (MafwGriloScheduler *scheduler,
+                           MafwGriloSchedulerPriority priority,
+                           gconstpointer client,
+                           gconstpointer client_data,
+                           MafwGriloSchedulerFunc func,
+                           gpointer user_data)
+{
+  SchedulerClient key, *scheduler_client;
+  SchedulerJob *job;
+
+  g_return_val_if_fail (scheduler != NULL, 0);
+  g_return_val_if_fail (priority < MAFW_GRILO_SCHEDULER_N_PRIORITIES, 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  key.client = client;
+  key.client_data = client_data;
+  scheduler_client = g_hash_table_lookup (scheduler->clients[priority], &key);
+  if (!scheduler_client)
+    {
+      scheduler_client = g_new0 (SchedulerClient, 1);
+      scheduler_client->client = client;
+      scheduler_client->client_data = client_data;
+      scheduler_client->priority = priority;
+      g_queue_init (&scheduler_client->jobs);
+      g_hash_table_insert (scheduler->clients[priority], scheduler_client,
+                           scheduler_client);
+      g_queue_push_tail (&scheduler->turns[priority], scheduler_client);
+    }
+
+  job = g_new0 (SchedulerJob, 1);
+  job->id = scheduler->next_job_id++;
+  job->client = scheduler_client;
+  job->func = func;
+  job->user_data = user_data;
+  g_hash_table_insert (scheduler->jobs, &job->id, job);
+  g_queue_push_tail (&scheduler_client->jobs, job);
+
+  /* Skip 0, it means no job */
+  if (!scheduler->next_job_id)
+    {
+      scheduler->next_job_id = 1;
+    }
+
+  schedule_dispatch (scheduler);
+
+  return job->id;
+}
+
+gboolean
+mafw_grilo_scheduler_remove (MafwGriloScheduler *scheduler, guint job_id)
+{
+  SchedulerJob *job;
+  SchedulerClient *client;
+
+  g_return_val_if_fail (scheduler != NULL, FALSE);
+
+  job = g_hash_table_lookup (scheduler->jobs, &job_id);
+  if (!job)
+    {
+      return FALSE;
+    }
+
+  client = job->client;
+  g_queue_remove (&client->jobs, job);
+  if (g_queue_is_empty (&client->jobs))
+    {
+      g_queue_remove (&scheduler->turns[client->priority], client);
+      g_hash_table_remove (scheduler->clients[client->priority], client);
+    }
+  g_hash_table_remove (scheduler->jobs, &job_id);
+
+  return TRUE;
+}
+
+void
+mafw_grilo_scheduler_done (MafwGriloScheduler *scheduler)
+{
+  g_return_if_fail (scheduler != NULL);
+  g_return_if_fail (scheduler->running > 0);
+
+  scheduler->running--;
+  schedule_dispatch (scheduler);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#ifndef MAFW_GRILO_SCHEDULER_H
+#define MAFW_GRILO_SCHEDULER_H
+
+G_BEGIN_DECLS
+
+/* The scheduler decides when the grilo operations of a source are
+   started. Only a few of them run at the same time; the rest wait in
+   a queue per priority, where clients take turns. A client is told
+   apart by its callback together with the user data it came with. */
+
+typedef enum
+  {
+    MAFW_GRILO_SCHEDULER_PRIORITY_BROWSE,
+    MAFW_GRILO_SCHEDULER_PRIORITY_METADATA,
+    MAFW_GRILO_SCHEDULER_PRIORITY_PREFETCH,
+    MAFW_GRILO_SCHEDULER_N_PRIORITIES
+  } MafwGriloSchedulerPriority;
+
+typedef struct _MafwGriloScheduler MafwGriloScheduler;
+
+typedef void (*MafwGriloSchedulerFunc) (gpointer user_data);
+
+MafwGriloScheduler *mafw_grilo_scheduler_new (guint max_running);
+void mafw_grilo_scheduler_free (MafwGriloScheduler *scheduler);
+
+void mafw_grilo_scheduler_set_max_running (MafwGriloScheduler *scheduler,
+                                           guint max_running);
+guint mafw_grilo_scheduler_get_max_running (MafwGriloScheduler *scheduler);
+guint mafw_grilo_scheduler_get_running (MafwGriloScheduler *scheduler);
+guint mafw_grilo_scheduler_get_waiting (MafwGriloScheduler *scheduler);
+
+guint mafw_grilo_scheduler_push (MafwGriloScheduler *scheduler,
+                                 MafwGriloSchedulerPriority priority,
+                                 gconstpointer client,
+                                 gconstpointer client_data,
+                                 MafwGriloSchedulerFunc func,
+                                 gpointer user_data);
+gboolean mafw_grilo_scheduler_remove (MafwGriloScheduler *scheduler,
+                                      guint job_id);
+void mafw_grilo_scheduler_done (MafwGriloScheduler *scheduler);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_SCHEDULER_H */
@@ -0,0 +1,794 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <libmafw/mafw.h>
+
+#include "mafw-grilo-snapshot.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+#define SNAPSHOT_MAGIC "MGSN"
+#define SNAPSHOT_VERSION 1
+
+/* Past this size we start over, it is only a cache */
+#define MAX_SNAPSHOT_SIZE (8 * 1024 * 1024)
+
+/* Seconds we gather records before writing them */
+#define FLUSH_DELAY 5
+
+/* Every record starts with its size and its type */
+#define RECORD_HEADER_SIZE 5
+
+typedef enum
+  {
+    RECORD_ROW = 1,
+    RECORD_END,
+    RECORD_OBJECT
+  } RecordType;
+
+typedef enum
+  {
+    VALUE_INT = 1,
+    VALUE_UINT,
+    VALUE_LONG,
+    VALUE_INT64,
+    VALUE_FLOAT,
+    VALUE_DOUBLE,
+    VALUE_BOOLEAN,
+    VALUE_STRING
+  } ValueType;
+
+struct _MafwGriloSnapshot
+{
+  gchar *path;
+  gchar *source_id;
+  gboolean loaded;
+  /* Bytes of the file holding good records, 0 when it has to be
+     written from scratch */
+  gsize length;
+  GString *pending;
+  guint flush_source;
+};
+
+typedef struct
+{
+  const gchar *data;
+  gsize length;
+  gsize offset;
+  gboolean failed;
+} Reader;
+
+/*----------------------------------------------------------------------------
+  Writing
+  ----------------------------------------------------------------------------*/
+
+static void
+write_uint8 (GString *buffer, guint8 value)
+{
+  g_string_append_c (buffer, value);
+}
+
+static void
+write_uint32 (GString *buffer, guint32 value)
+{
+  value = GUINT32_TO_LE (value);
+  g_string_append_len (buffer, (const gchar *) &value, sizeof (value));
+}
+
+static void
+write_uint64 (GString *buffer, guint64 value)
+{
+  value = GUINT64_TO_LE (value);
+  g_string_append_len (buffer, (const gchar *) &value, sizeof (value));
+}
+
+static void
+write_double (GString *buffer, gdouble value)
+{
+  guint64 bits;
+
+  memcpy (&bits, &value, sizeof (bits));
+  write_uint64 (buffer, bits);
+}
+
+static void
+write_string (GString *buffer, const gchar *string)
+{
+  gsize length = strlen (string);
+
+  /* The terminator is kept so that strings can be used right from the
+     map */
+  write_uint32 (buffer, length);
+  g_string_append_len (buffer, string, length + 1);
+}
+
+static void
+patch_uint32 (GString *buffer, gsize offset, guint32 value)
+{
+  value = GUINT32_TO_LE (value);
+  memcpy (buffer->str + offset, &value, sizeof (value));
+}
+
+static gboolean
+write_value (GString *buffer, const gchar *key, const GValue *value)
+{
+  switch (G_TYPE_FUNDAMENTAL (G_VALUE_TYPE (value)))
+    {
+    case G_TYPE_INT:
+      write_string (buffer, key);
+      write_uint8 (buffer, VALUE_INT);
+      write_uint32 (buffer, g_value_get_int (value));
+      break;
+    case G_TYPE_UINT:
+      write_string (buffer, key);
+      write_uint8 (buffer, VALUE_UINT);
+      write_uint32 (buffer, g_value_get_uint (value));
+      break;
+    case G_TYPE_LONG:
+      write_string (buffer, key);
+      write_uint8 (buffer, VALUE_LONG);
+      write_uint64 (buffer, g_value_get_long (value));
+      break;
+    case G_TYPE_INT64:
+      write_string (buffer, key);
+      write_uint8 (buffer, VALUE_INT64);
+      write_uint64 (buffer, g_value_get_int64 (value));
+      break;
+    case G_TYPE_FLOAT:
+      write_string (buffer, key);
+      write_uint8 (buffer, VALUE_FLOAT);
+      write_double (buffer, g_value_get_float (value));
+      break;
+    case G_TYPE_DOUBLE:
+      write_string (buffer, key);
+      write_uint8 (buffer, VALUE_DOUBLE);
+      write_double (buffer, g_value_get_double (value));
+      break;
+    case G_TYPE_BOOLEAN:
+      write_string (buffer, key);
+      write_uint8 (buffer, VALUE_BOOLEAN);
+      write_uint8 (buffer, g_value_get_boolean (value) ? 1 : 0);
+      break;
+    case G_TYPE_STRING:
+      if (!g_value_get_string (value))
+        {
+          return FALSE;
+        }
+      write_string (buffer, key);
+      write_uint8 (buffer, VALUE_STRING);
+      write_string (buffer, g_value_get_string (value));
+      break;
+    default:
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+write_metadata (GString *buffer, GHashTable *metadata)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  gsize count_offset;
+  guint32 count = 0;
+
+  count_offset = buffer->len;
+  write_uint32 (buffer, 0);
+
+  if (metadata)
+    {
+      g_hash_table_iter_init (&iter, metadata);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          if (mafw_metadata_nvalues (value) == 1)
+            {
+              count += write_value (buffer, key, value) ? 1 : 0;
+            }
+          else
+            {
+              GValueArray *array = value;
+              guint i;
+
+              for (i = 0; i < array->n_values; i++)
+                {
+                  count += write_value (buffer, key, &array->values[i]) ?
+                    1 : 0;
+                }
+            }
+        }
+    }
+
+  patch_uint32 (buffer, count_offset, count);
+}
+
+static gsize
+begin_record (MafwGriloSnapshot *snapshot, RecordType type)
+{
+  gsize offset = snapshot->pending->len;
+
+  write_uint32 (snapshot->pending, 0);
+  write_uint8 (snapshot->pending, type);
+
+  return offset;
+}
+
+static gboolean
+flush_timeout (gpointer user_data)
+{
+  MafwGriloSnapshot *snapshot = user_data;
+
+  snapshot->flush_source = 0;
+  mafw_grilo_snapshot_flush (snapshot);
+
+  return FALSE;
+}
+
+static void
+end_record (MafwGriloSnapshot *snapshot, gsize offset)
+{
+  patch_uint32 (snapshot->pending, offset, snapshot->pending->len - offset);
+
+  if (!snapshot->flush_source)
+    {
+      snapshot->flush_source =
+        g_timeout_add_seconds (FLUSH_DELAY, flush_timeout, snapshot);
+    }
+}
+
+/*----------------------------------------------------------------------------
+  Reading
+  ----------------------------------------------------------------------------*/
+
+static gboolean
+reader_check (Reader *reader, gsize size)
+{
+  if (reader->failed || reader->length - reader->offset < size)
+    {
+      reader->failed = TRUE;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static guint8
+read_uint8 (Reader *reader)
+{
+  if (!reader_check (reader, 1))
+    {
+      return 0;
+    }
+
+  return reader->data[reader->offset++];
+}
+
+static guint32
+read_uint32 (Reader *reader)
+{
+  guint32 value;
+
+  if (!reader_check (reader, sizeof (value)))
+    {
+      return 0;
+    }
+
+  memcpy (&value, reader->data + reader->offset, sizeof (value));
+  reader->offset += sizeof (value);
+
+  return GUINT32_FROM_LE (value);
+}
+
+static guint64
+read_uint64 (Reader *reader)
+{
+  guint64 value;
+
+  if (!reader_check (reader, sizeof (value)))
+    {
+      return 0;
+    }
+
+  memcpy (&value, reader->data + reader->offset, sizeof (value));
+  reader->offset += sizeof (value);
+
+  return GUINT64_FROM_LE (value);
+}
+
+static gdouble
+read_double (Reader *reader)
+{
+  guint64 bits;
+  gdouble value;
+
+  bits = read_uint64 (reader);
+  memcpy (&value, &bits, sizeof (value));
+
+  return value;
+}
+
+static const gchar *
+read_string (Reader *reader)
+{
+  const gchar *string;
+  guint32 length;
+
+  length = read_uint32 (reader);
+  if (length == G_MAXUINT32 || !reader_check (reader, length + 1) ||
+      reader->data[reader->offset + length] != '\0')
+    {
+      reader->failed = TRUE;
+      return NULL;
+    }
+
+  string = reader->data + reader->offset;
+  reader->offset += length + 1;
+
+  return string;
+}
+
+static GHashTable *
+read_metadata (Reader *reader)
+{
+  GHashTable *metadata;
+  guint32 count, i;
+
+  metadata = mafw_metadata_new ();
+  count = read_uint32 (reader);
+
+  for (i = 0; i < count && !reader->failed; i++)
+    {
+      const gchar *key;
+      GValue value = { 0, };
+
+      key = read_string (reader);
+
+      switch (read_uint8 (reader))
+        {
+        case VALUE_INT:
+          g_value_init (&value, G_TYPE_INT);
+          g_value_set_int (&value, (gint32) read_uint32 (reader));
+          break;
+        case VALUE_UINT:
+          g_value_init (&value, G_TYPE_UINT);
+          g_value_set_uint (&value, read_uint32 (reader));
+          break;
+        case VALUE_LONG:
+          g_value_init (&value, G_TYPE_LONG);
+          g_value_set_long (&value, (gint64) read_uint64 (reader));
+          break;
+        case VALUE_INT64:
+          g_value_init (&value, G_TYPE_INT64);
+          g_value_set_int64 (&value, (gint64) read_uint64 (reader));
+          break;
+        case VALUE_FLOAT:
+          g_value_init (&value, G_TYPE_FLOAT);
+          g_value_set_float (&value, read_double (reader));
+          break;
+        case VALUE_DOUBLE:
+          g_value_init (&value, G_TYPE_DOUBLE);
+          g_value_set_double (&value, read_double (reader));
+          break;
+        case VALUE_BOOLEAN:
+          g_value_init (&value, G_TYPE_BOOLEAN);
+          g_value_set_boolean (&value, read_uint8 (reader) != 0);
+          break;
+        case VALUE_STRING:
+          g_value_init (&value, G_TYPE_STRING);
+          g_value_set_static_string (&value, read_string (reader));
+          break;
+        default:
+          reader->failed = TRUE;
+          continue;
+        }
+
+      if (!reader->failed)
+        {
+          mafw_metadata_add_val (metadata, (gchar *) key, &value);
+        }
+      g_value_unset (&value);
+    }
+
+  if (reader->failed)
+    {
+      g_hash_table_unref (metadata);
+      return NULL;
+    }
+
+  return metadata;
+}
+
+static gboolean
+read_record (Reader *record,
+             MafwGriloSnapshotRowFunc row_func,
+             MafwGriloSnapshotEndFunc end_func,
+             MafwGriloSnapshotObjectFunc object_func,
+             gpointer user_data)
+{
+  const gchar *listing_key, *object_id;
+  GHashTable *metadata;
+  guint position;
+
+  switch (read_uint8 (record))
+    {
+    case RECORD_ROW:
+      listing_key = read_string (record);
+      position = read_uint32 (record);
+      object_id = read_string (record);
+      metadata = read_metadata (record);
+      if (record->failed)
+        {
+          return FALSE;
+        }
+      if (row_func)
+        {
+          row_func (listing_key, position, object_id, metadata, user_data);
+        }
+      g_hash_table_unref (metadata);
+      break;
+    case RECORD_END:
+      listing_key = read_string (record);
+      position = read_uint32 (record);
+      if (record->failed)
+        {
+          return FALSE;
+        }
+      if (end_func)
+        {
+          end_func (listing_key, position, user_data);
+        }
+      break;
+    case RECORD_OBJECT:
+      {
+        GPtrArray *known_keys = NULL;
+        guint32 n_keys, i;
+
+        object_id = read_string (record);
+        if (read_uint8 (record))
+          {
+            n_keys = read_uint32 (record);
+            known_keys = g_ptr_array_new ();
+            for (i = 0; i < n_keys && !record->failed; i++)
+              {
+                g_ptr_array_add (known_keys, (gpointer) read_string (record));
+              }
+            g_ptr_array_add (known_keys, NULL);
+          }
+        metadata = read_metadata (record);
+        if (!record->failed && object_func)
+          {
+            object_func (object_id, metadata,
+                         known_keys ?
+                         (const gchar *const *) known_keys->pdata : NULL,
+                         user_data);
+          }
+        if (known_keys)
+          {
+            g_ptr_array_free (known_keys, TRUE);
+          }
+        if (metadata)
+          {
+            g_hash_table_unref (metadata);
+          }
+        if (record->failed)
+          {
+            return FALSE;
+          }
+      }
+      break;
+    default:
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+  API
+  ----------------------------------------------------------------------------*/
+
+MafwGriloSnapshot *
+mafw_grilo_snapshot_new (const gchar *path, const gchar *source_id)
+{
+  MafwGriloSnapshot *snapshot;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (source_id != NULL, NULL);
+
+  snapshot = g_new0 (MafwGriloSnapshot, 1);
+  snapshot->path = g_strdup (path);
+  snapshot->source_id = g_strdup (source_id);
+  snapshot->pending = g_string_new (NULL);
+
+  return snapshot;
+}
+
+void
+mafw_grilo_snapshot_free (MafwGriloSnapshot *snapshot)
+{
+  g_return_if_fail (snapshot != NULL);
+
+  mafw_grilo_snapshot_flush (snapshot);
+
+  if (snapshot->flush_source)
+    {
+      g_source_remove (snapshot->flush_source);
+    }
+  g_string_free (snapshot->pending, TRUE);
+  g_free (snapshot->source_id);
+  g_free (snapshot->path);
+  g_free (snapshot);
+}
+
+void
+mafw_grilo_snapshot_load (MafwGriloSnapshot *snapshot,
+                          MafwGriloSnapshotRowFunc row_func,
+                          MafwGriloSnapshotEndFunc end_func,
+                          MafwGriloSnapshotObjectFunc object_func,
+                          gpointer user_data)
+{
+  GMappedFile *mapped_file;
+  GError *error = NULL;
+  Reader reader = { 0, };
+  const gchar *source_id;
+  guint records = 0;
+
+  g_return_if_fail (snapshot != NULL);
+
+  if (snapshot->loaded)
+    {
+      return;
+    }
+
+  snapshot->loaded = TRUE;
+  snapshot->length = 0;
+
+  mapped_file = g_mapped_file_new (snapshot->path, FALSE, &error);
+  if (!mapped_file)
+    {
+      g_debug ("No snapshot at %s: %s", snapshot->path, error->message);
+      g_error_free (error);
+      return;
+    }
+
+  reader.data = g_mapped_file_get_contents (mapped_file);
+  reader.length = g_mapped_file_get_length (mapped_file);
+
+  /* A snapshot of another version, or of another source, is as good
+     as none */
+  if (!reader_check (&reader, strlen (SNAPSHOT_MAGIC)) ||
+      memcmp (reader.data, SNAPSHOT_MAGIC, strlen (SNAPSHOT_MAGIC)) != 0)
+    {
+      g_debug ("%s is not a snapshot", snapshot->path);
+      g_mapped_file_free (mapped_file);
+      return;
+    }
+  reader.offset += strlen (SNAPSHOT_MAGIC);
+
+  if (read_uint32 (&reader) != SNAPSHOT_VERSION ||
+      !(source_id = read_string (&reader)) ||
+      strcmp (source_id, snapshot->source_id) != 0)
+    {
+      g_debug ("Snapshot %s is outdated", snapshot->path);
+      g_mapped_file_free (mapped_file);
+      return;
+    }
+
+  /* The records after the last good one are dropped, they can only
+     come from a write that did not finish */
+  snapshot->length = reader.offset;
+  while (reader.offset < reader.length)
+    {
+      Reader record;
+      guint32 size;
+
+      size = read_uint32 (&reader);
+      if (reader.failed || size < RECORD_HEADER_SIZE ||
+          !reader_check (&reader, size - sizeof (guint32)))
+        {
+          break;
+        }
+
+      record.data = reader.data + reader.offset;
+      record.length = size - sizeof (guint32);
+      record.offset = 0;
+      record.failed = FALSE;
+
+      if (!read_record (&record, row_func, end_func, object_func, user_data))
+        {
+          break;
+        }
+
+      reader.offset += record.length;
+      snapshot->length = reader.offset;
+      records++;
+    }
+
+  g_debug ("Loaded %u records from snapshot %s", records, snapshot->path);
+
+  g_mapped_file_free (mapped_file);
+
+  if (snapshot->length > MAX_SNAPSHOT_SIZE)
+    {
+      g_debug ("Snapshot %s is too big, starting over", snapshot->path);
+      snapshot->length = 0;
+    }
+}
+
+void
+mafw_grilo_snapshot_add_row (MafwGriloSnapshot *snapshot,
+                             const gchar *listing_key,
+                             guint position,
+                             const gchar *object_id,
+                             GHashTable *metadata)
+{
+  gsize offset;
+
+  g_return_if_fail (snapshot != NULL);
+
+  offset = begin_record (snapshot, RECORD_ROW);
+  write_string (snapshot->pending, listing_key);
+  write_uint32 (snapshot->pending, position);
+  write_string (snapshot->pending, object_id);
+  write_metadata (snapshot->pending, metadata);
+  end_record (snapshot, offset);
+}
+
+void
+mafw_grilo_snapshot_add_end (MafwGriloSnapshot *snapshot,
+                             const gchar *listing_key,
+                             guint position)
+{
+  gsize offset;
+
+  g_return_if_fail (snapshot != NULL);
+
+  offset = begin_record (snapshot, RECORD_END);
+  write_string (snapshot->pending, listing_key);
+  write_uint32 (snapshot->pending, position);
+  end_record (snapshot, offset);
+}
+
+void
+mafw_grilo_snapshot_add_object (MafwGriloSnapshot *snapshot,
+                                const gchar *object_id,
+                                GHashTable *metadata,
+                                const gchar *const *known_keys)
+{
+  gsize offset;
+  gint i;
+
+  g_return_if_fail (snapshot != NULL);
+
+  offset = begin_record (snapshot, RECORD_OBJECT);
+  write_string (snapshot->pending, object_id);
+  write_uint8 (snapshot->pending, known_keys != NULL);
+  if (known_keys)
+    {
+      write_uint32 (snapshot->pending,
+                    g_strv_length ((gchar **) known_keys));
+      for (i = 0; known_keys[i]; i++)
+        {
+          write_string (snapshot->pending, known_keys[i]);
+        }
+    }
+  write_metadata (snapshot->pending, metadata);
+  end_record (snapshot, offset);
+}
+
+void
+mafw_grilo_snapshot_flush (MafwGriloSnapshot *snapshot)
+{
+  GString *header = NULL;
+  gchar *dirname;
+  FILE *file;
+  gboolean written;
+
+  g_return_if_fail (snapshot != NULL);
+
+  if (!snapshot->pending->len)
+    {
+      return;
+    }
+
+  /* We never write over records we did not check */
+  mafw_grilo_snapshot_load (snapshot, NULL, NULL, NULL, NULL);
+
+  dirname = g_path_get_dirname (snapshot->path);
+  g_mkdir_with_parents (dirname, 0755);
+  g_free (dirname);
+
+  /* A source that runs for long keeps appending, so it has to stay
+     under the limit here too, not only when we load */
+  if (snapshot->length &&
+      snapshot->length + snapshot->pending->len > MAX_SNAPSHOT_SIZE)
+    {
+      g_debug ("Snapshot %s would grow too big, starting over",
+               snapshot->path);
+      snapshot->length = 0;
+    }
+
+  if (!snapshot->length)
+    {
+      header = g_string_new (SNAPSHOT_MAGIC);
+      write_uint32 (header, SNAPSHOT_VERSION);
+      write_string (header, snapshot->source_id);
+      file = g_fopen (snapshot->path, "wb");
+    }
+  else
+    {
+      file = g_fopen (snapshot->path, "r+b");
+    }
+
+  if (!file)
+    {
+      g_debug ("Cannot write snapshot %s", snapshot->path);
+      g_string_truncate (snapshot->pending, 0);
+      if (header)
+        {
+          g_string_free (header, TRUE);
+        }
+      return;
+    }
+
+  if (header)
+    {
+      written = fwrite (header->str, header->len, 1, file) == 1;
+      snapshot->length = header->len;
+      g_string_free (header, TRUE);
+    }
+  else
+    {
+      /* Whatever follows the good records goes away */
+      written = ftruncate (fileno (file), snapshot->length) == 0 &&
+        fseek (file, snapshot->length, SEEK_SET) == 0;
+    }
+
+  written = written &&
+    fwrite (snapshot->pending->str, snapshot->pending->len, 1, file) == 1;
+  written = fclose (file) == 0 && written;
+
+  if (written)
+    {
+      snapshot->length += snapshot->pending->len;
+    }
+  else
+    {
+      /* We do not know what made it to the disk, so next time we
+         start over */
+      g_debug ("Failed writing snapshot %s", snapshot->path);
+      snapshot->length = 0;
+    }
+
+  g_string_truncate (snapshot->pending, 0);
+}
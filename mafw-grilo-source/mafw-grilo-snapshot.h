@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include <glib.h>
+
+#ifndef MAFW_GRILO_SNAPSHOT_H
+#define MAFW_GRILO_SNAPSHOT_H
+
+G_BEGIN_DECLS
+
+/* The snapshot keeps on disk the listings and metadata of a source,
+   so that they survive restarts. It is a log of records, read through
+   a memory map and only ever appended to; when it grows too big it
+   starts over. */
+
+typedef struct _MafwGriloSnapshot MafwGriloSnapshot;
+
+typedef void (*MafwGriloSnapshotRowFunc) (const gchar *listing_key,
+                                          guint position,
+                                          const gchar *object_id,
+                                          GHashTable *metadata,
+                                          gpointer user_data);
+typedef void (*MafwGriloSnapshotEndFunc) (const gchar *listing_key,
+                                          guint position,
+                                          gpointer user_data);
+typedef void (*MafwGriloSnapshotObjectFunc) (const gchar *object_id,
+                                             GHashTable *metadata,
+                                             const gchar *const *known_keys,
+                                             gpointer user_data);
+
+MafwGriloSnapshot *mafw_grilo_snapshot_new (const gchar *path,
+                                            const gchar *source_id);
+void mafw_grilo_snapshot_free (MafwGriloSnapshot *snapshot);
+
+void mafw_grilo_snapshot_load (MafwGriloSnapshot *snapshot,
+                               MafwGriloSnapshotRowFunc row_func,
+                               MafwGriloSnapshotEndFunc end_func,
+                               MafwGriloSnapshotObjectFunc object_func,
+                               gpointer user_data);
+
+void mafw_grilo_snapshot_add_row (MafwGriloSnapshot *snapshot,
+                                  const gchar *listing_key,
+                                  guint position,
+                                  const gchar *object_id,
+                                  GHashTable *metadata);
+void mafw_grilo_snapshot_add_end (MafwGriloSnapshot *snapshot,
+                                  const gchar *listing_key,
+                                  guint position);
+void mafw_grilo_snapshot_add_object (MafwGriloSnapshot *snapshot,
+                                     const gchar *object_id,
+                                     GHashTable *metadata,
+                                     const gchar *const *known_keys);
+void mafw_grilo_snapshot_flush (MafwGriloSnapshot *snapshot);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_SNAPSHOT_H */
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+
+#include <libmafw/mafw.h>
+
+#include "mafw-grilo-sorter.h"
+#include "mafw-grilo-filter.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+typedef struct
+{
+  gboolean present;
+  gboolean numeric;
+  gdouble number;
+  gchar *collate_key;
+} SortValue;
+
+typedef struct
+{
+  gchar *object_id;
+  GHashTable *metadata;
+  guint sequence;
+  SortValue values[1];
+} SortRow;
+
+struct _MafwGriloSorter
+{
+  gchar **keys;
+  gboolean *descending;
+  guint n_keys;
+  guint max_rows;
+  guint seen;
+  /* Until sorted, a heap with the row that would go last on top */
+  GPtrArray *rows;
+  gboolean sorted;
+};
+
+MafwGriloSorter *
+mafw_grilo_sorter_new (const gchar *sort_criteria, guint max_rows)
+{
+  MafwGriloSorter *sorter;
+  gchar **criteria;
+  gint i;
+
+  if (!sort_criteria || sort_criteria[0] == '\0' || !max_rows)
+    {
+      return NULL;
+    }
+
+  criteria = g_strsplit (sort_criteria, ",", -1);
+
+  sorter = g_new0 (MafwGriloSorter, 1);
+  sorter->keys = g_new0 (gchar *, g_strv_length (criteria) + 1);
+  sorter->descending = g_new0 (gboolean, g_strv_length (criteria));
+  sorter->max_rows = max_rows;
+  sorter->rows = g_ptr_array_new ();
+
+  /* Every key comes with its direction, ascending if none */
+  for (i = 0; criteria[i]; i++)
+    {
+      const gchar *key = g_strstrip (criteria[i]);
+      gboolean descending = FALSE;
+
+      if (key[0] == '+' || key[0] == '-')
+        {
+          descending = key[0] == '-';
+          key++;
+        }
+
+      if (key[0] != '\0')
+        {
+          sorter->descending[sorter->n_keys] = descending;
+          sorter->keys[sorter->n_keys++] = g_strdup (key);
+        }
+    }
+
+  g_strfreev (criteria);
+
+  if (!sorter->n_keys)
+    {
+      mafw_grilo_sorter_free (sorter);
+      return NULL;
+    }
+
+  return sorter;
+}
+
+static void
+free_sort_row (MafwGriloSorter *sorter, SortRow *row)
+{
+  guint i;
+
+  for (i = 0; i < sorter->n_keys; i++)
+    {
+      g_free (row->values[i].collate_key);
+    }
+  g_free (row->object_id);
+  if (row->metadata)
+    {
+      g_hash_table_unref (row->metadata);
+    }
+  g_free (row);
+}
+
+void
+mafw_grilo_sorter_free (MafwGriloSorter *sorter)
+{
+  guint i;
+
+  g_return_if_fail (sorter != NULL);
+
+  for (i = 0; i < sorter->rows->len; i++)
+    {
+      free_sort_row (sorter, g_ptr_array_index (sorter->rows, i));
+    }
+  g_ptr_array_free (sorter->rows, TRUE);
+  g_strfreev (sorter->keys);
+  g_free (sorter->descending);
+  g_free (sorter);
+}
+
+const gchar *const *
+mafw_grilo_sorter_get_keys (MafwGriloSorter *sorter)
+{
+  g_return_val_if_fail (sorter != NULL, NULL);
+
+  return (const gchar *const *) sorter->keys;
+}
+
+static gint
+compare_sort_values (MafwGriloSorter *sorter, const SortRow *a,
+                     const SortRow *b)
+{
+  guint i;
+
+  for (i = 0; i < sorter->n_keys; i++)
+    {
+      const SortValue *value_a = &a->values[i];
+      const SortValue *value_b = &b->values[i];
+      gint result;
+
+      /* Rows without the key go last in any direction */
+      if (!value_a->present || !value_b->present)
+        {
+          if (value_a->present != value_b->present)
+            {
+              return value_a->present ? -1 : 1;
+            }
+          continue;
+        }
+
+      if (value_a->numeric && value_b->numeric)
+        {
+          result = value_a->number < value_b->number ? -1 :
+            value_a->number > value_b->number ? 1 : 0;
+        }
+      else
+        {
+          result = strcmp (value_a->collate_key ? value_a->collate_key : "",
+                           value_b->collate_key ? value_b->collate_key : "");
+        }
+
+      if (result)
+        {
+          return sorter->descending[i] ? -result : result;
+        }
+    }
+
+  return 0;
+}
+
+static gint
+compare_sort_rows (MafwGriloSorter *sorter, const SortRow *a,
+                   const SortRow *b)
+{
+  gint result;
+
+  result = compare_sort_values (sorter, a, b);
+  if (result)
+    {
+      return result;
+    }
+
+  /* Keep the order of the container for equal rows */
+  return a->sequence < b->sequence ? -1 : 1;
+}
+
+static void
+swap_rows (GPtrArray *rows, guint a, guint b)
+{
+  gpointer row = rows->pdata[a];
+
+  rows->pdata[a] = rows->pdata[b];
+  rows->pdata[b] = row;
+}
+
+static void
+sift_up (MafwGriloSorter *sorter, guint position)
+{
+  while (position > 0)
+    {
+      guint parent = (position - 1) / 2;
+
+      if (compare_sort_rows (sorter, sorter->rows->pdata[parent],
+                             sorter->rows->pdata[position]) >= 0)
+        {
+          break;
+        }
+
+      swap_rows (sorter->rows, parent, position);
+      position = parent;
+    }
+}
+
+static void
+sift_down (MafwGriloSorter *sorter, guint position, guint len)
+{
+  for (;;)
+    {
+      guint child = position * 2 + 1;
+      guint largest = position;
+
+      if (child < len &&
+          compare_sort_rows (sorter, sorter->rows->pdata[child],
+                             sorter->rows->pdata[largest]) > 0)
+        {
+          largest = child;
+        }
+      child++;
+      if (child < len &&
+          compare_sort_rows (sorter, sorter->rows->pdata[child],
+                             sorter->rows->pdata[largest]) > 0)
+        {
+          largest = child;
+        }
+
+      if (largest == position)
+        {
+          break;
+        }
+
+      swap_rows (sorter->rows, largest, position);
+      position = largest;
+    }
+}
+
+static SortRow *
+new_sort_row (MafwGriloSorter *sorter, gchar *object_id,
+              GHashTable *metadata)
+{
+  SortRow *row;
+  guint i;
+
+  row = g_malloc0 (sizeof (SortRow) +
+                   sizeof (SortValue) * (sorter->n_keys - 1));
+  row->object_id = object_id;
+  row->metadata = metadata;
+
+  /* Values are prepared once, as rows are compared many times */
+  for (i = 0; i < sorter->n_keys; i++)
+    {
+      GValue *value;
+      gchar *string;
+
+      value = metadata ? mafw_metadata_first (metadata, sorter->keys[i]) :
+        NULL;
+      if (!value)
+        {
+          continue;
+        }
+
+      row->values[i].present = TRUE;
+      row->values[i].numeric =
+        mafw_grilo_value_get_number (value, &row->values[i].number);
+      if (!row->values[i].numeric)
+        {
+          string = mafw_grilo_value_dup_string (value);
+          if (string)
+            {
+              row->values[i].collate_key = g_utf8_collate_key (string, -1);
+              g_free (string);
+            }
+        }
+    }
+
+  return row;
+}
+
+void
+mafw_grilo_sorter_add (MafwGriloSorter *sorter, gchar *object_id,
+                       GHashTable *metadata)
+{
+  SortRow *row;
+
+  g_return_if_fail (sorter != NULL);
+  g_return_if_fail (!sorter->sorted);
+
+  row = new_sort_row (sorter, object_id, metadata);
+  row->sequence = sorter->seen++;
+
+  if (sorter->rows->len < sorter->max_rows)
+    {
+      g_ptr_array_add (sorter->rows, row);
+      sift_up (sorter, sorter->rows->len - 1);
+    }
+  else if (compare_sort_rows (sorter, row, sorter->rows->pdata[0]) < 0)
+    {
+      /* It goes before the last row we keep, which is not needed
+         anymore */
+      free_sort_row (sorter, sorter->rows->pdata[0]);
+      sorter->rows->pdata[0] = row;
+      sift_down (sorter, 0, sorter->rows->len);
+    }
+  else
+    {
+      free_sort_row (sorter, row);
+    }
+}
+
+guint
+mafw_grilo_sorter_get_seen (MafwGriloSorter *sorter)
+{
+  g_return_val_if_fail (sorter != NULL, 0);
+
+  return sorter->seen;
+}
+
+guint
+mafw_grilo_sorter_sort (MafwGriloSorter *sorter)
+{
+  guint n;
+
+  g_return_val_if_fail (sorter != NULL, 0);
+
+  /* Taking the top of the heap out, from the end of the array to the
+     beginning, leaves the rows in order */
+  if (!sorter->sorted)
+    {
+      for (n = sorter->rows->len; n > 1; n--)
+        {
+          swap_rows (sorter->rows, 0, n - 1);
+          sift_down (sorter, 0, n - 1);
+        }
+      sorter->sorted = TRUE;
+    }
+
+  return sorter->rows->len;
+}
+
+const gchar *
+mafw_grilo_sorter_get_row (MafwGriloSorter *sorter, guint position,
+                           GHashTable **metadata)
+{
+  SortRow *row;
+
+  g_return_val_if_fail (sorter != NULL, NULL);
+  g_return_val_if_fail (sorter->sorted, NULL);
+  g_return_val_if_fail (position < sorter->rows->len, NULL);
+
+  row = g_ptr_array_index (sorter->rows, position);
+
+  if (metadata)
+    {
+      *metadata = row->metadata ? g_hash_table_ref (row->metadata) : NULL;
+    }
+
+  return row->object_id;
+}
+
+/* Compares two rows on their own, as when merging streams that are
+   already sorted with the same criteria. Equal rows give 0. */
+gint
+mafw_grilo_sorter_compare (MafwGriloSorter *sorter, GHashTable *metadata_a,
+                           GHashTable *metadata_b)
+{
+  SortRow *a, *b;
+  gint result;
+
+  g_return_val_if_fail (sorter != NULL, 0);
+
+  a = new_sort_row (sorter, NULL, metadata_a);
+  b = new_sort_row (sorter, NULL, metadata_b);
+
+  result = compare_sort_values (sorter, a, b);
+
+  /* The rows do not own the tables */
+  a->metadata = NULL;
+  b->metadata = NULL;
+  free_sort_row (sorter, a);
+  free_sort_row (sorter, b);
+
+  return result;
+}
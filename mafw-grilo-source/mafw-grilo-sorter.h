@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#ifndef MAFW_GRILO_SORTER_H
+#define MAFW_GRILO_SORTER_H
+
+G_BEGIN_DECLS
+
+/* The sorter keeps the first rows of a stream in the order given by a
+   MAFW sort criteria ("+key1,-key2,..."). Only max_rows rows are kept
+   at any time, so memory depends on the window and not on the size of
+   the container. */
+
+typedef struct _MafwGriloSorter MafwGriloSorter;
+
+MafwGriloSorter *mafw_grilo_sorter_new (const gchar *sort_criteria,
+                                        guint max_rows);
+void mafw_grilo_sorter_free (MafwGriloSorter *sorter);
+
+const gchar *const *mafw_grilo_sorter_get_keys (MafwGriloSorter *sorter);
+
+void mafw_grilo_sorter_add (MafwGriloSorter *sorter, gchar *object_id,
+                            GHashTable *metadata);
+guint mafw_grilo_sorter_get_seen (MafwGriloSorter *sorter);
+
+guint mafw_grilo_sorter_sort (MafwGriloSorter *sorter);
+const gchar *mafw_grilo_sorter_get_row (MafwGriloSorter *sorter,
+                                        guint position,
+                                        GHashTable **metadata);
+
+gint mafw_grilo_sorter_compare (MafwGriloSorter *sorter,
+                                GHashTable *metadata_a,
+                                GHashTable *metadata_b);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_SORTER_H */
@@ -31,6 +31,17 @@
 #include <grilo.h>
 
 #include "mafw-grilo-source.h"
+#include "mafw-grilo-listing-cache.h"
+#include "mafw-grilo-media-index.h"
+#include "mafw-grilo-scheduler.h"
+#include "mafw-grilo-filter.h"
+#include "mafw-grilo-sorter.h"
+#include "mafw-grilo-page-sizer.h"
+#include "mafw-grilo-object-id.h"
+#include "mafw-grilo-snapshot.h"
+#include "mafw-grilo-stats.h"
+#include "mafw-grilo-thumbnailer.h"
+#include "mafw-grilo-aggregate-source.h"
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "mafw-grilo-source"
@@ -39,6 +50,74 @@
 
 #define MAX_COUNT 1024
 
+/* Grilo requests are aligned to pages of this size, so that
+   neighbouring windows requested by clients reuse the same fetch */
+#define BROWSE_PAGE_SIZE 64
+
+#define DEFAULT_BROWSE_BATCH_SIZE 32
+#define DEFAULT_BROWSE_BATCH_TIME 4
+
+/* Delivered rows a browse keeps to use again */
+#define MAX_SPARE_BROWSE_ROWS 64
+
+#define DEFAULT_LISTING_CACHE_TTL 60
+#define DEFAULT_LISTING_CACHE_SIZE 16
+
+#define DEFAULT_MEDIA_INDEX_SIZE 512
+
+/* Key sets whose grilo translation we remember */
+#define GRL_KEYS_CACHE_SIZE 32
+
+#define DEFAULT_METADATA_CONCURRENCY 8
+
+#define DEFAULT_MAX_OPERATIONS 4
+
+#define DEFAULT_RECURSIVE_BREADTH 4
+#define DEFAULT_RECURSIVE_DEPTH 8
+
+/* Rows fetched ahead behind a "More results..." row, how many of
+   those fetches can be going on, and how long they can wait for the
+   client to come for them */
+#define DEFAULT_PREFETCH_SIZE MAX_COUNT
+#define MAX_PREFETCHES 4
+#define PREFETCH_TIMEOUT 30
+#define DEFAULT_SLOW_KEYS_RATE 10
+
+/* Seconds we give a browse and a metadata request before answering
+   with what we have, 0 meaning as long as they take. Clients ask for
+   them, as sorted and recursive browses fail when time runs out. */
+#define DEFAULT_BROWSE_DEADLINE 0
+#define DEFAULT_METADATA_DEADLINE 0
+
+/* Side of the thumbnails we keep, in pixels, size of their cache, in
+   kilobytes, and how many are fetched at once */
+#define DEFAULT_THUMBNAIL_SIZE 128
+#define DEFAULT_THUMBNAIL_CACHE_SIZE (10 * 1024)
+#define MAX_THUMBNAIL_FETCHES 2
+/* Objects told about a thumbnail they share once we have it, the rest
+   get it the next time they are asked for */
+#define MAX_THUMBNAIL_WAITERS 64
+
+/* Milliseconds a search replacing another one of the same client
+   waits for the next keystroke, and how many clients we remember */
+#define DEFAULT_SEARCH_DELAY 200
+#define MAX_SEARCH_CLIENTS 8
+
+/* Looked for in the user and then the system config dirs, as in
+
+   [plugins]
+   allow=libgrlfilesystem.so;libgrljamendo.so
+   deny=libgrlyoutube.so
+   aggregate=true
+   snapshot=true
+
+   Plugins go by the name of their file: we filter them before loading
+   them, and their ids are only known once loaded ("grl-metadata-store"
+   lives in libgrlmetadatastore.so). */
+#define MAFW_GRILO_SOURCE_CONFIG_FILE "mafw-grilo-source.conf"
+#define MAFW_GRILO_SOURCE_CONFIG_PLUGINS "plugins"
+#define GRL_PLUGIN_MODULE_PREFIX "libgrl"
+
 
 G_DEFINE_TYPE (MafwGriloSource, mafw_grilo_source, MAFW_TYPE_SOURCE);
 
@@ -47,9 +126,38 @@ G_DEFINE_TYPE (MafwGriloSource, mafw_grilo_source, MAFW_TYPE_SOURCE);
                                 MafwGriloSourcePrivate))
 
 #define MAFW_GRILO_SOURCE_ERROR (mafw_grilo_source_error_quark ())
+/* Our own codes in that domain, after the MafwExtensionError ones we
+   also report in it */
+#define MAFW_GRILO_SOURCE_ERROR_TIMED_OUT 100
+#define MAFW_GRILO_SOURCE_ERROR_CANCELLED 101
 #define MAFW_PROPERTY_GRILO_SOURCE_BROWSE_METADATA_MODE "browse-metadata-mode"
+#define MAFW_PROPERTY_GRILO_SOURCE_BROWSE_BATCH_SIZE "browse-batch-size"
+#define MAFW_PROPERTY_GRILO_SOURCE_BROWSE_BATCH_TIME "browse-batch-time"
 #define MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE "resolve-metadata-mode"
 #define MAFW_PROPERTY_GRILO_SOURCE_DEFAULT_MIME "default-mime"
+#define MAFW_PROPERTY_GRILO_SOURCE_LISTING_CACHE_TTL "listing-cache-ttl"
+#define MAFW_PROPERTY_GRILO_SOURCE_LISTING_CACHE_SIZE "listing-cache-size"
+#define MAFW_PROPERTY_GRILO_SOURCE_MEDIA_INDEX_SIZE "media-index-size"
+#define MAFW_PROPERTY_GRILO_SOURCE_METADATA_CONCURRENCY "metadata-concurrency"
+#define MAFW_PROPERTY_GRILO_SOURCE_MAX_OPERATIONS "max-operations"
+#define MAFW_PROPERTY_GRILO_SOURCE_RECURSIVE_BREADTH "recursive-breadth"
+#define MAFW_PROPERTY_GRILO_SOURCE_RECURSIVE_DEPTH "recursive-depth"
+#define MAFW_PROPERTY_GRILO_SOURCE_PREFETCH_SIZE "prefetch-size"
+#define MAFW_PROPERTY_GRILO_SOURCE_BROWSE_PAGE_SIZE "browse-page-size"
+#define MAFW_PROPERTY_GRILO_SOURCE_BROWSE_ITEM_LATENCY "browse-item-latency"
+#define MAFW_PROPERTY_GRILO_SOURCE_BROWSE_FIRST_ITEM_LATENCY "browse-first-item-latency"
+#define MAFW_PROPERTY_GRILO_SOURCE_BROWSE_SLOW_KEYS "browse-slow-keys"
+#define MAFW_PROPERTY_GRILO_SOURCE_SLOW_KEYS_RATE "slow-keys-rate"
+#define MAFW_PROPERTY_GRILO_SOURCE_SNAPSHOT "snapshot"
+#define MAFW_PROPERTY_GRILO_SOURCE_STATS "stats"
+#define MAFW_PROPERTY_GRILO_SOURCE_RESET_STATS "reset-stats"
+#define MAFW_PROPERTY_GRILO_SOURCE_BROWSE_DEADLINE "browse-deadline"
+#define MAFW_PROPERTY_GRILO_SOURCE_METADATA_DEADLINE "metadata-deadline"
+#define MAFW_PROPERTY_GRILO_SOURCE_THUMBNAILS "thumbnails"
+#define MAFW_PROPERTY_GRILO_SOURCE_THUMBNAIL_SIZE "thumbnail-size"
+#define MAFW_PROPERTY_GRILO_SOURCE_THUMBNAIL_CACHE_SIZE "thumbnail-cache-size"
+#define MAFW_PROPERTY_GRILO_SOURCE_SEARCH_DELAY "search-delay"
+#define MAFW_PROPERTY_GRILO_SOURCE_SUPERSEDE_SEARCHES "supersede-searches"
 
 typedef enum
   {
@@ -61,19 +169,114 @@ typedef enum
 struct _MafwGriloSourcePrivate
 {
   GrlMediaPlugin *grl_source;
+  /* What the grilo source can do, asked once when it is added. The
+     profile tells if each supported key is fast or slow. */
+  GrlSupportedOps supported_ops;
+  GList *supported_keys;
+  GHashTable *keys_profile;
   guint next_browse_id;
   GrlMetadataResolutionFlags browse_metadata_mode;
   GrlMetadataResolutionFlags resolve_metadata_mode;
+  guint browse_batch_size;
+  guint browse_batch_time;
+  GTimer *batch_timer;
   GHashTable *browse_requests;
+  GHashTable *metadata_requests;
+  GHashTable *grl_keys_cache;
+  GQueue grl_keys_lru;
   gchar *default_mime;
+  MafwGriloListingCache *listing_cache;
+  MafwGriloMediaIndex *media_index;
+  guint metadata_concurrency;
+  MafwGriloScheduler *scheduler;
+  guint recursive_breadth;
+  guint recursive_depth;
+  guint prefetch_size;
+  GHashTable *prefetches;
+  MafwGriloPageSizer *page_sizer;
+  gchar *object_id_prefix;
+  gsize object_id_prefix_length;
+  gboolean browse_slow_keys;
+  guint slow_keys_rate;
+  GList *slow_keys_resolvers;
+  guint slow_keys_running;
+  guint slow_keys_source;
+  gboolean snapshot_enabled;
+  MafwGriloSnapshot *snapshot;
+  guint snapshot_source;
+  MafwGriloStats *stats;
+  guint browse_deadline;
+  guint metadata_deadline;
+  guint thumbnail_size;
+  guint thumbnail_cache_size;
+  MafwGriloThumbnailer *thumbnailer;
+  /* For each thumbnail being fetched, the ids of the objects having
+     it */
+  GHashTable *thumbnail_waiters;
+  guint search_delay;
+  gboolean supersede_searches;
+  GQueue search_clients;
 };
 
 typedef struct
 {
   GSList *grl_sources;
+  gchar *snapshot_dir;
+  /* Grilo plugins we load, or do not load, by id */
+  gchar **allowed_plugins;
+  gchar **denied_plugins;
+  /* Paths of the plugins still to load */
+  GQueue pending_plugins;
+  guint load_source;
+  /* The source browsing all the others at once, if wanted */
+  gboolean aggregate_enabled;
+  /* If the sources keep their listings between runs */
+  gboolean snapshot_enabled;
+  MafwGriloAggregateSource *aggregate;
 } MafwGriloSourcePlugin;
 
-static MafwGriloSourcePlugin plugin = { NULL };
+/* MAFW keys and the grilo keys they are translated to. The last field
+   tells if the grilo key is translated back to MAFW, as the mime is
+   handled on its own. */
+#define METADATA_KEY_MAPPINGS(MAPPING)                                  \
+  MAPPING (MAFW_METADATA_KEY_URI, GRL_METADATA_KEY_URL, TRUE)           \
+  MAPPING (MAFW_METADATA_KEY_TITLE, GRL_METADATA_KEY_TITLE, TRUE)       \
+  MAPPING (MAFW_METADATA_KEY_ARTIST, GRL_METADATA_KEY_ARTIST, TRUE)     \
+  MAPPING (MAFW_METADATA_KEY_ALBUM, GRL_METADATA_KEY_ALBUM, TRUE)       \
+  MAPPING (MAFW_METADATA_KEY_GENRE, GRL_METADATA_KEY_GENRE, TRUE)       \
+  MAPPING (MAFW_METADATA_KEY_THUMBNAIL, GRL_METADATA_KEY_THUMBNAIL, TRUE) \
+  MAPPING (MAFW_METADATA_KEY_COMPOSER, GRL_METADATA_KEY_AUTHOR, TRUE)   \
+  MAPPING (MAFW_METADATA_KEY_DESCRIPTION, GRL_METADATA_KEY_DESCRIPTION, TRUE) \
+  MAPPING (MAFW_METADATA_KEY_LYRICS, GRL_METADATA_KEY_LYRICS, TRUE)     \
+  MAPPING (MAFW_METADATA_KEY_DURATION, GRL_METADATA_KEY_DURATION, TRUE) \
+  MAPPING (MAFW_METADATA_KEY_CHILDCOUNT_1, GRL_METADATA_KEY_CHILDCOUNT, TRUE) \
+  MAPPING (MAFW_METADATA_KEY_MIME, GRL_METADATA_KEY_MIME, FALSE)        \
+  MAPPING (MAFW_METADATA_KEY_RES_X, GRL_METADATA_KEY_WIDTH, TRUE)       \
+  MAPPING (MAFW_METADATA_KEY_RES_Y, GRL_METADATA_KEY_HEIGHT, TRUE)      \
+  MAPPING (MAFW_METADATA_KEY_VIDEO_FRAMERATE, GRL_METADATA_KEY_FRAMERATE, TRUE) \
+  MAPPING (MAFW_METADATA_KEY_RATING, GRL_METADATA_KEY_RATING, TRUE)     \
+  MAPPING (MAFW_METADATA_KEY_BITRATE, GRL_METADATA_KEY_BITRATE, TRUE)   \
+  MAPPING (MAFW_METADATA_KEY_PLAY_COUNT, GRL_METADATA_KEY_PLAY_COUNT, TRUE) \
+  MAPPING (MAFW_METADATA_KEY_LAST_PLAYED, GRL_METADATA_KEY_LAST_PLAYED, TRUE) \
+  MAPPING (MAFW_METADATA_KEY_PAUSED_POSITION, GRL_METADATA_KEY_LAST_POSITION, TRUE)
+
+/* A key set translated to grilo, in the order it was last used */
+typedef struct
+{
+  gchar *signature;
+  GList *grl_keys;
+} GrlKeysEntry;
+
+/* How a grilo key is given by a source, in its keys profile */
+#define KEY_FAST GINT_TO_POINTER (1)
+#define KEY_SLOW GINT_TO_POINTER (2)
+
+static GHashTable *mafw_to_grl_keys = NULL;
+static GHashTable *grl_to_mafw_keys = NULL;
+static GHashTable *next_row_metadata_keys = NULL;
+
+static MafwGriloSourcePlugin plugin = { NULL, NULL, NULL, NULL,
+                                         G_QUEUE_INIT, 0 };
 
 enum
   {
@@ -87,24 +290,234 @@ typedef struct
   gpointer mafw_user_data;
   guint mafw_browse_id;
   guint grl_browse_id;
+  guint skip_count;
   guint item_count;
   gint total_items;
-  gboolean more_pages;
   GrlMedia *grl_media;
-  guint pagination_skip;
+  gchar **metadata_keys;
+  /* Keys we fetch only to filter or sort the rows, that the client
+     did not ask for */
+  gchar **extra_keys;
+  GList *grl_keys;
+  GrlMetadataResolutionFlags grl_flags;
+  gchar *listing_key;
+  /* With a filter, or when browsing recursively, the window is
+     counted in matching rows, and the rows can come from a grilo
+     search */
+  gboolean match_window;
+  MafwFilter *filter;
+  gchar *search_text;
+  guint matched;
+  guint filter_skip;
+  guint filter_end;
+  /* With a sort criteria, the window is counted in sorted rows */
+  MafwGriloSorter *sorter;
+  guint sort_skip;
+  guint sort_end;
+  /* The boxes to look into when browsing recursively */
+  gboolean recursive;
+  GQueue pending_walks;
+  GList *active_walks;
+  /* What we finish with, because of a bad object id or a failed walk */
+  GError *error;
+  /* The prefetch of the next page we started, and the one we are
+     waiting for */
+  struct _Prefetch *prefetch_started;
+  struct _Prefetch *prefetch;
+  /* Resolves the slow keys of the rows we deliver */
+  struct _SlowKeysResolver *slow_keys_resolver;
+  /* Absolute positions in the container of the next row we have to
+     deliver, of the end of the requested window and of the end of the
+     container, when we know it */
+  guint position;
+  guint end;
+  guint known_end;
+  /* The grilo page being fetched */
+  guint grl_skip;
+  guint grl_count;
+  guint page_received;
+  gboolean page_done;
+  /* What the grilo callbacks of that page come with; the pages are
+     counted so that we know which one an operation id belongs to */
+  struct _BrowsePage *page;
+  guint page_serial;
+  /* How long the pages take to come */
+  guint pages_fetched;
+  GTimer *page_timer;
+  gdouble first_row_time;
+  /* The page is waiting for its turn in the scheduler, or running */
+  guint job_id;
+  gboolean page_running;
+  /* What the client sees of the browse, for the statistics */
+  GTimer *browse_timer;
+  gboolean first_item_delivered;
+  gboolean failed;
+  /* We hold back the last row until we know if it is the last one */
+  gchar *pending_object_id;
+  GHashTable *pending_metadata;
+  /* Rows waiting to be delivered to the client, and the ones already
+     delivered, to be used again */
+  GQueue batch;
+  GTrashStack *spare_rows;
+  guint n_spare_rows;
+  guint flush_source;
+  guint idle_source;
+  /* A search replacing another one starts a bit later, in case the
+     client replaces it too */
+  gboolean delayed;
+  /* Cancelled because the client searched again */
+  gboolean superseded;
+  /* When time runs out the browse stops as if it was cancelled, but
+     what we have is delivered */
+  guint deadline_source;
+  gboolean timed_out;
+  gboolean cancelled;
+  gboolean finished;
 } BrowseCbInfo;
 
+/* The link comes first, so that the row can sit in the batch without
+   another allocation */
+typedef struct
+{
+  GList link;
+  gchar *object_id;
+  GHashTable *metadata;
+  guint remaining;
+  guint index;
+  GError *error;
+  gboolean next_page;
+} BrowseRow;
+
+/* Given to grilo with each page of a browse. It is detached from the
+   browse when a newer page replaces it, so late callbacks are
+   ignored */
+typedef struct _BrowsePage
+{
+  BrowseCbInfo *browse_cb_info;
+} BrowsePage;
+
+/* One box being browsed as part of a recursive browse. The browse and
+   the grilo operation going on each hold a reference, as either can
+   be over first. */
+typedef struct
+{
+  guint ref_count;
+  BrowseCbInfo *browse_cb_info;
+  GrlMedia *grl_media;
+  guint depth;
+  guint skip;
+  guint count;
+  guint received;
+  guint job_id;
+  guint grl_browse_id;
+  /* Counts the operations, to know which one an id belongs to */
+  guint serial;
+  gboolean running;
+  gboolean done;
+  /* Stopped by us, grilo ends it with an error that is not one */
+  gboolean cancelled;
+} RecursiveWalk;
+
+/* The fetch of the page behind a "More results..." row, before the
+   client asks for it */
+typedef struct _Prefetch
+{
+  MafwGriloSource *mafw_grilo_source;
+  gchar *listing_key;
+  GrlMedia *grl_media;
+  gchar *search_text;
+  GList *grl_keys;
+  guint skip;
+  guint count;
+  guint received;
+  guint job_id;
+  guint grl_browse_id;
+  gboolean running;
+  gboolean done;
+  guint timeout_source;
+  BrowseCbInfo *parent;
+  GList *waiters;
+  /* When refreshing a listing from the snapshot, what we had, and if
+     the source gave something else */
+  MafwGriloListing *stale;
+  gboolean changed;
+} Prefetch;
+
+/* When browsing with fast keys only, the slow keys of the delivered
+   rows are asked for later, and the client learns about them with
+   metadata-changed */
+typedef struct _SlowKeysResolver
+{
+  MafwGriloSource *mafw_grilo_source;
+  guint browse_id;
+  gchar **metadata_keys;
+  GQueue object_ids;
+  guint running;
+  gboolean browse_done;
+  gboolean cancelled;
+} SlowKeysResolver;
+
 typedef struct
 {
   MafwGriloSource *mafw_grilo_source;
   MafwSourceMetadataResultCb mafw_metadata_cb;
   gpointer mafw_user_data;
   gchar *mafw_object_id;
+  gchar **metadata_keys;
+  gchar **requested_keys;
+  GHashTable *metadata;
+  GError *error;
 } MetadataCbInfo;
 
+/* A grilo metadata operation, shared by all the clients asking for the
+   same object at the same time */
+typedef struct
+{
+  MafwGriloSource *mafw_grilo_source;
+  gchar *request_key;
+  gchar *mafw_object_id;
+  GrlMetadataResolutionFlags flags;
+  GPtrArray *metadata_keys;
+  GList *grl_keys;
+  GList *waiters;
+  guint job_id;
+  guint grl_browse_id;
+  GTimer *timer;
+  /* Once time runs out the waiters are answered, and what grilo gives
+     later only goes to the index */
+  guint deadline_source;
+  gboolean timed_out;
+} MetadataRequest;
+
+typedef struct
+{
+  MafwGriloSource *mafw_grilo_source;
+  MafwSourceMetadataResultsCb mafw_metadatas_cb;
+  gpointer mafw_user_data;
+  gchar **object_ids;
+  gchar **metadata_keys;
+  /* Next object to ask for and number of requests on their way */
+  guint next;
+  guint running;
+  GHashTable *metadatas;
+  GError *error;
+} MetadatasCbInfo;
+
+/* Clients searching as the user types, told apart by their callback
+   and user data: the search they are waiting for, and the last text
+   whose results they got from grilo */
+typedef struct
+{
+  MafwSourceBrowseResultCb mafw_browse_cb;
+  gpointer mafw_user_data;
+  guint browse_id;
+  gchar *base_text;
+} SearchClient;
+
 static void mafw_grilo_source_init (MafwGriloSource* self);
 static void mafw_grilo_source_class_init (MafwGriloSourceClass* klass);
 static MafwGriloSource *mafw_grilo_source_new (GrlMediaPlugin *grl_plugin);
+static void schedule_snapshot_load (MafwGriloSource *mafw_source);
 
 static guint mafw_grilo_source_browse (MafwSource *source,
                                        const gchar *object_id,
@@ -125,10 +538,17 @@ static void mafw_grilo_source_get_metadata (MafwSource *source,
                                             const gchar *const *metadata_keys,
                                             MafwSourceMetadataResultCb cb,
                                             gpointer user_data);
+static void mafw_grilo_source_get_metadatas (MafwSource *source,
+                                             const gchar **object_ids,
+                                             const gchar *const *metadata_keys,
+                                             MafwSourceMetadataResultsCb cb,
+                                             gpointer user_data);
 static gboolean mafw_grilo_source_initialize (MafwRegistry *mafw_registry,
                                               GError **error);
 static void mafw_grilo_source_deinitialize (GError **error);
 
+static void cancel_slow_keys_resolver (SlowKeysResolver *resolver);
+
 
 G_MODULE_EXPORT MafwPluginDescriptor mafw_grilo_source_plugin_description = {
   { .name = MAFW_GRILO_SOURCE_PLUGIN_NAME },
@@ -137,6 +557,29 @@ G_MODULE_EXPORT MafwPluginDescriptor mafw_grilo_source_plugin_description = {
 };
 
 
+static void
+probe_grl_source (MafwGriloSource *mafw_grilo_source,
+                  GrlSupportedOps supported_ops)
+{
+  MafwGriloSourcePrivate *priv = mafw_grilo_source->priv;
+  GrlMetadataSource *grl_source = GRL_METADATA_SOURCE (priv->grl_source);
+  const GList *key;
+
+  priv->supported_ops = supported_ops;
+  priv->supported_keys =
+    g_list_copy ((GList *) grl_metadata_source_supported_keys (grl_source));
+
+  for (key = priv->supported_keys; key; key = g_list_next (key))
+    {
+      g_hash_table_insert (priv->keys_profile, key->data, KEY_FAST);
+    }
+  for (key = grl_metadata_source_slow_keys (grl_source); key;
+       key = g_list_next (key))
+    {
+      g_hash_table_insert (priv->keys_profile, key->data, KEY_SLOW);
+    }
+}
+
 static void
 source_added_cb (GrlPluginRegistry *grl_registry, gpointer user_data)
 {
@@ -147,7 +590,7 @@ source_added_cb (GrlPluginRegistry *grl_registry, gpointer user_data)
   /* Only sources that implement browse are of interest */
   supported_ops =
     grl_metadata_source_supported_operations (GRL_METADATA_SOURCE (user_data));
-  if (!supported_ops & GRL_OP_BROWSE)
+  if (!(supported_ops & GRL_OP_BROWSE))
     {
       g_message ("discarded: %s (browse %s, metadata %s)",
                  grl_media_plugin_get_id (GRL_MEDIA_PLUGIN (user_data)),
@@ -157,8 +600,15 @@ source_added_cb (GrlPluginRegistry *grl_registry, gpointer user_data)
     }
 
   mafw_grilo_source = mafw_grilo_source_new (GRL_MEDIA_PLUGIN (user_data));
+  probe_grl_source (mafw_grilo_source, supported_ops);
+  schedule_snapshot_load (mafw_grilo_source);
   plugin.grl_sources =
     g_slist_prepend (plugin.grl_sources, g_object_ref (mafw_grilo_source));
+  if (plugin.aggregate)
+    {
+      mafw_grilo_aggregate_source_add_member (plugin.aggregate,
+                                              MAFW_SOURCE (mafw_grilo_source));
+    }
 
   mafw_registry = mafw_registry_get_instance ();
   mafw_registry_add_extension (mafw_registry,
@@ -194,6 +644,15 @@ cancel_pending_operations (MafwGriloSource *mafw_grilo_source)
     }
 
   g_list_free (list);
+
+  list = g_list_copy (mafw_grilo_source->priv->slow_keys_resolvers);
+
+  for (current = list; current; current = g_list_next (current))
+    {
+      cancel_slow_keys_resolver (current->data);
+    }
+
+  g_list_free (list);
 }
 
 static void
@@ -208,6 +667,11 @@ source_removed_cb (GrlPluginRegistry *registry, gpointer user_data)
     {
       MafwRegistry *mafw_registry;
 
+      if (plugin.aggregate)
+        {
+          mafw_grilo_aggregate_source_remove_member (plugin.aggregate,
+                                                     MAFW_SOURCE (link->data));
+        }
       cancel_pending_operations (MAFW_GRILO_SOURCE (link->data));
 
       mafw_registry = mafw_registry_get_instance ();
@@ -233,685 +697,3781 @@ initialize_media_types (void)
   type = grl_media_image_get_type ();
 }
 
-static gboolean
-mafw_grilo_source_initialize (MafwRegistry *mafw_registry,
-                              GError **error)
+static void
+load_plugin_config (void)
 {
-  GrlPluginRegistry *grl_registry;
+  GKeyFile *key_file;
+  const gchar **search_dirs;
+  const gchar *const *system_dirs;
+  gint i;
 
-  g_debug ("Mafw Grilo plugin initializing");
+  /* The user configuration goes before the system one */
+  system_dirs = g_get_system_config_dirs ();
+  search_dirs = g_new0 (const gchar *,
+                        g_strv_length ((gchar **) system_dirs) + 2);
+  search_dirs[0] = g_get_user_config_dir ();
+  for (i = 0; system_dirs[i]; i++)
+    {
+      search_dirs[i + 1] = system_dirs[i];
+    }
 
-  initialize_media_types ();
+  key_file = g_key_file_new ();
+  if (g_key_file_load_from_dirs (key_file, MAFW_GRILO_SOURCE_CONFIG_FILE,
+                                 search_dirs, NULL, G_KEY_FILE_NONE, NULL))
+    {
+      plugin.allowed_plugins =
+        g_key_file_get_string_list (key_file,
+                                    MAFW_GRILO_SOURCE_CONFIG_PLUGINS,
+                                    "allow", NULL, NULL);
+      plugin.denied_plugins =
+        g_key_file_get_string_list (key_file,
+                                    MAFW_GRILO_SOURCE_CONFIG_PLUGINS,
+                                    "deny", NULL, NULL);
+      plugin.aggregate_enabled =
+        g_key_file_get_boolean (key_file, MAFW_GRILO_SOURCE_CONFIG_PLUGINS,
+                                "aggregate", NULL);
+      plugin.snapshot_enabled =
+        g_key_file_get_boolean (key_file, MAFW_GRILO_SOURCE_CONFIG_PLUGINS,
+                                "snapshot", NULL);
+    }
 
-  grl_registry = grl_plugin_registry_get_instance ();
+  g_key_file_free (key_file);
+  g_free (search_dirs);
+}
 
-  g_signal_connect (grl_registry, "source-added",
-                    G_CALLBACK (source_added_cb), NULL);
-  g_signal_connect (grl_registry, "source-removed",
-                    G_CALLBACK (source_removed_cb), NULL);
+static gboolean
+plugin_is_wanted (const gchar *filename)
+{
+  gint i;
+
+  for (i = 0; plugin.denied_plugins && plugin.denied_plugins[i]; i++)
+    {
+      if (strcmp (plugin.denied_plugins[i], filename) == 0)
+        {
+          return FALSE;
+        }
+    }
 
-  grl_plugin_registry_load_all (grl_registry);
+  if (!plugin.allowed_plugins)
+    {
+      return TRUE;
+    }
 
-  return TRUE;
+  for (i = 0; plugin.allowed_plugins[i]; i++)
+    {
+      if (strcmp (plugin.allowed_plugins[i], filename) == 0)
+        {
+          return TRUE;
+        }
+    }
+
+  return FALSE;
 }
 
-static void
-mafw_grilo_source_deinitialize (GError **error)
+/* Grilo plugins are called libgrlfoo.so */
+static gboolean
+is_plugin_file (const gchar *filename)
 {
-  g_slist_foreach (plugin.grl_sources, (GFunc) g_object_unref, NULL);
-  g_slist_free (plugin.grl_sources);
-  plugin.grl_sources = NULL;
+  return g_str_has_prefix (filename, GRL_PLUGIN_MODULE_PREFIX) &&
+    g_str_has_suffix (filename, "." G_MODULE_SUFFIX) &&
+    strlen (filename) > strlen (GRL_PLUGIN_MODULE_PREFIX "." G_MODULE_SUFFIX);
 }
 
-static void
-destroy_browse_cb_info (gpointer user_data)
+static guint
+queue_plugins (const gchar *plugin_dir)
 {
-  BrowseCbInfo *browse_cb_info = user_data;
+  const gchar *filename;
+  guint found = 0;
+  GDir *dir;
 
-  g_object_unref (browse_cb_info->mafw_grilo_source);
-  if (browse_cb_info->grl_media)
+  dir = g_dir_open (plugin_dir, 0, NULL);
+  if (!dir)
     {
-      g_object_unref (browse_cb_info->grl_media);
+      return 0;
     }
-  g_free (browse_cb_info);
-}
-
-static const gchar *
-get_default_mime (MafwGriloSource *source)
-{
-  /* The mime is needed so that the apps can properly filter by them
-     when showing the results. As in some sources mime is a slow key
-     and we do not want to slow things down, we prefer to write this
-     HACK and set a default mime type depending on the source. This
-     way we always have a fallback. We could just say it is video, but
-     then in the interfaces showing icons, we would se an ugly video
-     icon for music or even they could be played like that. */
 
-  if (G_UNLIKELY (!source->priv->default_mime))
+  while ((filename = g_dir_read_name (dir)))
     {
-      if (strcmp (mafw_extension_get_uuid (MAFW_EXTENSION (source)),
-                  "grl_jamendo") == 0 ||
-          strcmp (mafw_extension_get_uuid (MAFW_EXTENSION (source)),
-                  "grl_shoutcast") == 0)
+      if (!is_plugin_file (filename))
         {
-          source->priv->default_mime =
-            g_strdup (MAFW_METADATA_VALUE_MIME_AUDIO);
+          continue;
+        }
+
+      found++;
+      if (plugin_is_wanted (filename))
+        {
+          g_queue_push_tail (&plugin.pending_plugins,
+                             g_build_filename (plugin_dir, filename, NULL));
         }
       else
         {
-          source->priv->default_mime =
-            g_strdup (MAFW_METADATA_VALUE_MIME_VIDEO);
+          g_debug ("skipping grilo plugin %s", filename);
         }
     }
 
-  return source->priv->default_mime;
+  g_dir_close (dir);
+
+  return found;
 }
 
-static void
-mafw_grilo_source_init (MafwGriloSource *self)
+static gboolean
+load_next_plugin (gpointer user_data)
 {
-  MafwGriloSourcePrivate *priv = NULL;
+  GrlPluginRegistry *grl_registry;
+  GTimer *timer;
+  gchar *path;
 
-  g_return_if_fail (MAFW_IS_GRILO_SOURCE (self));
-  priv = self->priv = MAFW_GRILO_SOURCE_GET_PRIVATE (self);
-  priv->grl_source = NULL;
-  priv->next_browse_id = 1;
-  priv->browse_metadata_mode = GRL_RESOLVE_FAST_ONLY;
-  priv->resolve_metadata_mode = GRL_RESOLVE_NORMAL;
-  priv->browse_requests =
-    g_hash_table_new_full (g_int_hash, g_int_equal, NULL,
-                           destroy_browse_cb_info);
-  priv->default_mime = NULL;
+  grl_registry = grl_plugin_registry_get_instance ();
+  timer = g_timer_new ();
 
-  mafw_extension_add_property(MAFW_EXTENSION(self),
-                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_METADATA_MODE,
-                              G_TYPE_UINT);
-  mafw_extension_add_property(MAFW_EXTENSION(self),
-                              MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE,
-                              G_TYPE_UINT);
-  mafw_extension_add_property(MAFW_EXTENSION(self),
-                              MAFW_PROPERTY_GRILO_SOURCE_DEFAULT_MIME,
-                              G_TYPE_STRING);
-}
+  /* One plugin per iteration, so that we can serve the sources we
+     have in the meantime. They are added from source_added_cb. */
+  path = g_queue_pop_head (&plugin.pending_plugins);
+  if (!path)
+    {
+      grl_plugin_registry_load_all (grl_registry);
+      g_debug ("grilo plugins took %.1f ms to load",
+               g_timer_elapsed (timer, NULL) * 1000);
+    }
+  else
+    {
+      if (!grl_plugin_registry_load (grl_registry, path))
+        {
+          g_warning ("could not load grilo plugin %s", path);
+        }
+      g_debug ("grilo plugin %s took %.1f ms to load", path,
+               g_timer_elapsed (timer, NULL) * 1000);
+      g_free (path);
+    }
 
-static void
-set_property (GObject *gobject, guint prop_id,
-              const GValue *value, GParamSpec *pspec)
-{
-  MafwGriloSource *source = MAFW_GRILO_SOURCE (gobject);
+  g_timer_destroy (timer);
 
-  switch (prop_id)
+  if (!g_queue_is_empty (&plugin.pending_plugins))
     {
-    case PROP_GRILO_PLUGIN:
-      /* Construct-only */
-      g_assert (source->priv->grl_source == NULL);
-      source->priv->grl_source = g_value_dup_object (value);
-      break;
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (source, prop_id, pspec);
-      break;
+      return TRUE;
     }
+
+  plugin.load_source = 0;
+
+  return FALSE;
 }
 
 static void
-dispose (GObject *object)
+start_loading_plugins (void)
 {
-  MafwGriloSource *source = MAFW_GRILO_SOURCE (object);
+  const gchar *plugin_path;
+  guint found = 0;
 
-  g_object_unref (source->priv->grl_source);
+  load_plugin_config ();
 
-  G_OBJECT_CLASS (mafw_grilo_source_parent_class)->dispose (object);
-}
+  /* Grilo looks in GRL_PLUGIN_PATH first too */
+  plugin_path = g_getenv ("GRL_PLUGIN_PATH");
+  if (plugin_path)
+    {
+      gchar **plugin_dirs;
+      gint i;
 
-static void
-finalize (GObject *object)
-{
-  MafwGriloSource *source = MAFW_GRILO_SOURCE (object);
+      plugin_dirs = g_strsplit (plugin_path, G_SEARCHPATH_SEPARATOR_S, -1);
+      for (i = 0; plugin_dirs[i]; i++)
+        {
+          found += queue_plugins (plugin_dirs[i]);
+        }
+      g_strfreev (plugin_dirs);
+    }
+  else
+    {
+      found = queue_plugins (GRILO_PLUGINS_DIR);
+    }
 
-  g_hash_table_destroy (source->priv->browse_requests);
-  g_free (source->priv->default_mime);
+  /* Without any plugin file we know of, we let grilo load what it
+     finds */
+  if (!found && (plugin.allowed_plugins || plugin.denied_plugins))
+    {
+      g_message ("no grilo plugins found to filter, loading them all");
+    }
+  else if (found && g_queue_is_empty (&plugin.pending_plugins))
+    {
+      g_message ("every grilo plugin is filtered out");
+      return;
+    }
 
-  G_OBJECT_CLASS (mafw_grilo_source_parent_class)->finalize (object);
+  plugin.load_source =
+    g_idle_add_full (G_PRIORITY_LOW, load_next_plugin, NULL, NULL);
 }
 
-static GQuark
-mafw_grilo_source_error_quark (void)
+static gboolean
+mafw_grilo_source_initialize (MafwRegistry *mafw_registry,
+                              GError **error)
 {
-  return g_quark_from_static_string ("mafw-grilo-source-error-quark");
-}
+  GrlPluginRegistry *grl_registry;
 
-static void
-mafw_grilo_source_get_property (MafwExtension *self,
-                                const gchar *key,
-                                MafwExtensionPropertyCallback callback,
-                                gpointer user_data)
-{
-  MafwGriloSource *source = MAFW_GRILO_SOURCE (self);
-  GValue *value = NULL;
-  GError *error = NULL;
+  g_debug ("Mafw Grilo plugin initializing");
 
-  g_return_if_fail (MAFW_IS_GRILO_SOURCE (self));
-  g_return_if_fail (callback != NULL);
-  g_return_if_fail (key != NULL);
+  initialize_media_types ();
 
-  if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_METADATA_MODE) == 0)
-    {
-      value = g_new0 (GValue, 1);
+  /* Sources load their snapshot, if enabled, once they are added */
+  plugin.snapshot_dir = g_build_filename (g_get_user_cache_dir (),
+                                          "mafw-grilo-source", NULL);
+
+  grl_registry = grl_plugin_registry_get_instance ();
+
+  g_signal_connect (grl_registry, "source-added",
+                    G_CALLBACK (source_added_cb), NULL);
+  g_signal_connect (grl_registry, "source-removed",
+                    G_CALLBACK (source_removed_cb), NULL);
+
+  /* Plugins are loaded later, so that we do not keep the daemon
+     waiting for them */
+  start_loading_plugins ();
+
+  /* The sources join it as they are added */
+  if (plugin.aggregate_enabled)
+    {
+      plugin.aggregate =
+        mafw_grilo_aggregate_source_new (MAFW_GRILO_SOURCE_PLUGIN_NAME);
+      mafw_registry_add_extension (mafw_registry,
+                                   MAFW_EXTENSION (plugin.aggregate));
+    }
+
+  return TRUE;
+}
+
+static void
+mafw_grilo_source_deinitialize (GError **error)
+{
+  if (plugin.aggregate)
+    {
+      g_object_unref (plugin.aggregate);
+      plugin.aggregate = NULL;
+    }
+  plugin.aggregate_enabled = FALSE;
+  plugin.snapshot_enabled = FALSE;
+  g_slist_foreach (plugin.grl_sources, (GFunc) g_object_unref, NULL);
+  g_slist_free (plugin.grl_sources);
+  plugin.grl_sources = NULL;
+  g_free (plugin.snapshot_dir);
+  plugin.snapshot_dir = NULL;
+
+  if (plugin.load_source)
+    {
+      g_source_remove (plugin.load_source);
+      plugin.load_source = 0;
+    }
+  g_queue_foreach (&plugin.pending_plugins, (GFunc) g_free, NULL);
+  g_queue_clear (&plugin.pending_plugins);
+  g_strfreev (plugin.allowed_plugins);
+  plugin.allowed_plugins = NULL;
+  g_strfreev (plugin.denied_plugins);
+  plugin.denied_plugins = NULL;
+}
+
+/* A browse goes through as many rows as the client reads, but only a
+   batch of them is alive at a time, so they are recycled within the
+   browse instead of going back to the allocator each time */
+static BrowseRow *
+new_browse_row (BrowseCbInfo *browse_cb_info)
+{
+  BrowseRow *row;
+
+  if (browse_cb_info->spare_rows)
+    {
+      row = g_trash_stack_pop (&browse_cb_info->spare_rows);
+      browse_cb_info->n_spare_rows--;
+    }
+  else
+    {
+      row = g_slice_new (BrowseRow);
+    }
+
+  row->link.data = row;
+  row->link.next = NULL;
+  row->link.prev = NULL;
+
+  return row;
+}
+
+static void
+free_browse_row (BrowseCbInfo *browse_cb_info, BrowseRow *row)
+{
+  g_free (row->object_id);
+  if (row->metadata)
+    {
+      g_hash_table_unref (row->metadata);
+    }
+  if (row->error)
+    {
+      g_error_free (row->error);
+    }
+
+  if (browse_cb_info->n_spare_rows < MAX_SPARE_BROWSE_ROWS)
+    {
+      g_trash_stack_push (&browse_cb_info->spare_rows, row);
+      browse_cb_info->n_spare_rows++;
+    }
+  else
+    {
+      g_slice_free (BrowseRow, row);
+    }
+}
+
+static void
+clear_browse_rows (BrowseCbInfo *browse_cb_info)
+{
+  GList *link;
+
+  while ((link = g_queue_pop_head_link (&browse_cb_info->batch)))
+    {
+      free_browse_row (browse_cb_info, link->data);
+    }
+}
+
+static void
+free_search_client (gpointer data, gpointer user_data)
+{
+  SearchClient *client = data;
+
+  g_free (client->base_text);
+  g_slice_free (SearchClient, client);
+}
+
+static RecursiveWalk *
+ref_recursive_walk (RecursiveWalk *walk)
+{
+  walk->ref_count++;
+
+  return walk;
+}
+
+static void
+unref_recursive_walk (gpointer data, gpointer user_data)
+{
+  RecursiveWalk *walk = data;
+
+  if (--walk->ref_count)
+    {
+      return;
+    }
+
+  if (walk->grl_media)
+    {
+      g_object_unref (walk->grl_media);
+    }
+  g_slice_free (RecursiveWalk, walk);
+}
+
+static gchar **
+get_slow_metadata_keys (MafwGriloSource *mafw_source,
+                        const gchar *const *metadata_keys)
+{
+  GPtrArray *keys;
+  GHashTableIter iter;
+  gpointer mafw_key, grl_key;
+  gint i;
+
+  keys = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, mafw_to_grl_keys);
+  while (g_hash_table_iter_next (&iter, &mafw_key, &grl_key))
+    {
+      if (g_hash_table_lookup (mafw_source->priv->keys_profile, grl_key) !=
+          KEY_SLOW)
+        {
+          continue;
+        }
+
+      for (i = 0; metadata_keys && metadata_keys[i]; i++)
+        {
+          if (strcmp (metadata_keys[i], mafw_key) == 0 ||
+              strcmp (metadata_keys[i], MAFW_SOURCE_KEY_WILDCARD) == 0)
+            {
+              g_ptr_array_add (keys, g_strdup (mafw_key));
+              break;
+            }
+        }
+    }
+
+  if (!keys->len)
+    {
+      g_ptr_array_free (keys, TRUE);
+      return NULL;
+    }
+
+  g_ptr_array_add (keys, NULL);
+
+  return (gchar **) g_ptr_array_free (keys, FALSE);
+}
+
+static SlowKeysResolver *
+new_slow_keys_resolver (MafwGriloSource *mafw_grilo_source, guint browse_id,
+                        gchar **metadata_keys)
+{
+  SlowKeysResolver *resolver;
+
+  resolver = g_slice_new0 (SlowKeysResolver);
+  resolver->mafw_grilo_source = g_object_ref (mafw_grilo_source);
+  resolver->browse_id = browse_id;
+  resolver->metadata_keys = metadata_keys;
+  g_queue_init (&resolver->object_ids);
+
+  /* The newest browse goes first, it is the one on the screen */
+  mafw_grilo_source->priv->slow_keys_resolvers =
+    g_list_prepend (mafw_grilo_source->priv->slow_keys_resolvers, resolver);
+
+  return resolver;
+}
+
+static void
+release_slow_keys_resolver (SlowKeysResolver *resolver)
+{
+  MafwGriloSourcePrivate *priv = resolver->mafw_grilo_source->priv;
+
+  if (resolver->running || !g_queue_is_empty (&resolver->object_ids) ||
+      (!resolver->browse_done && !resolver->cancelled))
+    {
+      return;
+    }
+
+  priv->slow_keys_resolvers = g_list_remove (priv->slow_keys_resolvers,
+                                             resolver);
+  g_strfreev (resolver->metadata_keys);
+  g_object_unref (resolver->mafw_grilo_source);
+  g_slice_free (SlowKeysResolver, resolver);
+}
+
+static void
+cancel_slow_keys_resolver (SlowKeysResolver *resolver)
+{
+  /* What is running cannot be stopped, but nobody will hear of it */
+  resolver->cancelled = TRUE;
+  g_queue_foreach (&resolver->object_ids, (GFunc) g_free, NULL);
+  g_queue_clear (&resolver->object_ids);
+  release_slow_keys_resolver (resolver);
+}
+
+static SlowKeysResolver *
+find_slow_keys_resolver (MafwGriloSource *mafw_grilo_source, guint browse_id)
+{
+  GList *link;
+
+  for (link = mafw_grilo_source->priv->slow_keys_resolvers; link;
+       link = g_list_next (link))
+    {
+      SlowKeysResolver *resolver = link->data;
+
+      if (resolver->browse_id == browse_id && !resolver->cancelled)
+        {
+          return resolver;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+slow_keys_resolved_cb (MafwSource *source,
+                       const gchar *object_id,
+                       GHashTable *metadata,
+                       gpointer user_data,
+                       const GError *error)
+{
+  SlowKeysResolver *resolver = user_data;
+
+  resolver->running--;
+  resolver->mafw_grilo_source->priv->slow_keys_running--;
+
+  /* We only asked for slow keys, so anything we got is news */
+  if (!resolver->cancelled && !error && metadata &&
+      g_hash_table_size (metadata) > 0)
+    {
+      g_signal_emit_by_name (source, "metadata-changed", object_id);
+    }
+
+  release_slow_keys_resolver (resolver);
+}
+
+static gboolean
+slow_keys_known (SlowKeysResolver *resolver, const gchar *object_id)
+{
+  GHashTable *metadata;
+  gchar **missing_keys;
+  GError *error = NULL;
+  gboolean known;
+
+  /* Another browse or a metadata request may have brought them */
+  known = mafw_grilo_media_index_lookup (resolver->mafw_grilo_source->priv->
+                                         media_index,
+                                         object_id,
+                                         (const gchar *const *) resolver->
+                                         metadata_keys,
+                                         &metadata, &missing_keys, &error);
+  known = known && !missing_keys && !error;
+
+  if (metadata)
+    {
+      g_hash_table_unref (metadata);
+    }
+  g_strfreev (missing_keys);
+  if (error)
+    {
+      g_error_free (error);
+    }
+
+  return known;
+}
+
+static gboolean
+resolve_slow_keys (gpointer user_data)
+{
+  MafwGriloSource *mafw_grilo_source = user_data;
+  MafwGriloSourcePrivate *priv = mafw_grilo_source->priv;
+  GList *link, *next;
+
+  /* We ask for one object per tick, so that the slow keys never take
+     the source from the browses and metadata requests of the
+     clients */
+  if (priv->slow_keys_running >= MAX (priv->metadata_concurrency, 1))
+    {
+      return TRUE;
+    }
+
+  for (link = priv->slow_keys_resolvers; link; link = next)
+    {
+      SlowKeysResolver *resolver = link->data;
+
+      next = g_list_next (link);
+
+      /* The rows were queued as they were delivered, so the earlier
+         ones, on the screen, go first */
+      while (!g_queue_is_empty (&resolver->object_ids))
+        {
+          gchar *object_id = g_queue_pop_head (&resolver->object_ids);
+
+          if (slow_keys_known (resolver, object_id))
+            {
+              g_free (object_id);
+              continue;
+            }
+
+          resolver->running++;
+          priv->slow_keys_running++;
+          mafw_grilo_source_get_metadata (MAFW_SOURCE (mafw_grilo_source),
+                                          object_id,
+                                          (const gchar *const *) resolver->
+                                          metadata_keys,
+                                          slow_keys_resolved_cb, resolver);
+          g_free (object_id);
+
+          return TRUE;
+        }
+
+      release_slow_keys_resolver (resolver);
+    }
+
+  priv->slow_keys_source = 0;
+
+  return FALSE;
+}
+
+static void
+queue_slow_keys (SlowKeysResolver *resolver, const gchar *object_id)
+{
+  MafwGriloSourcePrivate *priv = resolver->mafw_grilo_source->priv;
+
+  g_queue_push_tail (&resolver->object_ids, g_strdup (object_id));
+
+  if (!priv->slow_keys_source)
+    {
+      priv->slow_keys_source =
+        g_timeout_add (1000 / MAX (priv->slow_keys_rate, 1),
+                       resolve_slow_keys, resolver->mafw_grilo_source);
+    }
+}
+
+static void
+destroy_browse_cb_info (gpointer user_data)
+{
+  BrowseCbInfo *browse_cb_info = user_data;
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  MafwGriloStats *stats = priv->stats;
+  GList *link;
+
+  mafw_grilo_stats_add (stats,
+                        browse_cb_info->timed_out ?
+                        MAFW_GRILO_STATS_BROWSES_TIMED_OUT :
+                        browse_cb_info->cancelled ?
+                        MAFW_GRILO_STATS_BROWSES_CANCELLED :
+                        browse_cb_info->failed ?
+                        MAFW_GRILO_STATS_BROWSES_FAILED :
+                        MAFW_GRILO_STATS_BROWSES_COMPLETED, 1);
+  mafw_grilo_stats_add_time (stats, MAFW_GRILO_STATS_BROWSE_TIME,
+                             g_timer_elapsed (browse_cb_info->browse_timer,
+                                              NULL));
+  g_timer_destroy (browse_cb_info->browse_timer);
+
+  if (browse_cb_info->grl_media)
+    {
+      g_object_unref (browse_cb_info->grl_media);
+    }
+  if (browse_cb_info->pending_metadata)
+    {
+      g_hash_table_unref (browse_cb_info->pending_metadata);
+    }
+  if (browse_cb_info->idle_source)
+    {
+      g_source_remove (browse_cb_info->idle_source);
+    }
+  if (browse_cb_info->flush_source)
+    {
+      g_source_remove (browse_cb_info->flush_source);
+    }
+  if (browse_cb_info->deadline_source)
+    {
+      g_source_remove (browse_cb_info->deadline_source);
+    }
+  clear_browse_rows (browse_cb_info);
+  while (browse_cb_info->spare_rows)
+    {
+      g_slice_free (BrowseRow,
+                    g_trash_stack_pop (&browse_cb_info->spare_rows));
+    }
+  if (browse_cb_info->job_id)
+    {
+      mafw_grilo_scheduler_remove (priv->scheduler, browse_cb_info->job_id);
+    }
+  if (browse_cb_info->filter)
+    {
+      mafw_filter_free (browse_cb_info->filter);
+    }
+  g_free (browse_cb_info->search_text);
+  g_list_free (browse_cb_info->grl_keys);
+  if (browse_cb_info->sorter)
+    {
+      mafw_grilo_sorter_free (browse_cb_info->sorter);
+    }
+  if (browse_cb_info->page)
+    {
+      browse_cb_info->page->browse_cb_info = NULL;
+    }
+  g_queue_foreach (&browse_cb_info->pending_walks, unref_recursive_walk, NULL);
+  g_queue_clear (&browse_cb_info->pending_walks);
+  for (link = browse_cb_info->active_walks; link; link = g_list_next (link))
+    {
+      RecursiveWalk *walk = link->data;
+
+      if (walk->job_id)
+        {
+          mafw_grilo_scheduler_remove (priv->scheduler, walk->job_id);
+        }
+      if (walk->running)
+        {
+          mafw_grilo_scheduler_done (priv->scheduler);
+        }
+      /* What grilo still has to say goes nowhere */
+      if (walk->grl_browse_id)
+        {
+          grl_media_source_cancel (GRL_MEDIA_SOURCE (priv->grl_source),
+                                   walk->grl_browse_id);
+        }
+      walk->browse_cb_info = NULL;
+      unref_recursive_walk (walk, NULL);
+    }
+  g_list_free (browse_cb_info->active_walks);
+  if (browse_cb_info->prefetch_started)
+    {
+      browse_cb_info->prefetch_started->parent = NULL;
+    }
+  if (browse_cb_info->prefetch)
+    {
+      browse_cb_info->prefetch->waiters =
+        g_list_remove (browse_cb_info->prefetch->waiters, browse_cb_info);
+    }
+  if (browse_cb_info->error)
+    {
+      g_error_free (browse_cb_info->error);
+    }
+  if (browse_cb_info->slow_keys_resolver)
+    {
+      /* The rows are delivered, but not all their slow keys */
+      browse_cb_info->slow_keys_resolver->browse_done = TRUE;
+      release_slow_keys_resolver (browse_cb_info->slow_keys_resolver);
+    }
+  if (browse_cb_info->page_timer)
+    {
+      g_timer_destroy (browse_cb_info->page_timer);
+    }
+  g_strfreev (browse_cb_info->metadata_keys);
+  g_strfreev (browse_cb_info->extra_keys);
+  g_free (browse_cb_info->pending_object_id);
+  g_free (browse_cb_info->listing_key);
+  g_object_unref (browse_cb_info->mafw_grilo_source);
+  g_free (browse_cb_info);
+}
+
+static const gchar *
+get_default_mime (MafwGriloSource *source)
+{
+  /* The mime is needed so that the apps can properly filter by them
+     when showing the results. As in some sources mime is a slow key
+     and we do not want to slow things down, we prefer to write this
+     HACK and set a default mime type depending on the source. This
+     way we always have a fallback. We could just say it is video, but
+     then in the interfaces showing icons, we would se an ugly video
+     icon for music or even they could be played like that. */
+
+  if (G_UNLIKELY (!source->priv->default_mime))
+    {
+      if (strcmp (mafw_extension_get_uuid (MAFW_EXTENSION (source)),
+                  "grl_jamendo") == 0 ||
+          strcmp (mafw_extension_get_uuid (MAFW_EXTENSION (source)),
+                  "grl_shoutcast") == 0)
+        {
+          source->priv->default_mime =
+            g_strdup (MAFW_METADATA_VALUE_MIME_AUDIO);
+        }
+      else
+        {
+          source->priv->default_mime =
+            g_strdup (MAFW_METADATA_VALUE_MIME_VIDEO);
+        }
+    }
+
+  return source->priv->default_mime;
+}
+
+static void
+mafw_grilo_source_init (MafwGriloSource *self)
+{
+  MafwGriloSourcePrivate *priv = NULL;
+
+  g_return_if_fail (MAFW_IS_GRILO_SOURCE (self));
+  priv = self->priv = MAFW_GRILO_SOURCE_GET_PRIVATE (self);
+  priv->grl_source = NULL;
+  priv->supported_ops = GRL_OP_NONE;
+  priv->supported_keys = NULL;
+  priv->keys_profile = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->next_browse_id = 1;
+  priv->browse_metadata_mode = GRL_RESOLVE_FAST_ONLY;
+  priv->resolve_metadata_mode = GRL_RESOLVE_NORMAL;
+  priv->browse_batch_size = DEFAULT_BROWSE_BATCH_SIZE;
+  priv->browse_batch_time = DEFAULT_BROWSE_BATCH_TIME;
+  priv->batch_timer = g_timer_new ();
+  priv->browse_requests =
+    g_hash_table_new_full (g_int_hash, g_int_equal, NULL,
+                           destroy_browse_cb_info);
+  priv->metadata_requests =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  priv->grl_keys_cache = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&priv->grl_keys_lru);
+  priv->default_mime = NULL;
+  priv->listing_cache =
+    mafw_grilo_listing_cache_new (DEFAULT_LISTING_CACHE_TTL,
+                                  DEFAULT_LISTING_CACHE_SIZE);
+  priv->media_index = mafw_grilo_media_index_new (DEFAULT_MEDIA_INDEX_SIZE);
+  priv->metadata_concurrency = DEFAULT_METADATA_CONCURRENCY;
+  priv->scheduler = mafw_grilo_scheduler_new (DEFAULT_MAX_OPERATIONS);
+  priv->recursive_breadth = DEFAULT_RECURSIVE_BREADTH;
+  priv->recursive_depth = DEFAULT_RECURSIVE_DEPTH;
+  priv->prefetch_size = DEFAULT_PREFETCH_SIZE;
+  priv->prefetches = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->page_sizer = mafw_grilo_page_sizer_new (BROWSE_PAGE_SIZE, MAX_COUNT);
+  priv->browse_slow_keys = FALSE;
+  priv->slow_keys_rate = DEFAULT_SLOW_KEYS_RATE;
+  priv->snapshot_enabled = plugin.snapshot_enabled;
+  priv->snapshot = NULL;
+  priv->stats = mafw_grilo_stats_new ();
+  priv->browse_deadline = DEFAULT_BROWSE_DEADLINE;
+  priv->metadata_deadline = DEFAULT_METADATA_DEADLINE;
+  priv->thumbnail_size = DEFAULT_THUMBNAIL_SIZE;
+  priv->thumbnail_cache_size = DEFAULT_THUMBNAIL_CACHE_SIZE;
+  priv->thumbnailer = NULL;
+  priv->search_delay = DEFAULT_SEARCH_DELAY;
+  priv->supersede_searches = FALSE;
+  g_queue_init (&priv->search_clients);
+
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_METADATA_MODE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_BATCH_SIZE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_BATCH_TIME,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_DEFAULT_MIME,
+                              G_TYPE_STRING);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_LISTING_CACHE_TTL,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_LISTING_CACHE_SIZE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_MEDIA_INDEX_SIZE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_METADATA_CONCURRENCY,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_MAX_OPERATIONS,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_RECURSIVE_BREADTH,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_RECURSIVE_DEPTH,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_PREFETCH_SIZE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_PAGE_SIZE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_ITEM_LATENCY,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_FIRST_ITEM_LATENCY,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_SLOW_KEYS,
+                              G_TYPE_BOOLEAN);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_SLOW_KEYS_RATE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_SNAPSHOT,
+                              G_TYPE_BOOLEAN);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_STATS,
+                              G_TYPE_STRING);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_RESET_STATS,
+                              G_TYPE_BOOLEAN);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_BROWSE_DEADLINE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_METADATA_DEADLINE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_THUMBNAILS,
+                              G_TYPE_BOOLEAN);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_THUMBNAIL_SIZE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_THUMBNAIL_CACHE_SIZE,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_SEARCH_DELAY,
+                              G_TYPE_UINT);
+  mafw_extension_add_property(MAFW_EXTENSION(self),
+                              MAFW_PROPERTY_GRILO_SOURCE_SUPERSEDE_SEARCHES,
+                              G_TYPE_BOOLEAN);
+}
+
+static void
+set_property (GObject *gobject, guint prop_id,
+              const GValue *value, GParamSpec *pspec)
+{
+  MafwGriloSource *source = MAFW_GRILO_SOURCE (gobject);
+
+  switch (prop_id)
+    {
+    case PROP_GRILO_PLUGIN:
+      /* Construct-only */
+      g_assert (source->priv->grl_source == NULL);
+      source->priv->grl_source = g_value_dup_object (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (source, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+dispose (GObject *object)
+{
+  MafwGriloSource *source = MAFW_GRILO_SOURCE (object);
+
+  g_object_unref (source->priv->grl_source);
+
+  G_OBJECT_CLASS (mafw_grilo_source_parent_class)->dispose (object);
+}
+
+static void
+free_grl_keys_entry (gpointer data, gpointer user_data)
+{
+  GrlKeysEntry *entry = data;
+
+  g_free (entry->signature);
+  g_list_free (entry->grl_keys);
+  g_slice_free (GrlKeysEntry, entry);
+}
+
+static void
+finalize (GObject *object)
+{
+  MafwGriloSource *source = MAFW_GRILO_SOURCE (object);
+
+  g_hash_table_destroy (source->priv->browse_requests);
+  g_hash_table_destroy (source->priv->metadata_requests);
+  g_hash_table_destroy (source->priv->prefetches);
+  g_hash_table_destroy (source->priv->grl_keys_cache);
+  g_queue_foreach (&source->priv->grl_keys_lru, free_grl_keys_entry, NULL);
+  g_queue_clear (&source->priv->grl_keys_lru);
+  g_hash_table_destroy (source->priv->keys_profile);
+  g_list_free (source->priv->supported_keys);
+  g_free (source->priv->default_mime);
+  g_free (source->priv->object_id_prefix);
+  if (source->priv->snapshot_source)
+    {
+      g_source_remove (source->priv->snapshot_source);
+    }
+  if (source->priv->snapshot)
+    {
+      mafw_grilo_snapshot_free (source->priv->snapshot);
+    }
+  if (source->priv->slow_keys_source)
+    {
+      g_source_remove (source->priv->slow_keys_source);
+    }
+  if (source->priv->thumbnailer)
+    {
+      mafw_grilo_thumbnailer_free (source->priv->thumbnailer);
+      g_hash_table_destroy (source->priv->thumbnail_waiters);
+    }
+  g_queue_foreach (&source->priv->search_clients, free_search_client, NULL);
+  g_queue_clear (&source->priv->search_clients);
+  g_timer_destroy (source->priv->batch_timer);
+  mafw_grilo_listing_cache_free (source->priv->listing_cache);
+  mafw_grilo_media_index_free (source->priv->media_index);
+  mafw_grilo_scheduler_free (source->priv->scheduler);
+  mafw_grilo_page_sizer_free (source->priv->page_sizer);
+  mafw_grilo_stats_free (source->priv->stats);
+
+  G_OBJECT_CLASS (mafw_grilo_source_parent_class)->finalize (object);
+}
+
+static GQuark
+mafw_grilo_source_error_quark (void)
+{
+  return g_quark_from_static_string ("mafw-grilo-source-error-quark");
+}
+
+static void
+mafw_grilo_source_get_property (MafwExtension *self,
+                                const gchar *key,
+                                MafwExtensionPropertyCallback callback,
+                                gpointer user_data)
+{
+  MafwGriloSource *source = MAFW_GRILO_SOURCE (self);
+  GValue *value = NULL;
+  GError *error = NULL;
+
+  g_return_if_fail (MAFW_IS_GRILO_SOURCE (self));
+  g_return_if_fail (callback != NULL);
+  g_return_if_fail (key != NULL);
+
+  if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_METADATA_MODE) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      switch (source->priv->browse_metadata_mode)
+        {
+        case GRL_RESOLVE_FAST_ONLY:
+          g_value_set_uint (value, MAFW_GRILO_SOURCE_METADATA_MODE_FAST);
+          break;
+        case GRL_RESOLVE_NORMAL:
+          g_value_set_uint (value, MAFW_GRILO_SOURCE_METADATA_MODE_NORMAL);
+          break;
+        case GRL_RESOLVE_FULL:
+          g_value_set_uint (value, MAFW_GRILO_SOURCE_METADATA_MODE_FULL);
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_BATCH_SIZE) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->browse_batch_size);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_BATCH_TIME) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->browse_batch_time);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      switch (source->priv->resolve_metadata_mode)
+        {
+        case GRL_RESOLVE_FAST_ONLY:
+          g_value_set_uint (value,
+                            MAFW_GRILO_SOURCE_METADATA_MODE_FAST);
+          break;
+        case GRL_RESOLVE_NORMAL:
+          g_value_set_uint (value,
+                            MAFW_GRILO_SOURCE_METADATA_MODE_NORMAL);
+          break;
+        case GRL_RESOLVE_FULL:
+          g_value_set_uint (value,
+                            MAFW_GRILO_SOURCE_METADATA_MODE_FULL);
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_STRING);
+      g_value_set_string (value, source->priv->default_mime);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_LISTING_CACHE_TTL) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value,
+                        mafw_grilo_listing_cache_get_ttl (source->priv->
+                                                          listing_cache));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_LISTING_CACHE_SIZE) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value,
+                        mafw_grilo_listing_cache_get_max_entries (source->priv->
+                                                                  listing_cache));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_MEDIA_INDEX_SIZE) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value,
+                        mafw_grilo_media_index_get_max_entries (source->priv->
+                                                                media_index));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_METADATA_CONCURRENCY) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->metadata_concurrency);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_MAX_OPERATIONS) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value,
+                        mafw_grilo_scheduler_get_max_running (source->priv->
+                                                              scheduler));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RECURSIVE_BREADTH) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->recursive_breadth);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RECURSIVE_DEPTH) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->recursive_depth);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_PREFETCH_SIZE) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->prefetch_size);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_PAGE_SIZE) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value,
+                        mafw_grilo_page_sizer_get_page_size (source->priv->
+                                                             page_sizer));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_ITEM_LATENCY) == 0)
+    {
+      /* Microseconds per item */
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value,
+                        mafw_grilo_page_sizer_get_item_latency (source->priv->
+                                                                page_sizer));
+    }
+  else if (strcmp (key,
+                   MAFW_PROPERTY_GRILO_SOURCE_BROWSE_FIRST_ITEM_LATENCY) == 0)
+    {
+      /* Milliseconds until the first item of a page */
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value,
+                        mafw_grilo_page_sizer_get_first_item_latency (source->
+                                                                      priv->
+                                                                      page_sizer));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_SLOW_KEYS) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_BOOLEAN);
+      g_value_set_boolean (value, source->priv->browse_slow_keys);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_SLOW_KEYS_RATE) == 0)
+    {
+      /* Objects per second */
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->slow_keys_rate);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_SNAPSHOT) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_BOOLEAN);
+      g_value_set_boolean (value, source->priv->snapshot_enabled);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_STATS) == 0)
+    {
+      GString *text;
+
+      /* "name value" lines, counting since the source was created or
+         the last reset */
+      text = g_string_new (NULL);
+      mafw_grilo_stats_print (source->priv->stats, text);
+      g_string_append_printf (text, "browses-active %u\n",
+                              g_hash_table_size (source->priv->
+                                                 browse_requests));
+      g_string_append_printf (text, "metadata-operations-active %u\n",
+                              g_hash_table_size (source->priv->
+                                                 metadata_requests));
+      g_string_append_printf (text, "operations-running %u\n",
+                              mafw_grilo_scheduler_get_running (source->priv->
+                                                                scheduler));
+      g_string_append_printf (text, "operations-waiting %u\n",
+                              mafw_grilo_scheduler_get_waiting (source->priv->
+                                                                scheduler));
+
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_STRING);
+      g_value_take_string (value, g_string_free (text, FALSE));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_DEADLINE) == 0)
+    {
+      /* Seconds */
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->browse_deadline);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_METADATA_DEADLINE) == 0)
+    {
+      /* Seconds */
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->metadata_deadline);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_THUMBNAILS) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_BOOLEAN);
+      g_value_set_boolean (value, source->priv->thumbnailer != NULL);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_THUMBNAIL_SIZE) == 0)
+    {
+      /* Pixels */
+      value = g_new0 (GValue, 1);
       g_value_init (value, G_TYPE_UINT);
-      switch (source->priv->browse_metadata_mode)
+      g_value_set_uint (value, source->priv->thumbnail_size);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_THUMBNAIL_CACHE_SIZE) == 0)
+    {
+      /* Kilobytes */
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->thumbnail_cache_size);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_SEARCH_DELAY) == 0)
+    {
+      /* Milliseconds */
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_UINT);
+      g_value_set_uint (value, source->priv->search_delay);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_SUPERSEDE_SEARCHES) == 0)
+    {
+      value = g_new0 (GValue, 1);
+      g_value_init (value, G_TYPE_BOOLEAN);
+      g_value_set_boolean (value, source->priv->supersede_searches);
+    }
+  else
+    {
+      /* Unsupported property */
+      error = g_error_new(MAFW_GRILO_SOURCE_ERROR,
+                          MAFW_EXTENSION_ERROR_GET_PROPERTY,
+                          "Unsupported property");
+    }
+
+  callback (self, key, value, user_data, error);
+}
+
+static void
+thumbnail_done_cb (const gchar *uri, const gchar *local_uri,
+                   gpointer user_data)
+{
+  MafwGriloSource *mafw_source = user_data;
+  MafwGriloSourcePrivate *priv = mafw_source->priv;
+  gpointer key, value;
+  GPtrArray *object_ids;
+  GHashTable *metadata;
+  guint i;
+
+  if (!g_hash_table_lookup_extended (priv->thumbnail_waiters, uri, &key,
+                                     &value))
+    {
+      return;
+    }
+  g_hash_table_steal (priv->thumbnail_waiters, uri);
+  g_free (key);
+  object_ids = value;
+
+  /* The objects are told only once the index has the new thumbnail,
+     as that is where their metadata comes from when they ask again */
+  if (local_uri)
+    {
+      metadata = mafw_metadata_new ();
+      mafw_metadata_add_str (metadata, MAFW_METADATA_KEY_THUMBNAIL,
+                             local_uri);
+      for (i = 0; i < object_ids->len; i++)
+        {
+          mafw_grilo_media_index_add (priv->media_index,
+                                      g_ptr_array_index (object_ids, i),
+                                      metadata, NULL);
+        }
+      g_hash_table_unref (metadata);
+
+      for (i = 0; i < object_ids->len; i++)
+        {
+          g_signal_emit_by_name (mafw_source, "metadata-changed",
+                                 g_ptr_array_index (object_ids, i));
+        }
+    }
+
+  g_ptr_array_unref (object_ids);
+}
+
+static void
+wait_for_thumbnail (MafwGriloSource *mafw_source, const gchar *uri,
+                    const gchar *object_id)
+{
+  GPtrArray *object_ids;
+  guint i;
+
+  object_ids = g_hash_table_lookup (mafw_source->priv->thumbnail_waiters,
+                                    uri);
+  if (!object_ids)
+    {
+      object_ids = g_ptr_array_new_with_free_func (g_free);
+      g_hash_table_insert (mafw_source->priv->thumbnail_waiters,
+                           g_strdup (uri), object_ids);
+    }
+  else if (object_ids->len >= MAX_THUMBNAIL_WAITERS)
+    {
+      return;
+    }
+
+  for (i = 0; i < object_ids->len; i++)
+    {
+      if (strcmp (g_ptr_array_index (object_ids, i), object_id) == 0)
+        {
+          return;
+        }
+    }
+
+  g_ptr_array_add (object_ids, g_strdup (object_id));
+}
+
+static void
+mafw_grilo_source_set_property (MafwExtension *self,
+                                const gchar *key,
+                                const GValue *value)
+{
+  MafwGriloSource *source = MAFW_GRILO_SOURCE (self);
+
+  g_return_if_fail (MAFW_IS_GRILO_SOURCE (self));
+  g_return_if_fail (key != NULL);
+
+  if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_METADATA_MODE) == 0)
+    {
+      switch (g_value_get_uint (value))
+        {
+        case MAFW_GRILO_SOURCE_METADATA_MODE_FAST:
+          source->priv->browse_metadata_mode = GRL_RESOLVE_FAST_ONLY;
+          break;
+        case MAFW_GRILO_SOURCE_METADATA_MODE_NORMAL:
+          source->priv->browse_metadata_mode = GRL_RESOLVE_NORMAL;
+          break;
+        case MAFW_GRILO_SOURCE_METADATA_MODE_FULL:
+          source->priv->browse_metadata_mode = GRL_RESOLVE_FULL;
+          break;
+        default:
+          g_warning ("Wrong metadata mode: %d", g_value_get_uint (value));
+        }
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_BATCH_SIZE) == 0)
+    {
+      /* We need to deliver at least one row each time */
+      source->priv->browse_batch_size = MAX (g_value_get_uint (value), 1);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_BATCH_TIME) == 0)
+    {
+      source->priv->browse_batch_time = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE) == 0)
+    {
+      switch (g_value_get_uint (value))
+        {
+        case MAFW_GRILO_SOURCE_METADATA_MODE_FAST:
+          source->priv->resolve_metadata_mode = GRL_RESOLVE_FAST_ONLY;
+          break;
+        case MAFW_GRILO_SOURCE_METADATA_MODE_NORMAL:
+          source->priv->resolve_metadata_mode = GRL_RESOLVE_NORMAL;
+          break;
+        case MAFW_GRILO_SOURCE_METADATA_MODE_FULL:
+          source->priv->resolve_metadata_mode = GRL_RESOLVE_FULL;
+          break;
+        default:
+          g_warning ("Wrong metadata mode: %d", g_value_get_uint (value));
+        }
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE) == 0)
+    {
+      gchar *old_string = source->priv->default_mime;
+      source->priv->default_mime = g_value_dup_string (value);
+      g_free (old_string);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_LISTING_CACHE_TTL) == 0)
+    {
+      mafw_grilo_listing_cache_set_ttl (source->priv->listing_cache,
+                                        g_value_get_uint (value));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_LISTING_CACHE_SIZE) == 0)
+    {
+      mafw_grilo_listing_cache_set_max_entries (source->priv->listing_cache,
+                                                g_value_get_uint (value));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_MEDIA_INDEX_SIZE) == 0)
+    {
+      mafw_grilo_media_index_set_max_entries (source->priv->media_index,
+                                              g_value_get_uint (value));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_METADATA_CONCURRENCY) == 0)
+    {
+      source->priv->metadata_concurrency = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_MAX_OPERATIONS) == 0)
+    {
+      mafw_grilo_scheduler_set_max_running (source->priv->scheduler,
+                                            g_value_get_uint (value));
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RECURSIVE_BREADTH) == 0)
+    {
+      source->priv->recursive_breadth = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RECURSIVE_DEPTH) == 0)
+    {
+      source->priv->recursive_depth = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_PREFETCH_SIZE) == 0)
+    {
+      source->priv->prefetch_size = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_SLOW_KEYS) == 0)
+    {
+      /* Only matters when browsing with fast keys only */
+      source->priv->browse_slow_keys = g_value_get_boolean (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_SLOW_KEYS_RATE) == 0)
+    {
+      source->priv->slow_keys_rate = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_SNAPSHOT) == 0)
+    {
+      source->priv->snapshot_enabled = g_value_get_boolean (value);
+      if (!source->priv->snapshot_enabled && source->priv->snapshot)
+        {
+          /* What we have is written, but nothing else */
+          mafw_grilo_snapshot_free (source->priv->snapshot);
+          source->priv->snapshot = NULL;
+        }
+      schedule_snapshot_load (source);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESET_STATS) == 0)
+    {
+      if (g_value_get_boolean (value))
+        {
+          mafw_grilo_stats_reset (source->priv->stats);
+        }
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_DEADLINE) == 0)
+    {
+      /* Applies to the browses started from now on */
+      source->priv->browse_deadline = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_METADATA_DEADLINE) == 0)
+    {
+      source->priv->metadata_deadline = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_THUMBNAILS) == 0)
+    {
+      if (g_value_get_boolean (value) && !source->priv->thumbnailer)
+        {
+          gchar *cache_dir;
+
+          /* All the sources share the cache */
+          cache_dir = g_build_filename (g_get_user_cache_dir (),
+                                        "mafw-grilo-source", "thumbnails",
+                                        NULL);
+          source->priv->thumbnailer =
+            mafw_grilo_thumbnailer_new (cache_dir,
+                                        source->priv->thumbnail_size,
+                                        (guint64) source->priv->
+                                        thumbnail_cache_size * 1024,
+                                        MAX_THUMBNAIL_FETCHES,
+                                        thumbnail_done_cb, source);
+          source->priv->thumbnail_waiters =
+            g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                   (GDestroyNotify) g_ptr_array_unref);
+          g_free (cache_dir);
+        }
+      else if (!g_value_get_boolean (value) && source->priv->thumbnailer)
+        {
+          mafw_grilo_thumbnailer_free (source->priv->thumbnailer);
+          source->priv->thumbnailer = NULL;
+          g_hash_table_destroy (source->priv->thumbnail_waiters);
+          source->priv->thumbnail_waiters = NULL;
+        }
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_THUMBNAIL_SIZE) == 0)
+    {
+      if (g_value_get_uint (value) == 0)
+        {
+          return;
+        }
+      source->priv->thumbnail_size = g_value_get_uint (value);
+      if (source->priv->thumbnailer)
+        {
+          mafw_grilo_thumbnailer_set_size (source->priv->thumbnailer,
+                                           source->priv->thumbnail_size);
+          /* Fetches of the old size are never done */
+          g_hash_table_remove_all (source->priv->thumbnail_waiters);
+        }
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_THUMBNAIL_CACHE_SIZE) == 0)
+    {
+      source->priv->thumbnail_cache_size = g_value_get_uint (value);
+      if (source->priv->thumbnailer)
+        {
+          mafw_grilo_thumbnailer_set_max_cache_size (source->priv->thumbnailer,
+                                                     (guint64) source->priv->
+                                                     thumbnail_cache_size *
+                                                     1024);
+        }
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_SEARCH_DELAY) == 0)
+    {
+      source->priv->search_delay = g_value_get_uint (value);
+    }
+  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_SUPERSEDE_SEARCHES) == 0)
+    {
+      source->priv->supersede_searches = g_value_get_boolean (value);
+    }
+  else
+    {
+      return;
+    }
+
+  mafw_extension_emit_property_changed (self, key, value);
+}
+
+static void
+initialize_metadata_key_mappings (void)
+{
+  mafw_to_grl_keys = g_hash_table_new (g_str_hash, g_str_equal);
+  grl_to_mafw_keys = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+#define ADD_METADATA_KEY_MAPPING(mafw_key, grl_key, from_grl)           \
+  g_hash_table_insert (mafw_to_grl_keys, (gpointer) mafw_key,           \
+                       GRLKEYID_TO_POINTER (grl_key));                  \
+  if (from_grl)                                                         \
+    {                                                                   \
+      g_hash_table_insert (grl_to_mafw_keys,                            \
+                           GRLKEYID_TO_POINTER (grl_key),               \
+                           (gpointer) mafw_key);                        \
+    }
+
+  METADATA_KEY_MAPPINGS (ADD_METADATA_KEY_MAPPING)
+
+#undef ADD_METADATA_KEY_MAPPING
+}
+
+static void
+mafw_grilo_source_class_init (MafwGriloSourceClass *klass)
+{
+  GObjectClass *gobject_class;
+  MafwSourceClass *source_class;
+
+  g_return_if_fail (klass != NULL);
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  source_class = MAFW_SOURCE_CLASS (klass);
+
+  g_type_class_add_private (gobject_class, sizeof (MafwGriloSourcePrivate));
+
+  initialize_metadata_key_mappings ();
+
+  source_class->browse = mafw_grilo_source_browse;
+  source_class->cancel_browse = mafw_grilo_source_cancel_browse;
+  source_class->get_metadata = mafw_grilo_source_get_metadata;
+  source_class->get_metadatas = mafw_grilo_source_get_metadatas;
+
+  gobject_class->set_property = set_property;
+  gobject_class->dispose = dispose;
+  gobject_class->finalize = finalize;
+
+  MAFW_EXTENSION_CLASS(klass)->get_extension_property =
+    mafw_grilo_source_get_property;
+  MAFW_EXTENSION_CLASS(klass)->set_extension_property =
+    mafw_grilo_source_set_property;
+
+  g_object_class_install_property (gobject_class, PROP_GRILO_PLUGIN,
+                                   g_param_spec_object ("grl-plugin",
+                                                        "Grilo Plugin",
+                                                        "The Grilo plugin "
+                                                        "object",
+                                                        GRL_TYPE_MEDIA_PLUGIN,
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS |
+                                                        G_PARAM_WRITABLE));
+}
+
+static void
+sanitize (gchar *string)
+{
+  gint i;
+  g_return_if_fail (string);
+
+  i=0;
+  while (string[i]) {
+    switch (string[i]) {
+    case '-':
+    case ':':
+      string[i] = '_';
+    break;
+    }
+    i++;
+  }
+}
+
+static MafwGriloSource *
+mafw_grilo_source_new (GrlMediaPlugin *grl_plugin)
+{
+  gchar *uuid;
+
+  uuid = g_strdup (grl_media_plugin_get_id (grl_plugin));
+  sanitize (uuid);
+
+  return g_object_new (MAFW_TYPE_GRILO_SOURCE,
+                       "plugin", MAFW_GRILO_SOURCE_PLUGIN_NAME,
+                       "uuid", uuid,
+                       "name", grl_media_plugin_get_name (grl_plugin),
+                       "grl-plugin", grl_plugin,
+                       NULL);
+}
+
+static gchar *
+grl_media_serialize (MafwGriloSource *mafw_source, GrlMedia *grl_media,
+                     guint pagination_skip)
+{
+  MafwGriloSourcePrivate *priv = mafw_source->priv;
+
+  /* The uuid does not change, so neither does the start of the ids */
+  if (G_UNLIKELY (!priv->object_id_prefix))
+    {
+      priv->object_id_prefix =
+        mafw_grilo_object_id_new_prefix (mafw_extension_get_uuid (MAFW_EXTENSION (mafw_source)),
+                                         &priv->object_id_prefix_length);
+    }
+
+  return mafw_grilo_object_id_encode (priv->object_id_prefix,
+                                      priv->object_id_prefix_length,
+                                      grl_media, pagination_skip);
+}
+
+static gint
+compare_metadata_keys (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+static gchar *
+get_metadata_keys_signature (const gchar *const *metadata_keys)
+{
+  gchar **sorted_keys;
+  gchar *signature;
+  guint n_keys;
+
+  if (!metadata_keys)
+    {
+      return g_strdup ("");
+    }
+
+  /* The order of the keys does not change the results, so we sort
+     them to get the same signature for the same set */
+  n_keys = g_strv_length ((gchar **) metadata_keys);
+  sorted_keys = g_new (gchar *, n_keys + 1);
+  memcpy (sorted_keys, metadata_keys, sizeof (gchar *) * (n_keys + 1));
+  qsort (sorted_keys, n_keys, sizeof (gchar *), compare_metadata_keys);
+
+  signature = g_strjoinv (",", sorted_keys);
+  g_free (sorted_keys);
+
+  return signature;
+}
+
+static gchar **
+add_metadata_keys (const gchar *const *metadata_keys,
+                   const gchar *const *more_keys)
+{
+  GPtrArray *keys;
+  gint i, j;
+
+  keys = g_ptr_array_new ();
+
+  for (i = 0; metadata_keys && metadata_keys[i]; i++)
+    {
+      g_ptr_array_add (keys, g_strdup (metadata_keys[i]));
+    }
+
+  for (i = 0; more_keys && more_keys[i]; i++)
+    {
+      for (j = 0; metadata_keys && metadata_keys[j]; j++)
+        {
+          if (strcmp (metadata_keys[j], more_keys[i]) == 0 ||
+              strcmp (metadata_keys[j], MAFW_SOURCE_KEY_WILDCARD) == 0)
+            {
+              break;
+            }
+        }
+
+      if (!metadata_keys || !metadata_keys[j])
+        {
+          g_ptr_array_add (keys, g_strdup (more_keys[i]));
+        }
+    }
+
+  g_ptr_array_add (keys, NULL);
+
+  return (gchar **) g_ptr_array_free (keys, FALSE);
+}
+
+static gboolean
+has_metadata_key (const gchar *const *metadata_keys, const gchar *key)
+{
+  gint i;
+
+  for (i = 0; metadata_keys && metadata_keys[i]; i++)
+    {
+      if (strcmp (metadata_keys[i], key) == 0 ||
+          strcmp (metadata_keys[i], MAFW_SOURCE_KEY_WILDCARD) == 0)
+        {
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/* The keys in metadata_keys that are not in client_keys, or NULL if
+   there are none */
+static gchar **
+get_extra_keys (const gchar *const *client_keys,
+                const gchar *const *metadata_keys)
+{
+  GPtrArray *keys;
+  gint i;
+
+  keys = g_ptr_array_new ();
+
+  for (i = 0; metadata_keys && metadata_keys[i]; i++)
+    {
+      /* Every row has its mime, asked for or not */
+      if (!has_metadata_key (client_keys, metadata_keys[i]) &&
+          strcmp (metadata_keys[i], MAFW_METADATA_KEY_MIME) != 0)
+        {
+          g_ptr_array_add (keys, g_strdup (metadata_keys[i]));
+        }
+    }
+
+  if (!keys->len)
+    {
+      g_ptr_array_free (keys, TRUE);
+      return NULL;
+    }
+
+  g_ptr_array_add (keys, NULL);
+
+  return (gchar **) g_ptr_array_free (keys, FALSE);
+}
+
+static gchar *
+get_listing_key (MafwGriloSource *mafw_source, GrlMedia *grl_media,
+                 const gchar *search_text, const gchar *signature)
+{
+  gchar *container_id, *listing_key;
+
+  /* The results of a search are a listing of their own */
+  if (search_text)
+    {
+      container_id = g_strdup_printf ("search:%s", search_text);
+    }
+  else
+    {
+      container_id =
+        grl_media_serialize (mafw_source, grl_media, 0);
+    }
+
+  listing_key = g_strdup_printf ("%s\n%u\n%s", container_id,
+                                 mafw_source->priv->browse_metadata_mode,
+                                 signature);
+
+  g_free (container_id);
+
+  return listing_key;
+}
+
+typedef struct
+{
+  MafwGriloSource *mafw_source;
+  /* Where each listing of the snapshot ends, to tell when it was
+     fetched again */
+  GHashTable *listing_ends;
+} SnapshotLoad;
+
+static void
+load_snapshot_row (const gchar *listing_key, guint position,
+                   const gchar *object_id, GHashTable *metadata,
+                   gpointer user_data)
+{
+  SnapshotLoad *load = user_data;
+  MafwGriloSourcePrivate *priv = load->mafw_source->priv;
+  gpointer end;
+
+  /* The newest rows are the good ones */
+  if (g_hash_table_lookup_extended (load->listing_ends, listing_key, NULL,
+                                    &end) &&
+      position < GPOINTER_TO_UINT (end))
+    {
+      mafw_grilo_listing_cache_remove (priv->listing_cache, listing_key);
+    }
+  g_hash_table_replace (load->listing_ends, g_strdup (listing_key),
+                        GUINT_TO_POINTER (position + 1));
+
+  mafw_grilo_listing_cache_store_row (priv->listing_cache, listing_key,
+                                      position, object_id, metadata);
+  mafw_grilo_media_index_add (priv->media_index, object_id, metadata, NULL);
+}
+
+static void
+load_snapshot_end (const gchar *listing_key, guint position,
+                   gpointer user_data)
+{
+  SnapshotLoad *load = user_data;
+
+  mafw_grilo_listing_cache_store_end (load->mafw_source->priv->listing_cache,
+                                      listing_key, position);
+}
+
+static void
+load_snapshot_object (const gchar *object_id, GHashTable *metadata,
+                      const gchar *const *known_keys, gpointer user_data)
+{
+  SnapshotLoad *load = user_data;
+
+  mafw_grilo_media_index_add (load->mafw_source->priv->media_index,
+                              object_id, metadata, known_keys);
+}
+
+static MafwGriloSnapshot *
+get_snapshot (MafwGriloSource *mafw_source)
+{
+  MafwGriloSourcePrivate *priv = mafw_source->priv;
+  SnapshotLoad load;
+  GHashTableIter iter;
+  gpointer listing_key;
+  gchar *filename, *path;
+
+  if (G_LIKELY (priv->snapshot || !priv->snapshot_enabled ||
+                !plugin.snapshot_dir))
+    {
+      return priv->snapshot;
+    }
+
+  filename = g_strconcat (mafw_extension_get_uuid (MAFW_EXTENSION (mafw_source)),
+                          ".snapshot", NULL);
+  path = g_build_filename (plugin.snapshot_dir, filename, NULL);
+  priv->snapshot =
+    mafw_grilo_snapshot_new (path,
+                             mafw_extension_get_uuid (MAFW_EXTENSION (mafw_source)));
+  g_free (path);
+  g_free (filename);
+
+  load.mafw_source = mafw_source;
+  load.listing_ends = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, NULL);
+  mafw_grilo_snapshot_load (priv->snapshot, load_snapshot_row,
+                            load_snapshot_end, load_snapshot_object, &load);
+
+  /* We give the listings right away, but we check them with the
+     source the first time they are used */
+  g_hash_table_iter_init (&iter, load.listing_ends);
+  while (g_hash_table_iter_next (&iter, &listing_key, NULL))
+    {
+      mafw_grilo_listing_cache_set_stale (priv->listing_cache, listing_key);
+    }
+  g_hash_table_destroy (load.listing_ends);
+
+  return priv->snapshot;
+}
+
+static gboolean
+load_snapshot_cb (gpointer user_data)
+{
+  MafwGriloSource *mafw_source = user_data;
+
+  mafw_source->priv->snapshot_source = 0;
+  get_snapshot (mafw_source);
+
+  return FALSE;
+}
+
+/* Reading the snapshot takes a while, so it is done when the main loop
+   has nothing better to do. The first request loads it itself if it
+   comes earlier. */
+static void
+schedule_snapshot_load (MafwGriloSource *mafw_source)
+{
+  MafwGriloSourcePrivate *priv = mafw_source->priv;
+
+  if (priv->snapshot_enabled && !priv->snapshot && !priv->snapshot_source)
+    {
+      priv->snapshot_source =
+        g_idle_add_full (G_PRIORITY_LOW, load_snapshot_cb, mafw_source, NULL);
+    }
+}
+
+static void
+store_listing_row (MafwGriloSource *mafw_source, const gchar *listing_key,
+                   guint position, const gchar *object_id,
+                   GHashTable *metadata)
+{
+  MafwGriloSnapshot *snapshot;
+
+  mafw_grilo_listing_cache_store_row (mafw_source->priv->listing_cache,
+                                      listing_key, position, object_id,
+                                      metadata);
+
+  snapshot = get_snapshot (mafw_source);
+  if (snapshot)
+    {
+      mafw_grilo_snapshot_add_row (snapshot, listing_key, position,
+                                   object_id, metadata);
+    }
+}
+
+static void
+store_listing_end (MafwGriloSource *mafw_source, const gchar *listing_key,
+                   guint position)
+{
+  MafwGriloSnapshot *snapshot;
+
+  mafw_grilo_listing_cache_store_end (mafw_source->priv->listing_cache,
+                                      listing_key, position);
+
+  snapshot = get_snapshot (mafw_source);
+  if (snapshot)
+    {
+      mafw_grilo_snapshot_add_end (snapshot, listing_key, position);
+    }
+}
+
+static GList *
+translate_mafw_keys (MafwGriloSource *mafw_source,
+                     const gchar *const *metadata_keys)
+{
+  GList *keys = NULL;
+  gint i;
+
+  for (i = 0; metadata_keys[i] != NULL; i++)
+    {
+      gpointer grl_key;
+
+      if (strcmp (metadata_keys[i], MAFW_SOURCE_KEY_WILDCARD) == 0)
+        {
+          g_list_free (keys);
+
+          return g_list_copy (mafw_source->priv->supported_keys);
+        }
+
+      if (G_UNLIKELY (!keys))
+        {
+          keys = grl_metadata_key_list_new (GRL_METADATA_KEY_ID, NULL);
+        }
+
+      grl_key = g_hash_table_lookup (mafw_to_grl_keys, metadata_keys[i]);
+
+      if (!grl_key)
+        {
+          g_message ("MAFW key %s cannot be mapped to Grilo", metadata_keys[i]);
+        }
+      else if (!g_list_find (keys, grl_key))
+        {
+          keys = g_list_prepend (keys, grl_key);
+        }
+    }
+
+  return keys;
+}
+
+/* Returns a copy of the grilo keys for a set of MAFW keys, to be freed
+   with g_list_free(). Clients usually ask for the same few key sets,
+   so the most recently used translations are kept. */
+static GList *
+mafw_keys_to_grl_keys (MafwGriloSource *mafw_source,
+                       const gchar *const *metadata_keys,
+                       const gchar *signature)
+{
+  MafwGriloSourcePrivate *priv = mafw_source->priv;
+  GrlKeysEntry *entry;
+  GList *link;
+
+  g_return_val_if_fail (metadata_keys != NULL, NULL);
+
+  link = g_hash_table_lookup (priv->grl_keys_cache, signature);
+  if (link)
+    {
+      entry = link->data;
+      g_queue_unlink (&priv->grl_keys_lru, link);
+      g_queue_push_tail_link (&priv->grl_keys_lru, link);
+    }
+  else
+    {
+      entry = g_slice_new (GrlKeysEntry);
+      entry->signature = g_strdup (signature);
+      entry->grl_keys = translate_mafw_keys (mafw_source, metadata_keys);
+      g_queue_push_tail (&priv->grl_keys_lru, entry);
+      g_hash_table_insert (priv->grl_keys_cache, entry->signature,
+                           g_queue_peek_tail_link (&priv->grl_keys_lru));
+
+      if (g_queue_get_length (&priv->grl_keys_lru) > GRL_KEYS_CACHE_SIZE)
+        {
+          GrlKeysEntry *oldest = g_queue_pop_head (&priv->grl_keys_lru);
+
+          g_hash_table_remove (priv->grl_keys_cache, oldest->signature);
+          free_grl_keys_entry (oldest, NULL);
+        }
+    }
+
+  return g_list_copy (entry->grl_keys);
+}
+
+/* Asking for slow keys is what makes operations slow. When the source
+   gives every key we want quickly there is no need to ask for more
+   than the fast ones, whatever the configured mode. */
+static GrlMetadataResolutionFlags
+get_resolution_flags (MafwGriloSource *mafw_source, const GList *grl_keys,
+                      GrlMetadataResolutionFlags flags)
+{
+  const GList *key;
+
+  if (flags == GRL_RESOLVE_FAST_ONLY)
+    {
+      return flags;
+    }
+
+  for (key = grl_keys; key; key = g_list_next (key))
+    {
+      if (POINTER_TO_GRLKEYID (key->data) != GRL_METADATA_KEY_ID &&
+          g_hash_table_lookup (mafw_source->priv->keys_profile, key->data) !=
+          KEY_FAST)
+        {
+          return flags;
+        }
+    }
+
+  return GRL_RESOLVE_FAST_ONLY;
+}
+
+/* Only the keys asked for are translated: sources often give more
+   than that, and clients would pay for every one of them in every
+   row */
+static GHashTable *
+mafw_keys_from_grl_media (MafwGriloSource *mafw_source, GrlMedia *grl_media,
+                          const gchar *object_id, const GList *grl_keys)
+{
+  GHashTable *mafw_metadata_keys;
+  const GList *current;
+
+  mafw_metadata_keys = mafw_metadata_new ();
+
+  for (current = grl_keys; current; current = g_list_next (current))
+    {
+      const gchar *mafw_key;
+      const GValue *value;
+
+      mafw_key = g_hash_table_lookup (grl_to_mafw_keys, current->data);
+
+      if (!mafw_key)
+        {
+          continue;
+        }
+
+      value = grl_data_get (GRL_DATA (grl_media),
+                            POINTER_TO_GRLKEYID (current->data));
+
+      if (!value ||
+          (G_VALUE_HOLDS_STRING (value) && !g_value_get_string (value)))
+        {
+          continue;
+        }
+
+      /* Clients get our small copy of the thumbnail once we have it */
+      if (mafw_source->priv->thumbnailer &&
+          POINTER_TO_GRLKEYID (current->data) == GRL_METADATA_KEY_THUMBNAIL &&
+          G_VALUE_HOLDS_STRING (value))
+        {
+          const gchar *local_uri;
+          gboolean pending;
+
+          local_uri =
+            mafw_grilo_thumbnailer_lookup (mafw_source->priv->thumbnailer,
+                                           g_value_get_string (value),
+                                           &pending);
+          if (local_uri)
+            {
+              mafw_metadata_add_str (mafw_metadata_keys, (gchar *) mafw_key,
+                                     local_uri);
+              continue;
+            }
+          /* Meanwhile they get the original one */
+          if (pending)
+            {
+              wait_for_thumbnail (mafw_source, g_value_get_string (value),
+                                  object_id);
+            }
+        }
+
+      mafw_metadata_add_val (mafw_metadata_keys, (gchar *) mafw_key,
+                             (GValue *) value);
+    }
+
+  /* We set this independently of it coming in the data or not,
+     because in some sources, it can be a slow key and it does not
+     come even if we had requested it. */
+  if (GRL_IS_MEDIA_BOX (grl_media))
+    {
+      mafw_metadata_add_str (mafw_metadata_keys, MAFW_METADATA_KEY_MIME,
+                             MAFW_METADATA_VALUE_MIME_CONTAINER);
+    }
+  else
+    {
+      const gchar *mime;
+
+      mime = grl_media_get_mime (grl_media);
+
+      if (mime)
+        {
+          mafw_metadata_add_str (mafw_metadata_keys, MAFW_METADATA_KEY_MIME,
+                                 mime);
+        }
+      else
+        {
+          mafw_metadata_add_str (mafw_metadata_keys, MAFW_METADATA_KEY_MIME,
+                                             get_default_mime (mafw_source));
+        }
+    }
+
+  return mafw_metadata_keys;
+}
+
+/* Records what we got for an object in the index. The mime we made up
+   in mafw_keys_from_grl_media() is not taken as known, so that it is
+   asked for again. */
+static void
+index_grl_media (MafwGriloSource *mafw_source, const gchar *object_id,
+                 GrlMedia *grl_media, GHashTable *mafw_metadata_keys,
+                 const gchar *const *known_keys)
+{
+  MafwGriloSourcePrivate *priv = mafw_source->priv;
+
+  mafw_grilo_media_index_add (priv->media_index, object_id,
+                              mafw_metadata_keys, known_keys);
+  if (!GRL_IS_MEDIA_BOX (grl_media) && !grl_media_get_mime (grl_media))
+    {
+      mafw_grilo_media_index_set_guessed (priv->media_index, object_id,
+                                          MAFW_METADATA_KEY_MIME);
+    }
+}
+
+/* Every "More results..." row carries the same metadata, so they all
+   share one table */
+static GHashTable *
+get_next_row_metadata_keys (void)
+{
+  if (G_UNLIKELY (!next_row_metadata_keys))
+    {
+      next_row_metadata_keys = mafw_metadata_new ();
+
+      mafw_metadata_add_str (next_row_metadata_keys, MAFW_METADATA_KEY_TITLE,
+                             "More results...");
+      mafw_metadata_add_str (next_row_metadata_keys, MAFW_METADATA_KEY_MIME,
+                             MAFW_METADATA_VALUE_MIME_CONTAINER);
+    }
+
+  return g_hash_table_ref (next_row_metadata_keys);
+}
+
+static void fetch_browse_page (BrowseCbInfo *browse_cb_info);
+static gboolean start_browse (gpointer user_data);
+static gboolean finish_cancelled_browse (gpointer user_data);
+static void run_browse_page (gpointer user_data);
+
+static gboolean
+flush_browse_rows (gpointer user_data)
+{
+  BrowseCbInfo *browse_cb_info = user_data;
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  guint flushed = 0;
+
+  /* We deliver rows in chunks to avoid one main loop iteration per
+     row, but we do not keep the loop busy for too long so that the UI
+     stays responsive */
+  g_timer_start (priv->batch_timer);
+
+  while (!g_queue_is_empty (&browse_cb_info->batch) &&
+         flushed < priv->browse_batch_size &&
+         (!flushed ||
+          g_timer_elapsed (priv->batch_timer, NULL) * 1000 <
+          priv->browse_batch_time))
+    {
+      BrowseRow *row = g_queue_pop_head_link (&browse_cb_info->batch)->data;
+
+      if (browse_cb_info->slow_keys_resolver && row->object_id &&
+          !row->error && !row->next_page)
+        {
+          queue_slow_keys (browse_cb_info->slow_keys_resolver,
+                           row->object_id);
+        }
+
+      if (row->object_id && !row->next_page)
+        {
+          if (!browse_cb_info->first_item_delivered)
+            {
+              browse_cb_info->first_item_delivered = TRUE;
+              mafw_grilo_stats_add_time (priv->stats,
+                                         MAFW_GRILO_STATS_BROWSE_FIRST_ITEM_TIME,
+                                         g_timer_elapsed (browse_cb_info->
+                                                          browse_timer, NULL));
+            }
+          mafw_grilo_stats_add (priv->stats, MAFW_GRILO_STATS_BROWSE_ITEMS, 1);
+        }
+      if (row->error)
+        {
+          browse_cb_info->failed = TRUE;
+        }
+
+      browse_cb_info->mafw_browse_cb (MAFW_SOURCE (browse_cb_info->
+                                                   mafw_grilo_source),
+                                      browse_cb_info->mafw_browse_id,
+                                      row->remaining, row->index,
+                                      row->object_id, row->metadata,
+                                      browse_cb_info->mafw_user_data,
+                                      row->error);
+
+      free_browse_row (browse_cb_info, row);
+      flushed++;
+    }
+
+  if (!g_queue_is_empty (&browse_cb_info->batch))
+    {
+      return TRUE;
+    }
+
+  browse_cb_info->flush_source = 0;
+
+  if (browse_cb_info->finished)
+    {
+      /* we don't free the info, we just remove it from the hash table
+         and it will free it for us */
+      g_hash_table_remove (browse_cb_info->mafw_grilo_source->priv->
+                           browse_requests,
+                           &(browse_cb_info->mafw_browse_id));
+    }
+
+  return FALSE;
+}
+
+/* The metadata the client gets, without the keys we only wanted for
+   ourselves. The index and the listing cache keep all of them, so the
+   table is copied rather than changed. */
+static GHashTable *
+strip_extra_keys (BrowseCbInfo *browse_cb_info, GHashTable *metadata)
+{
+  GHashTable *stripped;
+  GHashTableIter iter;
+  gpointer key, value;
+  gint i;
+
+  for (i = 0; browse_cb_info->extra_keys && browse_cb_info->extra_keys[i];
+       i++)
+    {
+      if (g_hash_table_lookup (metadata, browse_cb_info->extra_keys[i]))
+        {
+          break;
+        }
+    }
+
+  if (!browse_cb_info->extra_keys || !browse_cb_info->extra_keys[i])
+    {
+      return g_hash_table_ref (metadata);
+    }
+
+  stripped = mafw_metadata_new ();
+  g_hash_table_iter_init (&iter, metadata);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (!has_metadata_key ((const gchar *const *) browse_cb_info->
+                             extra_keys, key))
+        {
+          mafw_grilo_metadata_add_value (stripped, key, value);
+        }
+    }
+
+  return stripped;
+}
+
+/* The row takes the object id */
+static BrowseRow *
+emit_browse_row (BrowseCbInfo *browse_cb_info, gchar *object_id,
+                 GHashTable *metadata, guint remaining, const GError *error)
+{
+  BrowseRow *row;
+
+  row = new_browse_row (browse_cb_info);
+  row->object_id = object_id;
+  row->metadata = metadata ? g_hash_table_ref (metadata) : NULL;
+  row->remaining = remaining;
+  row->index = browse_cb_info->skip_count + browse_cb_info->total_items;
+  row->error = error ? g_error_copy (error) : NULL;
+  row->next_page = FALSE;
+
+  g_queue_push_tail_link (&browse_cb_info->batch, &row->link);
+
+  if (!browse_cb_info->flush_source)
+    {
+      browse_cb_info->flush_source =
+        g_idle_add (flush_browse_rows, browse_cb_info);
+    }
+
+  if (object_id)
+    {
+      browse_cb_info->total_items++;
+    }
+
+  return row;
+}
+
+static void
+drop_browse_rows (BrowseCbInfo *browse_cb_info)
+{
+  gboolean delivered;
+
+  /* The client does not want the rows we did not deliver yet. If the
+     end of the browse was among them we still have to report it. */
+  delivered = g_queue_is_empty (&browse_cb_info->batch);
+
+  clear_browse_rows (browse_cb_info);
+
+  if (browse_cb_info->finished && !delivered)
+    {
+      emit_browse_row (browse_cb_info, NULL, NULL, 0, NULL);
+    }
+}
+
+static void
+flush_pending_row (BrowseCbInfo *browse_cb_info, guint remaining,
+                   const GError *error)
+{
+  gchar *object_id = browse_cb_info->pending_object_id;
+  GHashTable *metadata = browse_cb_info->pending_metadata;
+  GHashTable *client_metadata;
+
+  browse_cb_info->pending_object_id = NULL;
+  browse_cb_info->pending_metadata = NULL;
+
+  client_metadata = metadata ? strip_extra_keys (browse_cb_info, metadata) :
+    NULL;
+  emit_browse_row (browse_cb_info, object_id, client_metadata, remaining,
+                   error);
+
+  if (metadata)
+    {
+      g_hash_table_unref (client_metadata);
+      g_hash_table_unref (metadata);
+    }
+}
+
+static void
+add_browse_row (BrowseCbInfo *browse_cb_info, gchar *object_id,
+                GHashTable *metadata)
+{
+  guint remaining;
+
+  if (browse_cb_info->match_window)
+    {
+      gboolean in_window = FALSE;
+
+      if (mafw_grilo_filter_matches (browse_cb_info->filter, metadata))
+        {
+          in_window = browse_cb_info->matched >= browse_cb_info->filter_skip;
+          browse_cb_info->matched++;
+        }
+
+      /* Rows not matching, or before the window, are just skipped */
+      if (!in_window)
+        {
+          g_free (object_id);
+          if (metadata)
+            {
+              g_hash_table_unref (metadata);
+            }
+          browse_cb_info->position++;
+          return;
+        }
+
+      remaining = browse_cb_info->filter_end - browse_cb_info->matched + 1;
+    }
+  else if (!browse_cb_info->sorter)
+    {
+      remaining = MIN (browse_cb_info->end, browse_cb_info->known_end) -
+        browse_cb_info->position;
+    }
+
+  /* Sorted rows wait until we have seen the whole container */
+  if (browse_cb_info->sorter)
+    {
+      mafw_grilo_sorter_add (browse_cb_info->sorter, object_id, metadata);
+      browse_cb_info->position++;
+      return;
+    }
+
+  /* The row we were holding back is not the last one, so it can go
+     now. We tell as remaining what is left of the window */
+  if (browse_cb_info->pending_object_id)
+    {
+      flush_pending_row (browse_cb_info, remaining, NULL);
+    }
+
+  browse_cb_info->pending_object_id = object_id;
+  browse_cb_info->pending_metadata = metadata;
+  browse_cb_info->position++;
+
+  /* Once the window is full there is no need to look further */
+  if (browse_cb_info->match_window &&
+      browse_cb_info->matched >= browse_cb_info->filter_end)
+    {
+      browse_cb_info->end = browse_cb_info->position;
+    }
+}
+
+static void
+add_next_page_row (BrowseCbInfo *browse_cb_info)
+{
+  gchar *object_id;
+  GHashTable *mafw_metadata_keys;
+  BrowseRow *row;
+
+  object_id =
+    grl_media_serialize (browse_cb_info->mafw_grilo_source,
+                         browse_cb_info->grl_media, browse_cb_info->end);
+
+  mafw_metadata_keys = get_next_row_metadata_keys ();
+
+  row = emit_browse_row (browse_cb_info, object_id, mafw_metadata_keys, 0,
+                         NULL);
+  row->next_page = TRUE;
+
+  g_hash_table_unref (mafw_metadata_keys);
+}
+
+static void
+free_prefetch (Prefetch *prefetch)
+{
+  MafwGriloSourcePrivate *priv = prefetch->mafw_grilo_source->priv;
+  GList *waiters, *waiter;
+
+  g_hash_table_remove (priv->prefetches, prefetch->listing_key);
+
+  /* A refresh we did not finish leaves the stale rows in place */
+  if (prefetch->stale)
+    {
+      mafw_grilo_listing_cache_finish_refresh (priv->listing_cache,
+                                               prefetch->listing_key, FALSE);
+    }
+
+  if (prefetch->timeout_source)
+    {
+      g_source_remove (prefetch->timeout_source);
+    }
+  if (prefetch->parent)
+    {
+      prefetch->parent->prefetch_started = NULL;
+    }
+
+  /* The browses waiting for the page take it from the listing cache,
+     or ask for what is missing themselves */
+  waiters = prefetch->waiters;
+  prefetch->waiters = NULL;
+  for (waiter = waiters; waiter; waiter = g_list_next (waiter))
+    {
+      BrowseCbInfo *browse_cb_info = waiter->data;
+
+      browse_cb_info->prefetch = NULL;
+      fetch_browse_page (browse_cb_info);
+    }
+  g_list_free (waiters);
+
+  if (prefetch->grl_media)
+    {
+      g_object_unref (prefetch->grl_media);
+    }
+  if (prefetch->stale)
+    {
+      mafw_grilo_listing_unref (prefetch->stale);
+    }
+  g_list_free (prefetch->grl_keys);
+  g_free (prefetch->search_text);
+  g_free (prefetch->listing_key);
+  g_object_unref (prefetch->mafw_grilo_source);
+  g_free (prefetch);
+}
+
+static void
+cancel_prefetch (Prefetch *prefetch)
+{
+  MafwGriloSourcePrivate *priv = prefetch->mafw_grilo_source->priv;
+
+  if (prefetch->job_id)
+    {
+      mafw_grilo_scheduler_remove (priv->scheduler, prefetch->job_id);
+      free_prefetch (prefetch);
+    }
+  else if (prefetch->grl_browse_id)
+    {
+      /* It is freed when grilo reports the end */
+      grl_media_source_cancel (GRL_MEDIA_SOURCE (priv->grl_source),
+                               prefetch->grl_browse_id);
+    }
+}
+
+static gboolean
+expire_prefetch (gpointer user_data)
+{
+  Prefetch *prefetch = user_data;
+
+  prefetch->timeout_source = 0;
+
+  /* Nobody came for it yet, so it is not worth waiting more */
+  if (!prefetch->waiters)
+    {
+      g_debug ("Prefetch of %u items from %u expired", prefetch->count,
+               prefetch->skip);
+      cancel_prefetch (prefetch);
+    }
+
+  return FALSE;
+}
+
+static void
+grl_prefetch_cb (GrlMediaSource *grl_source,
+                 guint grl_browse_id,
+                 GrlMedia *grl_media,
+                 guint remaining,
+                 gpointer user_data,
+                 const GError *error)
+{
+  Prefetch *prefetch = user_data;
+  MafwGriloSourcePrivate *priv = prefetch->mafw_grilo_source->priv;
+
+  if (!remaining || error)
+    {
+      prefetch->grl_browse_id = 0;
+      prefetch->done = TRUE;
+      if (prefetch->running)
+        {
+          prefetch->running = FALSE;
+          mafw_grilo_scheduler_done (priv->scheduler);
+        }
+    }
+
+  if (grl_media)
+    {
+      gchar *mafw_object_id;
+      GHashTable *mafw_metadata_keys;
+
+      mafw_object_id =
+        grl_media_serialize (prefetch->mafw_grilo_source, grl_media, 0);
+      mafw_metadata_keys = mafw_keys_from_grl_media (prefetch->
+                                                     mafw_grilo_source,
+                                                     grl_media,
+                                                     mafw_object_id,
+                                                     prefetch->grl_keys);
+      if (prefetch->stale && !prefetch->changed)
+        {
+          const gchar *stale_object_id;
+
+          stale_object_id =
+            mafw_grilo_listing_get_row (prefetch->stale,
+                                        prefetch->skip + prefetch->received,
+                                        NULL);
+          prefetch->changed = !stale_object_id ||
+            strcmp (stale_object_id, mafw_object_id) != 0;
+        }
+
+      store_listing_row (prefetch->mafw_grilo_source, prefetch->listing_key,
+                         prefetch->skip + prefetch->received++,
+                         mafw_object_id, mafw_metadata_keys);
+
+      g_free (mafw_object_id);
+      g_hash_table_unref (mafw_metadata_keys);
+    }
+
+  if (remaining && !error)
+    {
+      return;
+    }
+
+  if (!error && prefetch->received < prefetch->count)
+    {
+      store_listing_end (prefetch->mafw_grilo_source, prefetch->listing_key,
+                         prefetch->skip + prefetch->received);
+
+      /* The container got shorter */
+      if (prefetch->stale &&
+          mafw_grilo_listing_get_available (prefetch->stale,
+                                            prefetch->skip +
+                                            prefetch->received))
+        {
+          prefetch->changed = TRUE;
+        }
+    }
+
+  /* The fresh rows replace the stale ones before anybody is told */
+  if (prefetch->stale)
+    {
+      mafw_grilo_listing_cache_finish_refresh (priv->listing_cache,
+                                               prefetch->listing_key,
+                                               !error);
+    }
+
+  /* Searches have no container to tell about */
+  if (!error && prefetch->changed && !prefetch->search_text)
+    {
+      gchar *mafw_object_id;
+
+      mafw_object_id = grl_media_serialize (prefetch->mafw_grilo_source,
+                                            prefetch->grl_media, 0);
+      g_debug ("%s changed since the snapshot", mafw_object_id);
+      g_signal_emit_by_name (prefetch->mafw_grilo_source,
+                             "container-changed", mafw_object_id);
+      g_free (mafw_object_id);
+    }
+
+  free_prefetch (prefetch);
+}
+
+static void
+run_prefetch (gpointer user_data)
+{
+  Prefetch *prefetch = user_data;
+  MafwGriloSourcePrivate *priv = prefetch->mafw_grilo_source->priv;
+  GrlMetadataResolutionFlags flags;
+  guint grl_browse_id;
+
+  prefetch->job_id = 0;
+  prefetch->running = TRUE;
+  flags = get_resolution_flags (prefetch->mafw_grilo_source,
+                                prefetch->grl_keys,
+                                priv->browse_metadata_mode);
+
+  if (prefetch->stale)
+    {
+      /* The stale rows are still given until the fresh ones are
+         all here */
+      if (mafw_grilo_listing_cache_lookup (priv->listing_cache,
+                                           prefetch->listing_key) ==
+          prefetch->stale)
+        {
+          mafw_grilo_listing_cache_start_refresh (priv->listing_cache,
+                                                  prefetch->listing_key);
+        }
+      g_debug ("Refreshing %u items from %u", prefetch->count,
+               prefetch->skip);
+    }
+  else
+    {
+      g_debug ("Prefetching %u items from %u", prefetch->count,
+               prefetch->skip);
+    }
+
+  if (prefetch->search_text)
+    {
+      grl_browse_id =
+        grl_media_source_search (GRL_MEDIA_SOURCE (priv->grl_source),
+                                 prefetch->search_text,
+                                 prefetch->grl_keys,
+                                 prefetch->skip, prefetch->count,
+                                 flags, grl_prefetch_cb, prefetch);
+    }
+  else
+    {
+      grl_browse_id =
+        grl_media_source_browse (GRL_MEDIA_SOURCE (priv->grl_source),
+                                 prefetch->grl_media,
+                                 prefetch->grl_keys,
+                                 prefetch->skip, prefetch->count,
+                                 flags, grl_prefetch_cb, prefetch);
+    }
+
+  if (!prefetch->done)
+    {
+      prefetch->grl_browse_id = grl_browse_id;
+    }
+}
+
+static void
+start_prefetch (BrowseCbInfo *browse_cb_info)
+{
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  MafwGriloListing *listing;
+  Prefetch *prefetch;
+  guint skip, available = 0;
+
+  /* Prefetched rows live in the listing cache, and expire with it */
+  if (!priv->prefetch_size ||
+      !mafw_grilo_listing_cache_get_ttl (priv->listing_cache) ||
+      !mafw_grilo_listing_cache_get_max_entries (priv->listing_cache) ||
+      g_hash_table_size (priv->prefetches) >= MAX_PREFETCHES ||
+      g_hash_table_lookup (priv->prefetches, browse_cb_info->listing_key))
+    {
+      return;
+    }
+
+  /* The page after "More results..." starts at the end of this one,
+     but we might have some of it already */
+  skip = browse_cb_info->end;
+  listing = mafw_grilo_listing_cache_lookup (priv->listing_cache,
+                                             browse_cb_info->listing_key);
+  if (listing)
+    {
+      available = mafw_grilo_listing_get_available (listing, skip);
+      if (mafw_grilo_listing_is_end (listing, skip + available) ||
+          available >= priv->prefetch_size)
+        {
+          return;
+        }
+    }
+
+  prefetch = g_new0 (Prefetch, 1);
+  prefetch->mafw_grilo_source =
+    g_object_ref (browse_cb_info->mafw_grilo_source);
+  prefetch->listing_key = g_strdup (browse_cb_info->listing_key);
+  prefetch->grl_media = browse_cb_info->grl_media ?
+    g_object_ref (browse_cb_info->grl_media) : NULL;
+  prefetch->search_text = g_strdup (browse_cb_info->search_text);
+  prefetch->grl_keys = g_list_copy (browse_cb_info->grl_keys);
+  prefetch->skip = skip + available;
+  prefetch->count = priv->prefetch_size - available;
+  prefetch->parent = browse_cb_info;
+  browse_cb_info->prefetch_started = prefetch;
+
+  g_hash_table_insert (priv->prefetches, prefetch->listing_key, prefetch);
+
+  prefetch->job_id =
+    mafw_grilo_scheduler_push (priv->scheduler,
+                               MAFW_GRILO_SCHEDULER_PRIORITY_PREFETCH,
+                               browse_cb_info->mafw_browse_cb,
+                               browse_cb_info->mafw_user_data,
+                               run_prefetch, prefetch);
+  prefetch->timeout_source =
+    g_timeout_add_seconds (PREFETCH_TIMEOUT, expire_prefetch, prefetch);
+}
+
+static void
+start_refresh (BrowseCbInfo *browse_cb_info, MafwGriloListing *listing)
+{
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  Prefetch *prefetch;
+  guint base;
+
+  /* Whatever is being fetched for the listing is fresh already */
+  if (g_hash_table_lookup (priv->prefetches, browse_cb_info->listing_key))
+    {
+      return;
+    }
+
+  base = mafw_grilo_listing_get_base (listing);
+
+  prefetch = g_new0 (Prefetch, 1);
+  prefetch->mafw_grilo_source =
+    g_object_ref (browse_cb_info->mafw_grilo_source);
+  prefetch->listing_key = g_strdup (browse_cb_info->listing_key);
+  prefetch->grl_media = browse_cb_info->grl_media ?
+    g_object_ref (browse_cb_info->grl_media) : NULL;
+  prefetch->search_text = g_strdup (browse_cb_info->search_text);
+  prefetch->grl_keys = g_list_copy (browse_cb_info->grl_keys);
+  prefetch->skip = base;
+  prefetch->count =
+    CLAMP (mafw_grilo_listing_get_available (listing, base),
+           BROWSE_PAGE_SIZE, MAX_COUNT);
+  prefetch->stale = mafw_grilo_listing_ref (listing);
+
+  g_hash_table_insert (priv->prefetches, prefetch->listing_key, prefetch);
+
+  /* Nobody waits for it, so it does not expire */
+  prefetch->job_id =
+    mafw_grilo_scheduler_push (priv->scheduler,
+                               MAFW_GRILO_SCHEDULER_PRIORITY_PREFETCH,
+                               browse_cb_info->mafw_browse_cb,
+                               browse_cb_info->mafw_user_data,
+                               run_prefetch, prefetch);
+}
+
+static void
+finish_sorted_browse (BrowseCbInfo *browse_cb_info)
+{
+  gboolean more_pages;
+  guint n_rows, i;
+
+  n_rows = mafw_grilo_sorter_sort (browse_cb_info->sorter);
+  more_pages = browse_cb_info->item_count == 0 &&
+    mafw_grilo_sorter_get_seen (browse_cb_info->sorter) >
+    browse_cb_info->sort_end;
+
+  browse_cb_info->finished = TRUE;
+
+  for (i = browse_cb_info->sort_skip; i < n_rows; i++)
+    {
+      const gchar *object_id;
+      GHashTable *metadata, *client_metadata = NULL;
+
+      object_id = mafw_grilo_sorter_get_row (browse_cb_info->sorter, i,
+                                             &metadata);
+      if (metadata)
         {
-        case GRL_RESOLVE_FAST_ONLY:
-          g_value_set_uint (value, MAFW_GRILO_SOURCE_METADATA_MODE_FAST);
-          break;
-        case GRL_RESOLVE_NORMAL:
-          g_value_set_uint (value, MAFW_GRILO_SOURCE_METADATA_MODE_NORMAL);
-          break;
-        case GRL_RESOLVE_FULL:
-          g_value_set_uint (value, MAFW_GRILO_SOURCE_METADATA_MODE_FULL);
-          break;
-        default:
-          g_assert_not_reached ();
+          client_metadata = strip_extra_keys (browse_cb_info, metadata);
+          g_hash_table_unref (metadata);
+        }
+      emit_browse_row (browse_cb_info, g_strdup (object_id), client_metadata,
+                       n_rows - i - 1 + (more_pages ? 1 : 0), NULL);
+      if (client_metadata)
+        {
+          g_hash_table_unref (client_metadata);
         }
     }
-  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE) == 0)
+
+  if (more_pages)
     {
-      value = g_new0 (GValue, 1);
-      g_value_init (value, G_TYPE_UINT);
-      switch (source->priv->resolve_metadata_mode)
+      /* The pagination of sorted browses is a position in the sorted
+         rows */
+      browse_cb_info->end = browse_cb_info->sort_end;
+      add_next_page_row (browse_cb_info);
+    }
+  else if (browse_cb_info->sort_skip >= n_rows)
+    {
+      emit_browse_row (browse_cb_info, NULL, NULL, 0, NULL);
+    }
+}
+
+static void
+finish_timed_out_browse (BrowseCbInfo *browse_cb_info)
+{
+  GError *error = NULL;
+
+  browse_cb_info->finished = TRUE;
+
+  /* Sorted rows are not known to be the first ones until the whole
+     container is seen, and the walks of a recursive browse have no
+     position to go on from, so those browses just fail */
+  if (browse_cb_info->sorter || browse_cb_info->recursive)
+    {
+      g_set_error (&error, MAFW_GRILO_SOURCE_ERROR,
+                   MAFW_GRILO_SOURCE_ERROR_TIMED_OUT, "Browse timed out");
+      if (browse_cb_info->pending_object_id)
         {
-        case GRL_RESOLVE_FAST_ONLY:
-          g_value_set_uint (value,
-                            MAFW_GRILO_SOURCE_METADATA_MODE_FAST);
-          break;
-        case GRL_RESOLVE_NORMAL:
-          g_value_set_uint (value,
-                            MAFW_GRILO_SOURCE_METADATA_MODE_NORMAL);
-          break;
-        case GRL_RESOLVE_FULL:
-          g_value_set_uint (value,
-                            MAFW_GRILO_SOURCE_METADATA_MODE_FULL);
-          break;
-        default:
-          g_assert_not_reached ();
+          flush_pending_row (browse_cb_info, 0, error);
+        }
+      else
+        {
+          emit_browse_row (browse_cb_info, NULL, NULL, 0, error);
         }
+      g_error_free (error);
+      return;
     }
-  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE) == 0)
+
+  /* The rest is behind a "More results..." row, which goes on from
+     the first row we did not deliver */
+  if (browse_cb_info->pending_object_id)
     {
-      value = g_new0 (GValue, 1);
-      g_value_init (value, G_TYPE_STRING);
-      g_value_set_string (value, source->priv->default_mime);
+      flush_pending_row (browse_cb_info, 1, NULL);
     }
-  else
+  browse_cb_info->end = browse_cb_info->position;
+  add_next_page_row (browse_cb_info);
+}
+
+static void
+finish_browse (BrowseCbInfo *browse_cb_info, const GError *error)
+{
+  gboolean more_pages;
+
+  /* Whatever stopped the operations, it was us */
+  if (browse_cb_info->timed_out)
     {
-      /* Unsupported property */
-      error = g_error_new(MAFW_GRILO_SOURCE_ERROR,
-                          MAFW_EXTENSION_ERROR_GET_PROPERTY,
-                          "Unsupported property");
+      finish_timed_out_browse (browse_cb_info);
+      return;
     }
 
-  callback (self, key, value, user_data, error);
+  if (browse_cb_info->sorter && !browse_cb_info->cancelled && !error)
+    {
+      finish_sorted_browse (browse_cb_info);
+      return;
+    }
+
+  /* When the client did not set an item_count we deliver MAX_COUNT
+     items at most and then we add a row to get the next ones */
+  more_pages = !error && !browse_cb_info->cancelled &&
+    browse_cb_info->item_count == 0 &&
+    browse_cb_info->position >= browse_cb_info->end &&
+    browse_cb_info->known_end > browse_cb_info->end;
+
+  browse_cb_info->finished = TRUE;
+
+  if (browse_cb_info->cancelled)
+    {
+      GError *cancel_error = NULL;
+
+      g_free (browse_cb_info->pending_object_id);
+      browse_cb_info->pending_object_id = NULL;
+      if (browse_cb_info->pending_metadata)
+        {
+          g_hash_table_unref (browse_cb_info->pending_metadata);
+          browse_cb_info->pending_metadata = NULL;
+        }
+      /* The client did not cancel it itself, so it has to know why
+         there is nothing else */
+      if (browse_cb_info->superseded)
+        {
+          g_set_error (&cancel_error, MAFW_GRILO_SOURCE_ERROR,
+                       MAFW_GRILO_SOURCE_ERROR_CANCELLED,
+                       "Search superseded by a newer one");
+        }
+      emit_browse_row (browse_cb_info, NULL, NULL, 0, cancel_error);
+      if (cancel_error)
+        {
+          g_error_free (cancel_error);
+        }
+    }
+  else if (browse_cb_info->pending_object_id)
+    {
+      flush_pending_row (browse_cb_info, more_pages ? 1 : 0, error);
+    }
+  else if (!more_pages)
+    {
+      emit_browse_row (browse_cb_info, NULL, NULL, 0, error);
+    }
+
+  if (more_pages)
+    {
+      add_next_page_row (browse_cb_info);
+
+      /* Chances are the client will ask for the next page */
+      start_prefetch (browse_cb_info);
+    }
+
+  /* The info is released once the last row is delivered */
 }
 
 static void
-mafw_grilo_source_set_property (MafwExtension *self,
-                                const gchar *key,
-                                const GValue *value)
+grl_browse_cb (GrlMediaSource *grl_source,
+               guint grl_browse_id,
+               GrlMedia *grl_media,
+               guint remaining,
+               gpointer user_data,
+               const GError *error)
 {
-  MafwGriloSource *source = MAFW_GRILO_SOURCE (self);
+  BrowsePage *page = user_data;
+  BrowseCbInfo *browse_cb_info = page->browse_cb_info;
+  MafwGriloSourcePrivate *priv;
 
-  g_return_if_fail (MAFW_IS_GRILO_SOURCE (self));
-  g_return_if_fail (key != NULL);
+  if (!remaining || error)
+    {
+      if (browse_cb_info && browse_cb_info->page == page)
+        {
+          browse_cb_info->page = NULL;
+        }
+      g_slice_free (BrowsePage, page);
+    }
 
-  if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_BROWSE_METADATA_MODE) == 0)
+  if (!browse_cb_info)
     {
-      switch (g_value_get_uint (value))
+      /* The page was replaced, whatever it brings is not ours */
+      return;
+    }
+
+  priv = browse_cb_info->mafw_grilo_source->priv;
+
+  if (grl_media && browse_cb_info->first_row_time < 0)
+    {
+      browse_cb_info->first_row_time =
+        g_timer_elapsed (browse_cb_info->page_timer, NULL);
+    }
+
+  if (!remaining || error)
+    {
+      browse_cb_info->grl_browse_id = 0;
+      browse_cb_info->page_done = TRUE;
+      if (browse_cb_info->page_running)
         {
-        case MAFW_GRILO_SOURCE_METADATA_MODE_FAST:
-          source->priv->browse_metadata_mode = GRL_RESOLVE_FAST_ONLY;
-          break;
-        case MAFW_GRILO_SOURCE_METADATA_MODE_NORMAL:
-          source->priv->browse_metadata_mode = GRL_RESOLVE_NORMAL;
-          break;
-        case MAFW_GRILO_SOURCE_METADATA_MODE_FULL:
-          source->priv->browse_metadata_mode = GRL_RESOLVE_FULL;
-          break;
-        default:
-          g_warning ("Wrong metadata mode: %d", g_value_get_uint (value));
+          browse_cb_info->page_running = FALSE;
+          mafw_grilo_scheduler_done (priv->scheduler);
         }
     }
-  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE) == 0)
+
+  if (grl_media)
     {
-      switch (g_value_get_uint (value))
+      gchar *mafw_object_id;
+      GHashTable *mafw_metadata_keys;
+      guint position;
+
+      position = browse_cb_info->grl_skip + browse_cb_info->page_received++;
+      mafw_object_id =
+        grl_media_serialize (browse_cb_info->mafw_grilo_source, grl_media, 0);
+      mafw_metadata_keys = mafw_keys_from_grl_media (browse_cb_info->
+                                                     mafw_grilo_source,
+                                                     grl_media,
+                                                     mafw_object_id,
+                                                     browse_cb_info->grl_keys);
+      store_listing_row (browse_cb_info->mafw_grilo_source,
+                         browse_cb_info->listing_key, position,
+                         mafw_object_id, mafw_metadata_keys);
+      /* With fast keys only, a missing key might just be a slow one */
+      index_grl_media (browse_cb_info->mafw_grilo_source, mafw_object_id,
+                       grl_media, mafw_metadata_keys,
+                       priv->browse_metadata_mode == GRL_RESOLVE_FAST_ONLY ?
+                       NULL :
+                       (const gchar *const *) browse_cb_info->metadata_keys);
+
+      /* Pages are aligned, so the first and last rows can be out of
+         the window. They are cached anyway. */
+      if (!browse_cb_info->cancelled &&
+          position == browse_cb_info->position &&
+          position < browse_cb_info->end)
         {
-        case MAFW_GRILO_SOURCE_METADATA_MODE_FAST:
-          source->priv->resolve_metadata_mode = GRL_RESOLVE_FAST_ONLY;
-          break;
-        case MAFW_GRILO_SOURCE_METADATA_MODE_NORMAL:
-          source->priv->resolve_metadata_mode = GRL_RESOLVE_NORMAL;
-          break;
-        case MAFW_GRILO_SOURCE_METADATA_MODE_FULL:
-          source->priv->resolve_metadata_mode = GRL_RESOLVE_FULL;
-          break;
-        default:
-          g_warning ("Wrong metadata mode: %d", g_value_get_uint (value));
+          mafw_grilo_stats_add (priv->stats,
+                                MAFW_GRILO_STATS_LISTING_CACHE_MISSES, 1);
+          add_browse_row (browse_cb_info, mafw_object_id,
+                          mafw_metadata_keys);
+        }
+      else
+        {
+          g_free (mafw_object_id);
+          g_hash_table_unref (mafw_metadata_keys);
         }
     }
-  else if (strcmp (key, MAFW_PROPERTY_GRILO_SOURCE_RESOLVE_METADATA_MODE) == 0)
+
+  if (remaining && !error)
     {
-      gchar *old_string = source->priv->default_mime;
-      source->priv->default_mime = g_value_dup_string (value);
-      g_free (old_string);
+      return;
     }
-  else
+
+  if (browse_cb_info->cancelled)
     {
+      /* If the client cancelled while we were delivering the last row
+         there is already an idle to finish the browse */
+      if (!browse_cb_info->idle_source)
+        {
+          finish_browse (browse_cb_info, error);
+        }
       return;
     }
 
-  mafw_extension_emit_property_changed (self, key, value);
+  if (error)
+    {
+      finish_browse (browse_cb_info, error);
+      return;
+    }
+
+  mafw_grilo_page_sizer_add_sample (priv->page_sizer,
+                                    browse_cb_info->page_received,
+                                    browse_cb_info->first_row_time,
+                                    g_timer_elapsed (browse_cb_info->
+                                                     page_timer, NULL));
+
+  if (browse_cb_info->page_received < browse_cb_info->grl_count)
+    {
+      browse_cb_info->known_end =
+        MIN (browse_cb_info->known_end,
+             browse_cb_info->grl_skip + browse_cb_info->page_received);
+      store_listing_end (browse_cb_info->mafw_grilo_source,
+                         browse_cb_info->listing_key,
+                         browse_cb_info->known_end);
+    }
+
+  fetch_browse_page (browse_cb_info);
 }
 
 static void
-mafw_grilo_source_class_init (MafwGriloSourceClass *klass)
+fetch_browse_page (BrowseCbInfo *browse_cb_info)
 {
-  GObjectClass *gobject_class;
-  MafwSourceClass *source_class;
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  MafwGriloListing *listing;
+  Prefetch *prefetch;
+  guint span;
+
+  /* First we take everything we can from the listing cache */
+  while (!browse_cb_info->cancelled &&
+         browse_cb_info->position < MIN (browse_cb_info->end,
+                                         browse_cb_info->known_end) &&
+         (listing =
+          mafw_grilo_listing_cache_lookup (priv->listing_cache,
+                                           browse_cb_info->listing_key)))
+    {
+      guint available, i;
 
-  g_return_if_fail (klass != NULL);
+      available =
+        mafw_grilo_listing_get_available (listing, browse_cb_info->position);
+      if (mafw_grilo_listing_is_end (listing,
+                                     browse_cb_info->position + available))
+        {
+          browse_cb_info->known_end =
+            MIN (browse_cb_info->known_end,
+                 browse_cb_info->position + available);
+        }
 
-  gobject_class = G_OBJECT_CLASS (klass);
-  source_class = MAFW_SOURCE_CLASS (klass);
+      if (!available)
+        {
+          break;
+        }
 
-  g_type_class_add_private (gobject_class, sizeof (MafwGriloSourcePrivate));
+      /* Rows from the snapshot are given while we ask for them again */
+      if (mafw_grilo_listing_is_stale (listing))
+        {
+          start_refresh (browse_cb_info, listing);
+        }
 
-  source_class->browse = mafw_grilo_source_browse;
-  source_class->cancel_browse = mafw_grilo_source_cancel_browse;
-  source_class->get_metadata = mafw_grilo_source_get_metadata;
+      available = MIN (available,
+                       browse_cb_info->end - browse_cb_info->position);
 
-  gobject_class->set_property = set_property;
-  gobject_class->dispose = dispose;
-  gobject_class->finalize = finalize;
+      mafw_grilo_listing_ref (listing);
+      for (i = 0;
+           i < available && !browse_cb_info->cancelled &&
+             browse_cb_info->position < browse_cb_info->end;
+           i++)
+        {
+          const gchar *object_id;
+          GHashTable *metadata;
 
-  MAFW_EXTENSION_CLASS(klass)->get_extension_property =
-    mafw_grilo_source_get_property;
-  MAFW_EXTENSION_CLASS(klass)->set_extension_property =
-    mafw_grilo_source_set_property;
+          object_id = mafw_grilo_listing_get_row (listing,
+                                                  browse_cb_info->position,
+                                                  &metadata);
+          add_browse_row (browse_cb_info, g_strdup (object_id), metadata);
+        }
+      mafw_grilo_stats_add (priv->stats, MAFW_GRILO_STATS_LISTING_CACHE_HITS,
+                            i);
+      mafw_grilo_listing_unref (listing);
+    }
 
-  g_object_class_install_property (gobject_class, PROP_GRILO_PLUGIN,
-                                   g_param_spec_object ("grl-plugin",
-                                                        "Grilo Plugin",
-                                                        "The Grilo plugin "
-                                                        "object",
-                                                        GRL_TYPE_MEDIA_PLUGIN,
-                                                        G_PARAM_CONSTRUCT_ONLY |
-                                                        G_PARAM_STATIC_STRINGS |
-                                                        G_PARAM_WRITABLE));
+  if (browse_cb_info->cancelled)
+    {
+      /* Cancelling from the callback scheduled the end already */
+      return;
+    }
+
+  if (browse_cb_info->position >= MIN (browse_cb_info->end,
+                                       browse_cb_info->known_end))
+    {
+      finish_browse (browse_cb_info, NULL);
+      return;
+    }
+
+  /* And then we ask grilo for the pages covering the rest of the
+     window */
+  browse_cb_info->grl_skip = browse_cb_info->position -
+    browse_cb_info->position % BROWSE_PAGE_SIZE;
+  span = MIN (browse_cb_info->end - browse_cb_info->grl_skip,
+              browse_cb_info->pages_fetched ?
+              mafw_grilo_page_sizer_get_page_size (priv->page_sizer) :
+              mafw_grilo_page_sizer_get_first_page_size (priv->page_sizer));
+  browse_cb_info->grl_count =
+    (span + BROWSE_PAGE_SIZE - 1) / BROWSE_PAGE_SIZE * BROWSE_PAGE_SIZE;
+  browse_cb_info->page_received = 0;
+  browse_cb_info->page_done = FALSE;
+  browse_cb_info->page_serial++;
+
+  /* If we are already fetching it ahead, we wait for it */
+  prefetch = g_hash_table_lookup (priv->prefetches,
+                                  browse_cb_info->listing_key);
+  if (prefetch &&
+      browse_cb_info->position >= prefetch->skip &&
+      browse_cb_info->position < prefetch->skip + prefetch->count)
+    {
+      g_debug ("Waiting for the prefetch of %u items from %u",
+               prefetch->count, prefetch->skip);
+      browse_cb_info->prefetch = prefetch;
+      prefetch->waiters = g_list_append (prefetch->waiters, browse_cb_info);
+      return;
+    }
+
+  /* The page waits for its turn, unless the browse is cancelled
+     before */
+  browse_cb_info->job_id =
+    mafw_grilo_scheduler_push (priv->scheduler,
+                               MAFW_GRILO_SCHEDULER_PRIORITY_BROWSE,
+                               browse_cb_info->mafw_browse_cb,
+                               browse_cb_info->mafw_user_data,
+                               run_browse_page, browse_cb_info);
 }
 
 static void
-sanitize (gchar *string)
+run_browse_page (gpointer user_data)
 {
-  gint i;
-  g_return_if_fail (string);
+  BrowseCbInfo *browse_cb_info = user_data;
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  BrowsePage *page;
+  guint grl_browse_id;
+  guint serial;
+
+  browse_cb_info->job_id = 0;
+
+  if (browse_cb_info->cancelled)
+    {
+      /* Our turn came too late, nobody wants the page anymore */
+      mafw_grilo_scheduler_done (priv->scheduler);
+      if (!browse_cb_info->idle_source)
+        {
+          browse_cb_info->idle_source =
+            g_idle_add (finish_cancelled_browse, browse_cb_info);
+        }
+      return;
+    }
+
+  if (browse_cb_info->page)
+    {
+      browse_cb_info->page->browse_cb_info = NULL;
+    }
+  page = g_slice_new (BrowsePage);
+  page->browse_cb_info = browse_cb_info;
+  browse_cb_info->page = page;
+  serial = browse_cb_info->page_serial;
+
+  browse_cb_info->page_running = TRUE;
+  browse_cb_info->pages_fetched++;
+
+  if (!browse_cb_info->page_timer)
+    {
+      browse_cb_info->page_timer = g_timer_new ();
+    }
+  g_timer_start (browse_cb_info->page_timer);
+  browse_cb_info->first_row_time = -1;
+
+  g_debug ("Fetching %u items from %u", browse_cb_info->grl_count,
+           browse_cb_info->grl_skip);
+
+  /* We do not ask grilo to relay the results in idles as we already
+     batch them before delivering. That means some plugins can call us
+     back before returning, and even queue the next page from there,
+     so we only keep the operation id if this page is still running. */
+  if (browse_cb_info->search_text)
+    {
+      grl_browse_id =
+        grl_media_source_search (GRL_MEDIA_SOURCE (priv->grl_source),
+                                 browse_cb_info->search_text,
+                                 browse_cb_info->grl_keys,
+                                 browse_cb_info->grl_skip,
+                                 browse_cb_info->grl_count,
+                                 browse_cb_info->grl_flags,
+                                 grl_browse_cb,
+                                 page);
+    }
+  else
+    {
+      grl_browse_id =
+        grl_media_source_browse (GRL_MEDIA_SOURCE (priv->grl_source),
+                                 browse_cb_info->grl_media,
+                                 browse_cb_info->grl_keys,
+                                 browse_cb_info->grl_skip,
+                                 browse_cb_info->grl_count,
+                                 browse_cb_info->grl_flags,
+                                 grl_browse_cb,
+                                 page);
+    }
 
-  i=0;
-  while (string[i]) {
-    switch (string[i]) {
-    case '-':
-    case ':':
-      string[i] = '_';
-    break;
+  if (browse_cb_info->page_serial == serial && !browse_cb_info->page_done)
+    {
+      browse_cb_info->grl_browse_id = grl_browse_id;
     }
-    i++;
-  }
 }
 
-static MafwGriloSource *
-mafw_grilo_source_new (GrlMediaPlugin *grl_plugin)
+static void schedule_recursive_walk (RecursiveWalk *walk);
+
+static RecursiveWalk *
+new_recursive_walk (BrowseCbInfo *browse_cb_info, GrlMedia *grl_media,
+                    guint depth)
 {
-  gchar *uuid;
+  RecursiveWalk *walk;
 
-  uuid = g_strdup (grl_media_plugin_get_id (grl_plugin));
-  sanitize (uuid);
+  walk = g_slice_new0 (RecursiveWalk);
+  walk->ref_count = 1;
+  walk->browse_cb_info = browse_cb_info;
+  walk->grl_media = grl_media ? g_object_ref (grl_media) : NULL;
+  walk->depth = depth;
 
-  return g_object_new (MAFW_TYPE_GRILO_SOURCE,
-                       "plugin", MAFW_GRILO_SOURCE_PLUGIN_NAME,
-                       "uuid", uuid,
-                       "name", grl_media_plugin_get_name (grl_plugin),
-                       "grl-plugin", grl_plugin,
-                       NULL);
+  return walk;
+}
+
+static void
+expand_recursive_walks (BrowseCbInfo *browse_cb_info)
+{
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+
+  /* Boxes are expanded in the order we found them, a few at a time */
+  while (!browse_cb_info->cancelled &&
+         browse_cb_info->position < browse_cb_info->end &&
+         g_list_length (browse_cb_info->active_walks) <
+         MAX (priv->recursive_breadth, 1) &&
+         !g_queue_is_empty (&browse_cb_info->pending_walks))
+    {
+      RecursiveWalk *walk = g_queue_pop_head (&browse_cb_info->pending_walks);
+
+      browse_cb_info->active_walks =
+        g_list_prepend (browse_cb_info->active_walks, walk);
+      schedule_recursive_walk (walk);
+    }
 }
 
 static void
-grl_media_deserialize (const gchar *object_id, GrlMedia **grl_media,
-                       guint *pagination_skip)
+stop_recursive_walks (BrowseCbInfo *browse_cb_info, RecursiveWalk *current)
 {
-  gchar *serialized_grl_media = NULL;
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  GList *link, *next;
+
+  g_queue_foreach (&browse_cb_info->pending_walks, unref_recursive_walk, NULL);
+  g_queue_clear (&browse_cb_info->pending_walks);
 
-  if (mafw_source_split_objectid (object_id, NULL, &serialized_grl_media) &&
-      serialized_grl_media[0] != '\0')
+  for (link = browse_cb_info->active_walks; link; link = next)
     {
-      guint skip;
-      gchar *grl_media_type;
-      gchar *ptr;
+      RecursiveWalk *walk = link->data;
 
-      skip = strtoul (serialized_grl_media, &ptr, 10);
+      next = g_list_next (link);
 
-      if (pagination_skip)
+      if (walk == current)
         {
-          *pagination_skip = skip;
+          continue;
         }
 
-      /* We search ':' and then we convert the type in NULL terminated and
-         prepare the media id */
-      grl_media_type = ptr + 1;
-      if (grl_media_type[0] != '\0')
+      if (walk->job_id)
         {
-          gchar *grl_media_id;
-
-          grl_media_id = g_strstr_len (grl_media_type, -1, ":");
-          grl_media_type[grl_media_id - grl_media_type] = '\0';
-          grl_media_id++;
-
-          *grl_media =
-            g_object_new (g_type_from_name (grl_media_type), NULL);
-          grl_media_set_id (*grl_media, grl_media_id);
+          /* It did not reach grilo, so nobody will call us back */
+          mafw_grilo_scheduler_remove (priv->scheduler, walk->job_id);
+          browse_cb_info->active_walks =
+            g_list_delete_link (browse_cb_info->active_walks, link);
+          unref_recursive_walk (walk, NULL);
+        }
+      else if (walk->grl_browse_id)
+        {
+          walk->cancelled = TRUE;
+          grl_media_source_cancel (GRL_MEDIA_SOURCE (priv->grl_source),
+                                   walk->grl_browse_id);
         }
     }
-
-  g_free (serialized_grl_media);
 }
 
-static gchar *
-grl_media_serialize (GrlMedia *grl_media, const gchar *source_id,
-                     guint pagination_skip)
+static void
+add_recursive_walk_result (RecursiveWalk *walk, GrlMedia *grl_media,
+                           guint remaining, const GError *error)
 {
-  const gchar *media_id, *type;
-  gchar *value;
+  BrowseCbInfo *browse_cb_info = walk->browse_cb_info;
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+
+  if (!remaining || error)
+    {
+      walk->grl_browse_id = 0;
+      walk->done = TRUE;
+      if (walk->running)
+        {
+          walk->running = FALSE;
+          mafw_grilo_scheduler_done (priv->scheduler);
+        }
+    }
 
   if (grl_media)
     {
-      type = G_OBJECT_TYPE_NAME (grl_media);
-      media_id = grl_media_get_id (grl_media);
+      walk->received++;
 
-      value = g_strdup_printf ("%s::%u:%s:%s", source_id, pagination_skip, type,
-                               media_id);
+      if (GRL_IS_MEDIA_BOX (grl_media))
+        {
+          /* Boxes are not delivered, we look inside them instead */
+          if (!browse_cb_info->cancelled && !walk->cancelled &&
+              walk->depth < priv->recursive_depth)
+            {
+              g_queue_push_tail (&browse_cb_info->pending_walks,
+                                 new_recursive_walk (browse_cb_info,
+                                                     grl_media,
+                                                     walk->depth + 1));
+            }
+        }
+      else if (!browse_cb_info->cancelled &&
+               browse_cb_info->position < browse_cb_info->end)
+        {
+          gchar *mafw_object_id;
+          GHashTable *mafw_metadata_keys;
+
+          mafw_object_id =
+            grl_media_serialize (browse_cb_info->mafw_grilo_source,
+                                 grl_media, 0);
+          mafw_metadata_keys =
+            mafw_keys_from_grl_media (browse_cb_info->mafw_grilo_source,
+                                      grl_media, mafw_object_id,
+                                      browse_cb_info->grl_keys);
+          index_grl_media (browse_cb_info->mafw_grilo_source,
+                           mafw_object_id, grl_media, mafw_metadata_keys,
+                           priv->browse_metadata_mode ==
+                           GRL_RESOLVE_FAST_ONLY ?
+                           NULL :
+                           (const gchar *const *) browse_cb_info->
+                           metadata_keys);
+          add_browse_row (browse_cb_info, mafw_object_id, mafw_metadata_keys);
+
+          if (browse_cb_info->position >= browse_cb_info->end)
+            {
+              stop_recursive_walks (browse_cb_info, walk);
+            }
+        }
     }
-  else
+
+  if (remaining && !error)
     {
-      value = g_strdup_printf ("%s::%u:", source_id, pagination_skip);
+      expand_recursive_walks (browse_cb_info);
+      return;
     }
 
-  return value;
-}
-
-static GList *
-mafw_keys_to_grl_keys (MafwGriloSource *mafw_source,
-                       const gchar *const *metadata_keys)
-{
-  GList *keys = NULL;
-  gint i;
-  gboolean wildcard = FALSE;
+  /* It is just retired, whatever grilo says */
+  if (walk->cancelled)
+    {
+      error = NULL;
+    }
 
-  g_return_val_if_fail (metadata_keys != NULL, NULL);
+  /* A box failing below the top is just left out */
+  if (error && walk->depth > 0)
+    {
+      g_warning ("Could not browse a box recursively: %s", error->message);
+      error = NULL;
+    }
 
-  for (i = 0; metadata_keys[i] != NULL; i++)
+  if (!error && !browse_cb_info->cancelled && !walk->cancelled &&
+      browse_cb_info->position < browse_cb_info->end &&
+      walk->received == walk->count)
     {
-      if (strcmp (metadata_keys[i], MAFW_SOURCE_KEY_WILDCARD) == 0)
-        {
-          g_list_free (keys);
+      /* There could be more in this box */
+      walk->skip += walk->received;
+      walk->received = 0;
+      walk->done = FALSE;
+      schedule_recursive_walk (walk);
+      return;
+    }
 
-          keys = g_list_copy ((GList *) grl_metadata_source_supported_keys (GRL_METADATA_SOURCE (mafw_source->priv->grl_source)));
-          g_debug ("Converting \"*\" to grilo\n");
+  browse_cb_info->active_walks =
+    g_list_remove (browse_cb_info->active_walks, walk);
+  unref_recursive_walk (walk, NULL);
 
-          wildcard = TRUE;
-        }
-      else
-        {
-          if (G_UNLIKELY (!keys))
-            {
-              keys = grl_metadata_key_list_new (GRL_METADATA_KEY_ID, NULL);
-            }
+  if (error)
+    {
+      stop_recursive_walks (browse_cb_info, NULL);
+      browse_cb_info->error = g_error_copy (error);
+    }
 
-          if (G_LIKELY (!wildcard))
-            {
+  expand_recursive_walks (browse_cb_info);
 
-#define MAFW_KEY_TO_GRL_KEY(mafw_key, grl_key)                        \
-              (strcmp (metadata_keys[i], mafw_key) == 0) {              \
-                keys = g_list_prepend (keys, GRLKEYID_TO_POINTER(grl_key)); \
-                g_debug ("Converting %s to grilo\n", mafw_key);         \
-              }
-
-              if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_URI, GRL_METADATA_KEY_URL)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_TITLE, GRL_METADATA_KEY_TITLE)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_ARTIST, GRL_METADATA_KEY_ARTIST)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_ALBUM, GRL_METADATA_KEY_ALBUM)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_GENRE, GRL_METADATA_KEY_GENRE)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_THUMBNAIL, GRL_METADATA_KEY_THUMBNAIL)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_COMPOSER, GRL_METADATA_KEY_AUTHOR)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_DESCRIPTION, GRL_METADATA_KEY_DESCRIPTION)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_LYRICS, GRL_METADATA_KEY_LYRICS)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_DURATION, GRL_METADATA_KEY_DURATION)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_CHILDCOUNT_1, GRL_METADATA_KEY_CHILDCOUNT)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_MIME, GRL_METADATA_KEY_MIME)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_RES_X, GRL_METADATA_KEY_WIDTH)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_RES_Y, GRL_METADATA_KEY_HEIGHT)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_VIDEO_FRAMERATE, GRL_METADATA_KEY_FRAMERATE)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_RATING, GRL_METADATA_KEY_RATING)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_BITRATE, GRL_METADATA_KEY_BITRATE)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_PLAY_COUNT, GRL_METADATA_KEY_PLAY_COUNT)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_LAST_PLAYED, GRL_METADATA_KEY_LAST_PLAYED)
-              else if MAFW_KEY_TO_GRL_KEY (MAFW_METADATA_KEY_PAUSED_POSITION, GRL_METADATA_KEY_LAST_POSITION)
-              else
-                {
-                  g_message ("MAFW key %s cannot be mapped to Grilo", metadata_keys[i]);
-                }
-            }
-        }
+  if (browse_cb_info->active_walks)
+    {
+      return;
     }
 
-  return keys;
+  /* If the client cancelled while we were delivering the last row
+     there is already an idle to finish the browse */
+  if (!browse_cb_info->cancelled || !browse_cb_info->idle_source)
+    {
+      finish_browse (browse_cb_info, browse_cb_info->error);
+    }
 }
 
-static GHashTable *
-mafw_keys_from_grl_media (MafwGriloSource *mafw_source, GrlMedia *grl_media)
+static void
+grl_recursive_browse_cb (GrlMediaSource *grl_source,
+                         guint grl_browse_id,
+                         GrlMedia *grl_media,
+                         guint remaining,
+                         gpointer user_data,
+                         const GError *error)
 {
-  GHashTable *mafw_metadata_keys;
-  GList *keys, *current;
+  RecursiveWalk *walk = user_data;
 
-  mafw_metadata_keys = mafw_metadata_new ();
+  /* The browse could be gone already */
+  if (walk->browse_cb_info)
+    {
+      add_recursive_walk_result (walk, grl_media, remaining, error);
+    }
 
-  keys = grl_data_get_keys (GRL_DATA (grl_media));
+  if (!remaining || error)
+    {
+      unref_recursive_walk (walk, NULL);
+    }
+}
 
-  for (current = keys; current; current = g_list_next (current))
+static void
+run_recursive_walk (gpointer user_data)
+{
+  RecursiveWalk *walk = user_data;
+  BrowseCbInfo *browse_cb_info = walk->browse_cb_info;
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  guint grl_browse_id;
+  guint serial;
+
+  walk->job_id = 0;
+  walk->running = TRUE;
+  walk->count = mafw_grilo_page_sizer_get_page_size (priv->page_sizer);
+  serial = walk->serial;
+
+  /* One reference for the operation and one for us, as grilo can be
+     done with the walk, and so can the browse, before returning */
+  ref_recursive_walk (walk);
+  ref_recursive_walk (walk);
+  grl_browse_id =
+    grl_media_source_browse (GRL_MEDIA_SOURCE (priv->grl_source),
+                             walk->grl_media,
+                             browse_cb_info->grl_keys,
+                             walk->skip, walk->count,
+                             browse_cb_info->grl_flags,
+                             grl_recursive_browse_cb,
+                             walk);
+
+  /* Same as with the pages of a plain browse, it could be over
+     already, or even waiting to go on */
+  if (walk->serial == serial && !walk->done)
     {
-      GrlKeyID id;
-      const GValue *value;
+      walk->grl_browse_id = grl_browse_id;
+    }
+  unref_recursive_walk (walk, NULL);
+}
 
-      id = POINTER_TO_GRLKEYID (current->data);
-      value = grl_data_get (GRL_DATA (grl_media), id);
-
-      if (value)
-        {
-#define GRL_KEY_TO_MAFW_KEY(mafw_key, grl_key) \
-          (id == grl_key) { \
-            g_debug ("Converting %s from grilo\n", mafw_key); \
-            if (!G_VALUE_HOLDS_STRING (value) || g_value_get_string (value)) \
-              mafw_metadata_add_val (mafw_metadata_keys, mafw_key, (GValue*) value); \
-          }
-
-          if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_URI, GRL_METADATA_KEY_URL)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_TITLE, GRL_METADATA_KEY_TITLE)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_ARTIST, GRL_METADATA_KEY_ARTIST)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_ALBUM, GRL_METADATA_KEY_ALBUM)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_GENRE, GRL_METADATA_KEY_GENRE)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_THUMBNAIL, GRL_METADATA_KEY_THUMBNAIL)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_COMPOSER, GRL_METADATA_KEY_AUTHOR)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_DESCRIPTION, GRL_METADATA_KEY_DESCRIPTION)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_LYRICS, GRL_METADATA_KEY_LYRICS)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_DURATION, GRL_METADATA_KEY_DURATION)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_CHILDCOUNT_1, GRL_METADATA_KEY_CHILDCOUNT)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_RES_X, GRL_METADATA_KEY_WIDTH)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_RES_Y, GRL_METADATA_KEY_HEIGHT)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_VIDEO_FRAMERATE, GRL_METADATA_KEY_FRAMERATE)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_RATING, GRL_METADATA_KEY_RATING)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_BITRATE, GRL_METADATA_KEY_BITRATE)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_PLAY_COUNT, GRL_METADATA_KEY_PLAY_COUNT)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_LAST_PLAYED, GRL_METADATA_KEY_LAST_PLAYED)
-          else if GRL_KEY_TO_MAFW_KEY (MAFW_METADATA_KEY_PAUSED_POSITION, GRL_METADATA_KEY_LAST_POSITION)
-     }
-   }
+static void
+schedule_recursive_walk (RecursiveWalk *walk)
+{
+  BrowseCbInfo *browse_cb_info = walk->browse_cb_info;
+
+  walk->serial++;
+  walk->job_id =
+    mafw_grilo_scheduler_push (browse_cb_info->mafw_grilo_source->priv->
+                               scheduler,
+                               MAFW_GRILO_SCHEDULER_PRIORITY_BROWSE,
+                               browse_cb_info->mafw_browse_cb,
+                               browse_cb_info->mafw_user_data,
+                               run_recursive_walk, walk);
+}
 
-  /* We set this independently of it coming in the data or not,
-     because in some sources, it can be a slow key and it does not
-     come even if we had requested it. */
-  if (GRL_IS_MEDIA_BOX (grl_media))
+static void
+start_recursive_browse (BrowseCbInfo *browse_cb_info)
+{
+  g_queue_push_tail (&browse_cb_info->pending_walks,
+                     new_recursive_walk (browse_cb_info,
+                                         browse_cb_info->grl_media, 0));
+  expand_recursive_walks (browse_cb_info);
+}
+
+static gboolean
+finish_cancelled_browse (gpointer user_data)
+{
+  BrowseCbInfo *browse_cb_info = user_data;
+
+  browse_cb_info->idle_source = 0;
+  finish_browse (browse_cb_info, NULL);
+
+  return FALSE;
+}
+
+/* Stops whatever the browse is waiting for. It finishes when grilo
+   reports the operations cancelled, or from an idle if there are
+   none */
+static void
+stop_browse (BrowseCbInfo *browse_cb_info)
+{
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+
+  /* Nobody is going to use the next page */
+  if (browse_cb_info->prefetch_started &&
+      !browse_cb_info->prefetch_started->waiters)
     {
-      g_debug ("Converting mime container from grilo\n");
-      mafw_metadata_add_str (mafw_metadata_keys, MAFW_METADATA_KEY_MIME,
-                             MAFW_METADATA_VALUE_MIME_CONTAINER);
+      cancel_prefetch (browse_cb_info->prefetch_started);
     }
-  else
+
+  if (browse_cb_info->prefetch)
     {
-      const gchar *mime;
+      browse_cb_info->prefetch->waiters =
+        g_list_remove (browse_cb_info->prefetch->waiters, browse_cb_info);
+      browse_cb_info->prefetch = NULL;
+    }
 
-      mime = grl_media_get_mime (grl_media);
+  /* A page still waiting for its turn will never be asked for */
+  if (browse_cb_info->job_id)
+    {
+      mafw_grilo_scheduler_remove (priv->scheduler, browse_cb_info->job_id);
+      browse_cb_info->job_id = 0;
+    }
 
-      if (mime)
-        {
-          g_debug ("Converting mime from grilo\n");
-          mafw_metadata_add_str (mafw_metadata_keys, MAFW_METADATA_KEY_MIME,
-                                 mime);
-        }
-      else
+  if (browse_cb_info->recursive)
+    {
+      /* Boxes being browsed report back when grilo cancels them; if
+         there are none we finish ourselves */
+      stop_recursive_walks (browse_cb_info, NULL);
+      if (!browse_cb_info->active_walks && !browse_cb_info->idle_source)
         {
-          g_debug ("Setting default mime\n");
-          mafw_metadata_add_str (mafw_metadata_keys, MAFW_METADATA_KEY_MIME,
-                                             get_default_mime (mafw_source));
+          browse_cb_info->idle_source =
+            g_idle_add (finish_cancelled_browse, browse_cb_info);
         }
     }
-
-  g_list_free (keys);
-
-  return mafw_metadata_keys;
+  else if (browse_cb_info->grl_browse_id)
+    {
+      grl_media_source_cancel (GRL_MEDIA_SOURCE (priv->grl_source),
+                               browse_cb_info->grl_browse_id);
+      /* We don't need to free anything here as grilo will call the
+         browse callback and everything will be freed in that
+         moment */
+    }
+  else if (browse_cb_info->delayed)
+    {
+      /* No need to wait for the next keystroke to finish */
+      g_source_remove (browse_cb_info->idle_source);
+      browse_cb_info->delayed = FALSE;
+      browse_cb_info->idle_source =
+        g_idle_add (start_browse, browse_cb_info);
+    }
+  else if (!browse_cb_info->idle_source)
+    {
+      /* We are not waiting for grilo, so we report the end of the
+         browse ourselves as grilo would do */
+      browse_cb_info->idle_source =
+        g_idle_add (finish_cancelled_browse, browse_cb_info);
+    }
 }
 
-static GHashTable *
-get_next_row_metadata_keys (void)
+static gboolean
+expire_browse (gpointer user_data)
 {
-  GHashTable *keys;
+  BrowseCbInfo *browse_cb_info = user_data;
+
+  browse_cb_info->deadline_source = 0;
 
-  keys = mafw_metadata_new ();
+  if (browse_cb_info->finished || browse_cb_info->cancelled)
+    {
+      return FALSE;
+    }
 
-  mafw_metadata_add_str (keys, MAFW_METADATA_KEY_TITLE, "More results...");
-  mafw_metadata_add_str (keys, MAFW_METADATA_KEY_MIME,
-                         MAFW_METADATA_VALUE_MIME_CONTAINER);
+  g_debug ("Browse %u timed out at position %u",
+           browse_cb_info->mafw_browse_id, browse_cb_info->position);
 
-  return keys;
+  browse_cb_info->timed_out = TRUE;
+  browse_cb_info->cancelled = TRUE;
+  stop_browse (browse_cb_info);
+
+  return FALSE;
 }
 
 static gboolean
-add_next_page_row (gpointer user_data)
+start_browse (gpointer user_data)
 {
   BrowseCbInfo *browse_cb_info = user_data;
-  gchar *object_id;
-  GHashTable *mafw_metadata_keys;
 
-  object_id =
-    grl_media_serialize (browse_cb_info->grl_media,
-                         mafw_extension_get_uuid (MAFW_EXTENSION (browse_cb_info->mafw_grilo_source)),
-                         browse_cb_info->pagination_skip);
+  browse_cb_info->idle_source = 0;
+  browse_cb_info->delayed = FALSE;
 
-  mafw_metadata_keys = get_next_row_metadata_keys ();
+  if (browse_cb_info->cancelled || browse_cb_info->error)
+    {
+      finish_browse (browse_cb_info, browse_cb_info->error);
+    }
+  else if (browse_cb_info->recursive)
+    {
+      start_recursive_browse (browse_cb_info);
+    }
+  else
+    {
+      fetch_browse_page (browse_cb_info);
+    }
 
-  browse_cb_info->mafw_browse_cb (MAFW_SOURCE (browse_cb_info->
-                                               mafw_grilo_source),
-                                  browse_cb_info->mafw_browse_id, 0, 0,
-                                  object_id, mafw_metadata_keys,
-                                  browse_cb_info->mafw_user_data, NULL);
+  return FALSE;
+}
 
-  g_free (object_id);
-  if (mafw_metadata_keys)
+static void
+answer_metadata_request (MetadataCbInfo *metadata_cb_info,
+                         GHashTable *mafw_metadata_keys,
+                         const GError *error)
+{
+  metadata_cb_info->mafw_metadata_cb (MAFW_SOURCE (metadata_cb_info->
+                                                   mafw_grilo_source),
+                                      metadata_cb_info->mafw_object_id,
+                                      mafw_metadata_keys,
+                                      metadata_cb_info->mafw_user_data,
+                                      error);
+
+  if (metadata_cb_info->metadata)
     {
-      g_hash_table_unref (mafw_metadata_keys);
+      g_hash_table_unref (metadata_cb_info->metadata);
+    }
+  if (metadata_cb_info->error)
+    {
+      g_error_free (metadata_cb_info->error);
     }
+  g_strfreev (metadata_cb_info->metadata_keys);
+  g_strfreev (metadata_cb_info->requested_keys);
+  g_free (metadata_cb_info->mafw_object_id);
+  g_free (metadata_cb_info);
+}
+
+static gboolean
+answer_metadata_request_from_index (gpointer user_data)
+{
+  MetadataCbInfo *metadata_cb_info = user_data;
 
-  /* we don't free the info, we just remove it from the hash table
-     and it will free it for us */
-  g_hash_table_remove (browse_cb_info->mafw_grilo_source->priv->
-                       browse_requests,
-                       &(browse_cb_info->mafw_browse_id));
+  answer_metadata_request (metadata_cb_info, metadata_cb_info->metadata,
+                           metadata_cb_info->error);
 
   return FALSE;
 }
 
-static void
-grl_browse_cb (GrlMediaSource *grl_source,
-               guint grl_browse_id,
-               GrlMedia *grl_media,
-               guint remaining,
-               gpointer user_data,
-               const GError *error)
+static GHashTable *
+filter_metadata (GHashTable *metadata, const gchar *const *metadata_keys)
 {
-  BrowseCbInfo *browse_cb_info = user_data;
-  gchar *mafw_object_id = NULL;
-  GHashTable *mafw_metadata_keys = NULL;
-
-  browse_cb_info->more_pages |= remaining + 1 >= MAX_COUNT;
+  GHashTable *filtered;
+  gpointer value;
+  gint i;
 
-  if (grl_media)
+  if (!metadata_keys)
     {
-      const gchar *mafw_uuid;
+      return g_hash_table_ref (metadata);
+    }
 
-      mafw_uuid = mafw_extension_get_uuid (MAFW_EXTENSION (browse_cb_info->
-                                                           mafw_grilo_source));
+  filtered = mafw_metadata_new ();
 
-      mafw_object_id =
-        grl_media_serialize (grl_media, mafw_uuid, 0);
-      mafw_metadata_keys = mafw_keys_from_grl_media (browse_cb_info->
-                                                     mafw_grilo_source,
-                                                     grl_media);
-      browse_cb_info->total_items++;
+  for (i = 0; metadata_keys[i]; i++)
+    {
+      if (strcmp (metadata_keys[i], MAFW_SOURCE_KEY_WILDCARD) == 0)
+        {
+          g_hash_table_unref (filtered);
+          return g_hash_table_ref (metadata);
+        }
+
+      value = g_hash_table_lookup (metadata, metadata_keys[i]);
+      if (value && !g_hash_table_lookup (filtered, metadata_keys[i]))
+        {
+          mafw_grilo_metadata_add_value (filtered, metadata_keys[i], value);
+        }
     }
 
-  browse_cb_info->mafw_browse_cb (MAFW_SOURCE (browse_cb_info->
-                                               mafw_grilo_source),
-                                  browse_cb_info->mafw_browse_id,
-                                  browse_cb_info->more_pages ?
-                                  remaining + 1 : remaining, 0,
-                                  mafw_object_id,
-                                  mafw_metadata_keys,
-                                  browse_cb_info->mafw_user_data,
-                                  error);
+  return filtered;
+}
+
+static void
+free_metadata_request (MetadataRequest *metadata_request)
+{
+  MafwGriloSourcePrivate *priv = metadata_request->mafw_grilo_source->priv;
 
-  g_free (mafw_object_id);
-  if (mafw_metadata_keys)
+  /* A newer request for the same object could have taken our place */
+  if (g_hash_table_lookup (priv->metadata_requests,
+                           metadata_request->request_key) == metadata_request)
     {
-      g_hash_table_unref (mafw_metadata_keys);
+      g_hash_table_remove (priv->metadata_requests,
+                           metadata_request->request_key);
     }
 
-  if (!remaining || error)
+  if (metadata_request->timer)
     {
-      if (browse_cb_info->total_items > browse_cb_info->item_count)
-        {
-          g_message ("Exceeded item_count %d by returning %d items",
-                     browse_cb_info->item_count,
-                     browse_cb_info->total_items);
-        }
+      g_timer_destroy (metadata_request->timer);
+    }
+  if (metadata_request->deadline_source)
+    {
+      g_source_remove (metadata_request->deadline_source);
+    }
+  g_list_free (metadata_request->waiters);
+  g_ptr_array_foreach (metadata_request->metadata_keys, (GFunc) g_free, NULL);
+  g_ptr_array_free (metadata_request->metadata_keys, TRUE);
+  g_list_free (metadata_request->grl_keys);
+  g_free (metadata_request->request_key);
+  g_free (metadata_request->mafw_object_id);
+  g_free (metadata_request);
+}
 
-      if (browse_cb_info->more_pages)
+static gboolean
+metadata_request_has_key (MetadataRequest *metadata_request,
+                          const gchar *key)
+{
+  guint i;
+
+  for (i = 0; i < metadata_request->metadata_keys->len; i++)
+    {
+      const gchar *request_key =
+        g_ptr_array_index (metadata_request->metadata_keys, i);
+
+      if (request_key &&
+          (strcmp (request_key, key) == 0 ||
+           strcmp (request_key, MAFW_SOURCE_KEY_WILDCARD) == 0))
         {
-          browse_cb_info->pagination_skip += MAX_COUNT;
-          g_idle_add (add_next_page_row, browse_cb_info);
+          return TRUE;
         }
-      else
+    }
+
+  return FALSE;
+}
+
+static gboolean
+metadata_request_covers_keys (MetadataRequest *metadata_request,
+                              const gchar *const *metadata_keys)
+{
+  gint i;
+
+  for (i = 0; metadata_keys && metadata_keys[i]; i++)
+    {
+      if (!metadata_request_has_key (metadata_request, metadata_keys[i]))
         {
-          /* we don't free the info, we just remove it from the hash table
-             and it will free it for us */
-          g_hash_table_remove (browse_cb_info->mafw_grilo_source->priv->
-                               browse_requests,
-                               &(browse_cb_info->mafw_browse_id));
+          return FALSE;
         }
     }
+
+  return TRUE;
 }
 
 static void
@@ -920,29 +4480,100 @@ grl_metadata_cb (GrlMediaSource *source,
                  gpointer user_data,
                  const GError *error)
 {
-  MetadataCbInfo *metadata_cb_info = user_data;
+  MetadataRequest *metadata_request = user_data;
+  MafwGriloSourcePrivate *priv = metadata_request->mafw_grilo_source->priv;
   GHashTable *mafw_metadata_keys = NULL;
+  GList *waiter;
 
-  if (grl_media)
+  /* After a timeout our turn in the scheduler was given back
+     already */
+  if (!metadata_request->timed_out)
     {
-      mafw_metadata_keys = mafw_keys_from_grl_media (metadata_cb_info->
-                                                     mafw_grilo_source,
-                                                     grl_media);
+      mafw_grilo_scheduler_done (priv->scheduler);
     }
+  mafw_grilo_stats_add_time (priv->stats, MAFW_GRILO_STATS_METADATA_TIME,
+                             g_timer_elapsed (metadata_request->timer, NULL));
 
-  metadata_cb_info->mafw_metadata_cb (MAFW_SOURCE (metadata_cb_info->
-                                                   mafw_grilo_source),
-                                      metadata_cb_info->mafw_object_id,
-                                      mafw_metadata_keys,
-                                      metadata_cb_info->mafw_user_data,
-                                      error);
+  /* Failing because we gave up says nothing about the object */
+  if (error && !metadata_request->timed_out)
+    {
+      mafw_grilo_media_index_add_error (priv->media_index,
+                                        metadata_request->mafw_object_id,
+                                        error);
+    }
+  else if (grl_media)
+    {
+      mafw_metadata_keys =
+        mafw_keys_from_grl_media (metadata_request->mafw_grilo_source,
+                                  grl_media, metadata_request->mafw_object_id,
+                                  metadata_request->grl_keys);
+      index_grl_media (metadata_request->mafw_grilo_source,
+                       metadata_request->mafw_object_id, grl_media,
+                       mafw_metadata_keys,
+                       metadata_request->flags == GRL_RESOLVE_FAST_ONLY ?
+                       NULL :
+                       (const gchar *const *) metadata_request->
+                       metadata_keys->pdata);
+      if (get_snapshot (metadata_request->mafw_grilo_source))
+        {
+          mafw_grilo_snapshot_add_object (priv->snapshot,
+                                          metadata_request->mafw_object_id,
+                                          mafw_metadata_keys,
+                                          metadata_request->flags ==
+                                          GRL_RESOLVE_FAST_ONLY ?
+                                          NULL :
+                                          (const gchar *const *)
+                                          metadata_request->metadata_keys->
+                                          pdata);
+        }
+    }
+
+  /* Everybody waiting gets the answer to what they asked for */
+  for (waiter = metadata_request->waiters; waiter;
+       waiter = g_list_next (waiter))
+    {
+      MetadataCbInfo *metadata_cb_info = waiter->data;
+      GHashTable *waiter_metadata_keys = NULL;
+      gchar **missing_keys = NULL;
+
+      if (mafw_metadata_keys)
+        {
+          /* If we only asked for some of the keys, the rest come from
+             the index */
+          if (!mafw_grilo_media_index_lookup (priv->media_index,
+                                              metadata_cb_info->mafw_object_id,
+                                              (const gchar *const *)
+                                              metadata_cb_info->metadata_keys,
+                                              &waiter_metadata_keys,
+                                              &missing_keys, NULL) ||
+              missing_keys)
+            {
+              if (waiter_metadata_keys)
+                {
+                  g_hash_table_unref (waiter_metadata_keys);
+                }
+              waiter_metadata_keys =
+                filter_metadata (mafw_metadata_keys,
+                                 (const gchar *const *) metadata_cb_info->
+                                 metadata_keys);
+            }
+          g_strfreev (missing_keys);
+        }
+
+      answer_metadata_request (metadata_cb_info, waiter_metadata_keys, error);
+
+      if (waiter_metadata_keys)
+        {
+          g_hash_table_unref (waiter_metadata_keys);
+        }
+    }
 
   if (mafw_metadata_keys)
     {
       g_hash_table_unref (mafw_metadata_keys);
     }
-  g_free (metadata_cb_info->mafw_object_id);
-  g_free (metadata_cb_info);
+
+  free_metadata_request (metadata_request);
 }
 
 static void
@@ -955,6 +4586,7 @@ grl_browse_metadata_cb (GrlMediaSource *grl_source,
 {
   if (!remaining)
     {
+      ((MetadataRequest *) user_data)->grl_browse_id = 0;
       grl_metadata_cb (grl_source, grl_media, user_data, error);
     }
   else
@@ -964,6 +4596,197 @@ grl_browse_metadata_cb (GrlMediaSource *grl_source,
     }
 }
 
+static void start_metadatas_requests (MetadatasCbInfo *metadatas_cb_info);
+
+static void
+finish_metadatas_request (MetadatasCbInfo *metadatas_cb_info)
+{
+  metadatas_cb_info->mafw_metadatas_cb (MAFW_SOURCE (metadatas_cb_info->
+                                                     mafw_grilo_source),
+                                        metadatas_cb_info->metadatas,
+                                        metadatas_cb_info->mafw_user_data,
+                                        metadatas_cb_info->error);
+
+  if (metadatas_cb_info->error)
+    {
+      g_error_free (metadatas_cb_info->error);
+    }
+  g_hash_table_unref (metadatas_cb_info->metadatas);
+  g_strfreev (metadatas_cb_info->object_ids);
+  g_strfreev (metadatas_cb_info->metadata_keys);
+  g_free (metadatas_cb_info);
+}
+
+static gboolean
+finish_empty_metadatas_request (gpointer user_data)
+{
+  finish_metadatas_request (user_data);
+
+  return FALSE;
+}
+
+static void
+metadatas_item_cb (MafwSource *source,
+                   const gchar *object_id,
+                   GHashTable *metadata,
+                   gpointer user_data,
+                   const GError *error)
+{
+  MetadatasCbInfo *metadatas_cb_info = user_data;
+
+  metadatas_cb_info->running--;
+
+  if (metadata)
+    {
+      g_hash_table_replace (metadatas_cb_info->metadatas,
+                            g_strdup (object_id),
+                            g_hash_table_ref (metadata));
+    }
+  /* We only report the first error, the rest of the objects are
+     returned anyway */
+  else if (error && !metadatas_cb_info->error)
+    {
+      metadatas_cb_info->error = g_error_copy (error);
+    }
+
+  if (metadatas_cb_info->object_ids[metadatas_cb_info->next])
+    {
+      start_metadatas_requests (metadatas_cb_info);
+    }
+  else if (!metadatas_cb_info->running)
+    {
+      finish_metadatas_request (metadatas_cb_info);
+    }
+}
+
+static void
+start_metadatas_requests (MetadatasCbInfo *metadatas_cb_info)
+{
+  MafwGriloSourcePrivate *priv = metadatas_cb_info->mafw_grilo_source->priv;
+  guint max_running = MAX (priv->metadata_concurrency, 1);
+
+  /* Objects already in the index are answered from an idle, so they do
+     not hold the line for long */
+  while (metadatas_cb_info->running < max_running &&
+         metadatas_cb_info->object_ids[metadatas_cb_info->next])
+    {
+      metadatas_cb_info->running++;
+      mafw_grilo_source_get_metadata (MAFW_SOURCE (metadatas_cb_info->
+                                                   mafw_grilo_source),
+                                      metadatas_cb_info->
+                                      object_ids[metadatas_cb_info->next++],
+                                      (const gchar *const *)
+                                      metadatas_cb_info->metadata_keys,
+                                      metadatas_item_cb,
+                                      metadatas_cb_info);
+    }
+}
+
+/* Whether we have every result of a search in the listing cache */
+static gboolean
+is_search_complete (MafwGriloSource *mafw_source, const gchar *search_text,
+                    const gchar *signature)
+{
+  MafwGriloListing *listing;
+  gchar *listing_key;
+  gboolean complete;
+
+  listing_key = get_listing_key (mafw_source, NULL, search_text, signature);
+  listing = mafw_grilo_listing_cache_lookup (mafw_source->priv->listing_cache,
+                                             listing_key);
+  g_free (listing_key);
+
+  complete = listing && !mafw_grilo_listing_is_stale (listing) &&
+    mafw_grilo_listing_get_base (listing) == 0 &&
+    mafw_grilo_listing_is_end (listing,
+                               mafw_grilo_listing_get_available (listing, 0));
+
+  return complete;
+}
+
+/* With supersede-searches set, a client searching again is not
+   interested in the results of its previous search anymore, which
+   ends with an error saying so. When the text contains one whose
+   results we have complete, those results contain the new ones and the
+   filter narrows them down without asking grilo. Returns whether the
+   search replaced another one still going on. */
+static gboolean
+track_search (BrowseCbInfo *browse_cb_info, const gchar *signature)
+{
+  MafwGriloSourcePrivate *priv = browse_cb_info->mafw_grilo_source->priv;
+  SearchClient *client = NULL;
+  BrowseCbInfo *previous;
+  gboolean superseded = FALSE;
+  GList *link;
+
+  for (link = priv->search_clients.head; link; link = g_list_next (link))
+    {
+      client = link->data;
+      if (client->mafw_browse_cb == browse_cb_info->mafw_browse_cb &&
+          client->mafw_user_data == browse_cb_info->mafw_user_data)
+        {
+          break;
+        }
+    }
+
+  if (link)
+    {
+      g_queue_unlink (&priv->search_clients, link);
+      g_queue_push_head_link (&priv->search_clients, link);
+    }
+  else
+    {
+      if (priv->search_clients.length >= MAX_SEARCH_CLIENTS)
+        {
+          free_search_client (g_queue_pop_tail (&priv->search_clients),
+                              NULL);
+        }
+      client = g_slice_new0 (SearchClient);
+      client->mafw_browse_cb = browse_cb_info->mafw_browse_cb;
+      client->mafw_user_data = browse_cb_info->mafw_user_data;
+      g_queue_push_head (&priv->search_clients, client);
+    }
+
+  previous = priv->supersede_searches ?
+    g_hash_table_lookup (priv->browse_requests, &client->browse_id) : NULL;
+  if (previous)
+    {
+      if (!previous->finished && !previous->cancelled)
+        {
+          g_debug ("Search %u superseded by %u", client->browse_id,
+                   browse_cb_info->mafw_browse_id);
+          mafw_grilo_stats_add (priv->stats,
+                                MAFW_GRILO_STATS_SEARCHES_SUPERSEDED, 1);
+          previous->superseded = TRUE;
+          superseded = TRUE;
+        }
+      mafw_grilo_source_cancel_browse (MAFW_SOURCE (browse_cb_info->
+                                                    mafw_grilo_source),
+                                       client->browse_id, NULL);
+    }
+  client->browse_id = browse_cb_info->mafw_browse_id;
+
+  if (client->base_text &&
+      strstr (browse_cb_info->search_text, client->base_text) &&
+      is_search_complete (browse_cb_info->mafw_grilo_source,
+                          client->base_text, signature))
+    {
+      g_debug ("Refining search of '%s' locally", client->base_text);
+      mafw_grilo_stats_add (priv->stats, MAFW_GRILO_STATS_SEARCHES_REFINED,
+                            1);
+      g_free (browse_cb_info->search_text);
+      browse_cb_info->search_text = g_strdup (client->base_text);
+
+      /* There is nothing to wait for */
+      return FALSE;
+    }
+
+  g_free (client->base_text);
+  client->base_text = g_strdup (browse_cb_info->search_text);
+
+  return superseded;
+}
+
 /*----------------------------------------------------------------------------
   Public API
   ----------------------------------------------------------------------------*/
@@ -982,45 +4805,204 @@ mafw_grilo_source_browse (MafwSource *source,
 {
   GrlMedia *grl_media = NULL;
   BrowseCbInfo *browse_cb_info;
-  GList *grl_keys;
+  guint pagination_skip = 0;
+  gchar *signature;
+  gboolean delay = FALSE;
 
   g_return_val_if_fail (browse_cb, MAFW_SOURCE_INVALID_BROWSE_ID);
 
   browse_cb_info = g_new0 (BrowseCbInfo, 1);
 
   browse_cb_info->mafw_grilo_source = MAFW_GRILO_SOURCE (g_object_ref (source));
+  browse_cb_info->browse_timer = g_timer_new ();
+  mafw_grilo_stats_add (browse_cb_info->mafw_grilo_source->priv->stats,
+                        MAFW_GRILO_STATS_BROWSES_STARTED, 1);
+
+  /* What we knew before a restart is there from the first browse */
+  get_snapshot (browse_cb_info->mafw_grilo_source);
   browse_cb_info->mafw_browse_cb = browse_cb;
   browse_cb_info->mafw_user_data = user_data;
   browse_cb_info->mafw_browse_id =
     browse_cb_info->mafw_grilo_source->priv->next_browse_id++;
+  browse_cb_info->skip_count = skip_count;
   browse_cb_info->item_count = item_count;
 
-  grl_media_deserialize (object_id, &grl_media,
-                         &(browse_cb_info->pagination_skip));
+  if (!mafw_grilo_object_id_decode (object_id, &grl_media, &pagination_skip))
+    {
+      g_set_error (&browse_cb_info->error, MAFW_SOURCE_ERROR,
+                   MAFW_SOURCE_ERROR_INVALID_OBJECT_ID,
+                   "Invalid object id %s", object_id);
+    }
+
+  browse_cb_info->metadata_keys =
+    mafw_grilo_filter_add_keys (filter, metadata_keys);
+
+  /* The rows come with their fast keys and the slow ones the client
+     asked for are brought later */
+  if (browse_cb_info->mafw_grilo_source->priv->browse_slow_keys &&
+      browse_cb_info->mafw_grilo_source->priv->browse_metadata_mode ==
+      GRL_RESOLVE_FAST_ONLY)
+    {
+      gchar **slow_metadata_keys;
+
+      slow_metadata_keys =
+        get_slow_metadata_keys (browse_cb_info->mafw_grilo_source,
+                                metadata_keys);
+      if (slow_metadata_keys)
+        {
+          browse_cb_info->slow_keys_resolver =
+            new_slow_keys_resolver (browse_cb_info->mafw_grilo_source,
+                                    browse_cb_info->mafw_browse_id,
+                                    slow_metadata_keys);
+        }
+    }
+
+  if (sort_criteria)
+    {
+      guint count = item_count ? item_count : MAX_COUNT;
+
+      browse_cb_info->sort_skip = pagination_skip +
+        MIN (skip_count, G_MAXUINT - pagination_skip);
+      browse_cb_info->sort_end = browse_cb_info->sort_skip +
+        MIN (count, G_MAXUINT - browse_cb_info->sort_skip);
+
+      /* Only the rows up to the end of the window are kept */
+      browse_cb_info->sorter =
+        mafw_grilo_sorter_new (sort_criteria, browse_cb_info->sort_end);
+    }
+
+  if (browse_cb_info->sorter)
+    {
+      gchar **metadata_keys_to_sort;
+
+      metadata_keys_to_sort =
+        add_metadata_keys ((const gchar *const *) browse_cb_info->
+                           metadata_keys,
+                           mafw_grilo_sorter_get_keys (browse_cb_info->
+                                                       sorter));
+      g_strfreev (browse_cb_info->metadata_keys);
+      browse_cb_info->metadata_keys = metadata_keys_to_sort;
+    }
+
+  browse_cb_info->extra_keys =
+    get_extra_keys (metadata_keys,
+                    (const gchar *const *) browse_cb_info->metadata_keys);
+
+  browse_cb_info->grl_media = grl_media;
 
-  browse_cb_info->grl_media = grl_media ? g_object_ref (grl_media) : NULL;
+  if (filter)
+    {
+      browse_cb_info->filter = mafw_filter_copy (filter);
+
+      /* Searches cover the whole source, so they can only replace a
+         recursive browse of the root. A flat one gives the matching
+         children of the root, filtered here. */
+      if (!grl_media && recursive &&
+          (browse_cb_info->mafw_grilo_source->priv->supported_ops &
+           GRL_OP_SEARCH))
+        {
+          browse_cb_info->search_text =
+            mafw_grilo_filter_get_search_text (filter);
+        }
+
+      g_debug ("filtering %s", browse_cb_info->search_text ?
+               "grilo search results" : "locally");
+    }
 
-  grl_keys = mafw_keys_to_grl_keys (MAFW_GRILO_SOURCE (source), metadata_keys);
+  signature =
+    get_metadata_keys_signature ((const gchar *const *) browse_cb_info->
+                                 metadata_keys);
+  if (browse_cb_info->search_text && !browse_cb_info->error)
+    {
+      delay = track_search (browse_cb_info, signature);
+    }
+  browse_cb_info->grl_keys =
+    mafw_keys_to_grl_keys (MAFW_GRILO_SOURCE (source),
+                           (const gchar *const *) browse_cb_info->
+                           metadata_keys,
+                           signature);
+  browse_cb_info->grl_flags =
+    get_resolution_flags (browse_cb_info->mafw_grilo_source,
+                          browse_cb_info->grl_keys,
+                          browse_cb_info->mafw_grilo_source->priv->
+                          browse_metadata_mode);
+  browse_cb_info->listing_key =
+    get_listing_key (browse_cb_info->mafw_grilo_source, grl_media,
+                     browse_cb_info->search_text, signature);
+  g_free (signature);
+
+  /* A search already gives all the matching items of the source, so
+     there is no need to walk it */
+  browse_cb_info->recursive = recursive && !browse_cb_info->search_text;
+  browse_cb_info->match_window = filter || browse_cb_info->recursive;
+  g_queue_init (&browse_cb_info->pending_walks);
+
+  if (browse_cb_info->sorter)
+    {
+      /* We have to see every matching row before knowing which ones
+         go in the window */
+      browse_cb_info->position = 0;
+      browse_cb_info->end = G_MAXUINT;
+      browse_cb_info->filter_skip = 0;
+      browse_cb_info->filter_end = G_MAXUINT;
+    }
+  else if (browse_cb_info->recursive)
+    {
+      /* The order of the items found walking the boxes concurrently
+         can change, so there is no "More results..." row to continue
+         from. Without item_count we give everything. */
+      browse_cb_info->position = 0;
+      browse_cb_info->end = G_MAXUINT;
+      browse_cb_info->filter_skip = skip_count;
+      browse_cb_info->filter_end = item_count ?
+        skip_count + MIN (item_count, G_MAXUINT - skip_count) : G_MAXUINT;
+    }
+  else if (filter)
+    {
+      /* We do not know where the window ends in the container until we
+         have seen enough matching rows. The pagination of the "More
+         results..." row is a position in the container, though. */
+      browse_cb_info->position = pagination_skip;
+      browse_cb_info->end = G_MAXUINT;
+      browse_cb_info->filter_skip = skip_count;
+      browse_cb_info->filter_end = skip_count +
+        MIN (item_count ? item_count : MAX_COUNT, G_MAXUINT - skip_count);
+    }
+  else
+    {
+      /* The window the client wants. Without item_count we give
+         MAX_COUNT items and a row to continue from there. */
+      browse_cb_info->position = pagination_skip +
+        MIN (skip_count, G_MAXUINT - pagination_skip);
+      browse_cb_info->end = browse_cb_info->position +
+        MIN (item_count ? item_count : MAX_COUNT,
+             G_MAXUINT - browse_cb_info->position);
+    }
+  browse_cb_info->known_end = G_MAXUINT;
 
   g_hash_table_insert (browse_cb_info->mafw_grilo_source->priv->browse_requests,
                        &(browse_cb_info->mafw_browse_id),
                        browse_cb_info);
 
-  browse_cb_info->grl_browse_id =
-    grl_media_source_browse (GRL_MEDIA_SOURCE (browse_cb_info->
-                                               mafw_grilo_source->priv->
-                                               grl_source),
-                             grl_media,
-                             grl_keys,
-                             browse_cb_info->pagination_skip,
-                             MAX_COUNT,
-                             GRL_RESOLVE_IDLE_RELAY |
-                             browse_cb_info->mafw_grilo_source->priv->
-                             browse_metadata_mode,
-                             grl_browse_cb,
-                             browse_cb_info);
-
-  g_list_free (grl_keys);
+  if (delay && browse_cb_info->mafw_grilo_source->priv->search_delay)
+    {
+      browse_cb_info->delayed = TRUE;
+      browse_cb_info->idle_source =
+        g_timeout_add (browse_cb_info->mafw_grilo_source->priv->search_delay,
+                       start_browse, browse_cb_info);
+    }
+  else
+    {
+      browse_cb_info->idle_source = g_idle_add (start_browse, browse_cb_info);
+    }
+
+  if (browse_cb_info->mafw_grilo_source->priv->browse_deadline)
+    {
+      browse_cb_info->deadline_source =
+        g_timeout_add_seconds (browse_cb_info->mafw_grilo_source->priv->
+                               browse_deadline,
+                               expire_browse, browse_cb_info);
+    }
 
   return browse_cb_info->mafw_browse_id;
 }
@@ -1031,19 +5013,44 @@ mafw_grilo_source_cancel_browse (MafwSource *source,
                                  GError **error)
 {
   BrowseCbInfo *browse_cb_info;
+  SlowKeysResolver *resolver;
   MafwGriloSource *mafw_grilo_source = MAFW_GRILO_SOURCE (source);
 
   browse_cb_info =
     g_hash_table_lookup (mafw_grilo_source->priv->browse_requests, &browse_id);
 
-  if (browse_cb_info)
+  if (browse_cb_info &&
+      (!browse_cb_info->cancelled || browse_cb_info->timed_out))
     {
-      grl_media_source_cancel (GRL_MEDIA_SOURCE (mafw_grilo_source->priv->
-                                                 grl_source),
-                               browse_cb_info->grl_browse_id);
-      /* We don't need to free anything here as grilo will call the
-         browse callback and everything will be freed in that
-         moment */
+      /* After a timeout the operations are being stopped already, but
+         the client does not want what we had either */
+      gboolean stopped = browse_cb_info->cancelled;
+
+      browse_cb_info->cancelled = TRUE;
+      browse_cb_info->timed_out = FALSE;
+      drop_browse_rows (browse_cb_info);
+
+      if (browse_cb_info->slow_keys_resolver)
+        {
+          cancel_slow_keys_resolver (browse_cb_info->slow_keys_resolver);
+          browse_cb_info->slow_keys_resolver = NULL;
+        }
+
+      if (browse_cb_info->finished || stopped)
+        {
+          return TRUE;
+        }
+
+      stop_browse (browse_cb_info);
+    }
+  /* Every row was delivered, but we are still bringing their slow
+     keys */
+  else if (!browse_cb_info &&
+           (resolver = find_slow_keys_resolver (mafw_grilo_source,
+                                                browse_id)))
+    {
+      cancel_slow_keys_resolver (resolver);
+      return TRUE;
     }
   /* I wonder if we should just silent ignore it and not reporting any
      error */
@@ -1057,6 +5064,204 @@ mafw_grilo_source_cancel_browse (MafwSource *source,
   return browse_cb_info != NULL;
 }
 
+static void
+dispatch_metadata_request (gpointer user_data)
+{
+  MetadataRequest *metadata_request = user_data;
+  MafwGriloSourcePrivate *priv = metadata_request->mafw_grilo_source->priv;
+  GrlMedia *grl_media = NULL;
+  GList *grl_keys;
+  const gchar *const *metadata_keys;
+  GrlMetadataResolutionFlags flags;
+  gchar *signature;
+
+  metadata_request->job_id = 0;
+  metadata_request->timer = g_timer_new ();
+  mafw_grilo_stats_add (priv->stats, MAFW_GRILO_STATS_METADATA_OPERATIONS, 1);
+
+  /* From now on the key set is closed, later requests can only join
+     if they need nothing else */
+  g_ptr_array_add (metadata_request->metadata_keys, NULL);
+  metadata_keys = (const gchar *const *) metadata_request->metadata_keys->pdata;
+
+  mafw_grilo_object_id_decode (metadata_request->mafw_object_id, &grl_media,
+                               NULL);
+  signature = get_metadata_keys_signature (metadata_keys);
+  grl_keys = mafw_keys_to_grl_keys (metadata_request->mafw_grilo_source,
+                                    metadata_keys, signature);
+  metadata_request->grl_keys = grl_keys;
+  g_free (signature);
+
+  /* The index still takes what comes as resolved with the configured
+     mode, as nothing slow was asked for */
+  flags = get_resolution_flags (metadata_request->mafw_grilo_source,
+                                grl_keys, metadata_request->flags);
+
+  if (priv->supported_ops & GRL_OP_METADATA)
+    {
+      g_debug ("getting metadata with source_metadata");
+      grl_media_source_metadata (GRL_MEDIA_SOURCE (priv->grl_source),
+                                 grl_media, grl_keys,
+                                 GRL_RESOLVE_IDLE_RELAY | flags,
+                                 grl_metadata_cb,
+                                 metadata_request);
+    }
+  else
+    {
+      g_debug ("getting metadata with source_browse");
+      /* Results are relayed in an idle, so it cannot be over yet */
+      metadata_request->grl_browse_id =
+        grl_media_source_browse (GRL_MEDIA_SOURCE (priv->grl_source),
+                                 grl_media, grl_keys, 0, 1,
+                                 GRL_RESOLVE_IDLE_RELAY | flags,
+                                 grl_browse_metadata_cb,
+                                 metadata_request);
+    }
+}
+
+static gboolean
+expire_metadata_request (gpointer user_data)
+{
+  MetadataRequest *metadata_request = user_data;
+  MafwGriloSourcePrivate *priv = metadata_request->mafw_grilo_source->priv;
+  GError *error = NULL;
+  GList *waiter;
+
+  metadata_request->deadline_source = 0;
+  metadata_request->timed_out = TRUE;
+  mafw_grilo_stats_add (priv->stats, MAFW_GRILO_STATS_METADATA_TIMEOUTS, 1);
+
+  g_debug ("Getting metadata of %s timed out",
+           metadata_request->mafw_object_id);
+  g_set_error (&error, MAFW_GRILO_SOURCE_ERROR,
+               MAFW_GRILO_SOURCE_ERROR_TIMED_OUT,
+               "Getting metadata timed out");
+
+  /* Everybody gets the keys we already knew, from browsing or from
+     earlier requests */
+  for (waiter = metadata_request->waiters; waiter;
+       waiter = g_list_next (waiter))
+    {
+      MetadataCbInfo *metadata_cb_info = waiter->data;
+      GHashTable *metadata = NULL;
+      gchar **missing_keys = NULL;
+
+      mafw_grilo_media_index_lookup (priv->media_index,
+                                     metadata_cb_info->mafw_object_id,
+                                     (const gchar *const *) metadata_cb_info->
+                                     metadata_keys,
+                                     &metadata, &missing_keys, NULL);
+      answer_metadata_request (metadata_cb_info, metadata, error);
+      if (metadata)
+        {
+          g_hash_table_unref (metadata);
+        }
+      g_strfreev (missing_keys);
+    }
+  g_list_free (metadata_request->waiters);
+  metadata_request->waiters = NULL;
+  g_error_free (error);
+
+  /* New requests for the object do not wait for this one */
+  if (g_hash_table_lookup (priv->metadata_requests,
+                           metadata_request->request_key) == metadata_request)
+    {
+      g_hash_table_remove (priv->metadata_requests,
+                           metadata_request->request_key);
+    }
+
+  if (metadata_request->job_id)
+    {
+      /* It never reached grilo */
+      mafw_grilo_scheduler_remove (priv->scheduler, metadata_request->job_id);
+      free_metadata_request (metadata_request);
+    }
+  else
+    {
+      /* Grilo still calls us back, but a hung plugin does not keep
+         the turn of others. Metadata operations cannot be cancelled,
+         only the browses standing for them. */
+      mafw_grilo_scheduler_done (priv->scheduler);
+      if (metadata_request->grl_browse_id)
+        {
+          grl_media_source_cancel (GRL_MEDIA_SOURCE (priv->grl_source),
+                                   metadata_request->grl_browse_id);
+        }
+    }
+
+  return FALSE;
+}
+
+static MetadataRequest *
+get_metadata_request (MafwGriloSource *mafw_grilo_source,
+                      const gchar *object_id,
+                      const gchar *const *metadata_keys,
+                      gconstpointer client, gconstpointer client_data)
+{
+  MafwGriloSourcePrivate *priv = mafw_grilo_source->priv;
+  MetadataRequest *metadata_request;
+  gchar *request_key;
+  gint i;
+
+  request_key = g_strdup_printf ("%s\n%d", object_id,
+                                 priv->resolve_metadata_mode);
+  metadata_request = g_hash_table_lookup (priv->metadata_requests,
+                                          request_key);
+
+  if (metadata_request && metadata_request->job_id)
+    {
+      /* Not started yet, so it can ask for our keys too */
+      g_debug ("joining pending metadata request");
+      g_free (request_key);
+    }
+  else if (metadata_request &&
+           metadata_request_covers_keys (metadata_request, metadata_keys))
+    {
+      g_debug ("joining running metadata request");
+      g_free (request_key);
+      return metadata_request;
+    }
+  else
+    {
+      metadata_request = g_new0 (MetadataRequest, 1);
+      metadata_request->mafw_grilo_source = mafw_grilo_source;
+      metadata_request->request_key = request_key;
+      metadata_request->mafw_object_id = g_strdup (object_id);
+      metadata_request->flags = priv->resolve_metadata_mode;
+      metadata_request->metadata_keys = g_ptr_array_new ();
+
+      /* Requests for the same object arriving before it is its turn
+         are sent together */
+      metadata_request->job_id =
+        mafw_grilo_scheduler_push (priv->scheduler,
+                                   MAFW_GRILO_SCHEDULER_PRIORITY_METADATA,
+                                   client, client_data,
+                                   dispatch_metadata_request,
+                                   metadata_request);
+      if (priv->metadata_deadline)
+        {
+          metadata_request->deadline_source =
+            g_timeout_add_seconds (priv->metadata_deadline,
+                                   expire_metadata_request,
+                                   metadata_request);
+        }
+
+      g_hash_table_replace (priv->metadata_requests,
+                            g_strdup (request_key), metadata_request);
+    }
+
+  for (i = 0; metadata_keys && metadata_keys[i]; i++)
+    {
+      if (!metadata_request_has_key (metadata_request, metadata_keys[i]))
+        {
+          g_ptr_array_add (metadata_request->metadata_keys,
+                           g_strdup (metadata_keys[i]));
+        }
+    }
+
+  return metadata_request;
+}
+
 static void
 mafw_grilo_source_get_metadata (MafwSource *source,
                                 const gchar *object_id,
@@ -1066,9 +5271,8 @@ mafw_grilo_source_get_metadata (MafwSource *source,
                                 gpointer user_data)
 {
   MetadataCbInfo *metadata_cb_info;
-  GrlMedia *grl_media = NULL;
-  GList *grl_keys;
-  GrlSupportedOps supported_ops;
+  MetadataRequest *metadata_request;
+  gboolean known;
 
   g_return_if_fail (metadata_cb);
 
@@ -1078,40 +5282,87 @@ mafw_grilo_source_get_metadata (MafwSource *source,
   metadata_cb_info->mafw_metadata_cb = metadata_cb;
   metadata_cb_info->mafw_user_data = user_data;
   metadata_cb_info->mafw_object_id = g_strdup (object_id);
+  metadata_cb_info->metadata_keys = g_strdupv ((gchar **) metadata_keys);
 
-  grl_media_deserialize (object_id, &grl_media, NULL);
-  grl_keys = mafw_keys_to_grl_keys (MAFW_GRILO_SOURCE (source), metadata_keys);
+  get_snapshot (metadata_cb_info->mafw_grilo_source);
+  mafw_grilo_stats_add (metadata_cb_info->mafw_grilo_source->priv->stats,
+                        MAFW_GRILO_STATS_METADATA_REQUESTS, 1);
 
-  supported_ops =
-    grl_metadata_source_supported_operations (GRL_METADATA_SOURCE (metadata_cb_info->
-                                                                   mafw_grilo_source->
-                                                                   priv->grl_source));
-  if (supported_ops & GRL_OP_METADATA)
+  if (!mafw_grilo_object_id_decode (object_id, NULL, NULL))
     {
-      g_debug ("getting metadata with source_metadata");
-      grl_media_source_metadata (GRL_MEDIA_SOURCE (metadata_cb_info->
-                                                   mafw_grilo_source->
-                                                   priv->grl_source),
-                                 grl_media, grl_keys,
-                                 GRL_RESOLVE_IDLE_RELAY |
-                                 metadata_cb_info->mafw_grilo_source->priv->
-                                 resolve_metadata_mode,
-                                 grl_metadata_cb,
-                                 metadata_cb_info);
+      g_set_error (&metadata_cb_info->error, MAFW_SOURCE_ERROR,
+                   MAFW_SOURCE_ERROR_INVALID_OBJECT_ID,
+                   "Invalid object id %s", object_id);
+      g_idle_add (answer_metadata_request_from_index, metadata_cb_info);
+      return;
     }
-  else
+
+  /* We might know everything already from a previous browse or
+     metadata request, or at least part of it */
+  known = mafw_grilo_media_index_lookup (metadata_cb_info->mafw_grilo_source->
+                                         priv->media_index,
+                                         object_id, metadata_keys,
+                                         &metadata_cb_info->metadata,
+                                         &metadata_cb_info->requested_keys,
+                                         &metadata_cb_info->error);
+  mafw_grilo_stats_add (metadata_cb_info->mafw_grilo_source->priv->stats,
+                        !known ? MAFW_GRILO_STATS_MEDIA_INDEX_MISSES :
+                        metadata_cb_info->requested_keys ?
+                        MAFW_GRILO_STATS_MEDIA_INDEX_PARTIAL_HITS :
+                        MAFW_GRILO_STATS_MEDIA_INDEX_HITS, 1);
+  if (known && !metadata_cb_info->requested_keys)
     {
-      g_debug ("getting metadata with source_browse");
-      grl_media_source_browse (GRL_MEDIA_SOURCE (metadata_cb_info->
-                                                 mafw_grilo_source->priv->
-                                                 grl_source),
-                               grl_media, grl_keys, 0, 1,
-                               GRL_RESOLVE_IDLE_RELAY |
-                               metadata_cb_info->mafw_grilo_source->priv->
-                               resolve_metadata_mode,
-                               grl_browse_metadata_cb,
-                               metadata_cb_info);
-    }
-
-  g_list_free (grl_keys);
+      g_debug ("getting metadata from the index");
+      g_idle_add (answer_metadata_request_from_index, metadata_cb_info);
+      return;
+    }
+
+  if (metadata_cb_info->metadata)
+    {
+      g_hash_table_unref (metadata_cb_info->metadata);
+      metadata_cb_info->metadata = NULL;
+    }
+  if (!metadata_cb_info->requested_keys)
+    {
+      metadata_cb_info->requested_keys = g_strdupv ((gchar **) metadata_keys);
+    }
+
+  metadata_request =
+    get_metadata_request (metadata_cb_info->mafw_grilo_source, object_id,
+                          (const gchar *const *) metadata_cb_info->
+                          requested_keys,
+                          metadata_cb, metadata_cb_info->mafw_user_data);
+  metadata_request->waiters = g_list_append (metadata_request->waiters,
+                                             metadata_cb_info);
+}
+
+static void
+mafw_grilo_source_get_metadatas (MafwSource *source,
+                                 const gchar **object_ids,
+                                 const gchar *const *metadata_keys,
+                                 MafwSourceMetadataResultsCb metadatas_cb,
+                                 gpointer user_data)
+{
+  MetadatasCbInfo *metadatas_cb_info;
+
+  g_return_if_fail (metadatas_cb);
+
+  metadatas_cb_info = g_new0 (MetadatasCbInfo, 1);
+
+  metadatas_cb_info->mafw_grilo_source = MAFW_GRILO_SOURCE (source);
+  metadatas_cb_info->mafw_metadatas_cb = metadatas_cb;
+  metadatas_cb_info->mafw_user_data = user_data;
+  metadatas_cb_info->object_ids = g_strdupv ((gchar **) object_ids);
+  metadatas_cb_info->metadata_keys = g_strdupv ((gchar **) metadata_keys);
+  metadatas_cb_info->metadatas =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                           (GDestroyNotify) g_hash_table_unref);
+
+  if (!object_ids || !object_ids[0])
+    {
+      g_idle_add (finish_empty_metadatas_request, metadatas_cb_info);
+      return;
+    }
+
+  start_metadatas_requests (metadatas_cb_info);
 }
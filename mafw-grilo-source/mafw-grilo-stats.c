@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include "config.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include "mafw-grilo-stats.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+/* Bucket i counts the times below 2^i ms, the last one everything
+   else */
+#define N_BUCKETS 16
+
+typedef struct
+{
+  guint64 count;
+  gdouble sum;
+  gdouble max;
+  guint64 buckets[N_BUCKETS];
+} Histogram;
+
+struct _MafwGriloStats
+{
+  guint64 counters[MAFW_GRILO_STATS_N_COUNTERS];
+  Histogram histograms[MAFW_GRILO_STATS_N_HISTOGRAMS];
+};
+
+static const gchar *counter_names[MAFW_GRILO_STATS_N_COUNTERS] =
+  {
+    "browses-started",
+    "browses-completed",
+    "browses-cancelled",
+    "browses-failed",
+    "browses-timed-out",
+    "browse-items",
+    "searches-superseded",
+    "searches-refined",
+    "metadata-requests",
+    "metadata-operations",
+    "metadata-timeouts",
+    "listing-cache-hits",
+    "listing-cache-misses",
+    "media-index-hits",
+    "media-index-partial-hits",
+    "media-index-misses",
+  };
+
+static const gchar *histogram_names[MAFW_GRILO_STATS_N_HISTOGRAMS] =
+  {
+    "browse-first-item-time",
+    "browse-time",
+    "metadata-time",
+  };
+
+MafwGriloStats *
+mafw_grilo_stats_new (void)
+{
+  return g_new0 (MafwGriloStats, 1);
+}
+
+void
+mafw_grilo_stats_free (MafwGriloStats *stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  g_free (stats);
+}
+
+void
+mafw_grilo_stats_reset (MafwGriloStats *stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  memset (stats, 0, sizeof (MafwGriloStats));
+}
+
+void
+mafw_grilo_stats_add (MafwGriloStats *stats, MafwGriloStatsCounter counter,
+                      guint amount)
+{
+  g_return_if_fail (stats != NULL);
+  g_return_if_fail (counter < MAFW_GRILO_STATS_N_COUNTERS);
+
+  stats->counters[counter] += amount;
+}
+
+void
+mafw_grilo_stats_add_time (MafwGriloStats *stats,
+                           MafwGriloStatsHistogram histogram,
+                           gdouble seconds)
+{
+  Histogram *h;
+  gdouble ms;
+  gint i;
+
+  g_return_if_fail (stats != NULL);
+  g_return_if_fail (histogram < MAFW_GRILO_STATS_N_HISTOGRAMS);
+
+  h = &stats->histograms[histogram];
+  ms = MAX (seconds, 0) * 1000;
+
+  for (i = 0; i < N_BUCKETS - 1 && ms >= (1 << i); i++);
+
+  h->buckets[i]++;
+  h->count++;
+  h->sum += ms;
+  h->max = MAX (h->max, ms);
+}
+
+/* The upper bound of the bucket holding the given fraction of the
+   samples */
+static gdouble
+get_percentile (Histogram *h, gdouble fraction)
+{
+  guint64 seen = 0;
+  gint i;
+
+  for (i = 0; i < N_BUCKETS - 1; i++)
+    {
+      seen += h->buckets[i];
+      if (seen >= h->count * fraction)
+        {
+          return MIN (1 << i, h->max);
+        }
+    }
+
+  return h->max;
+}
+
+void
+mafw_grilo_stats_print (MafwGriloStats *stats, GString *text)
+{
+  gdouble browse_time;
+  gint i;
+
+  g_return_if_fail (stats != NULL);
+  g_return_if_fail (text != NULL);
+
+  for (i = 0; i < MAFW_GRILO_STATS_N_COUNTERS; i++)
+    {
+      g_string_append_printf (text, "%s %" G_GUINT64_FORMAT "\n",
+                              counter_names[i], stats->counters[i]);
+    }
+
+  /* Items per second while browsing, not over the whole lifetime */
+  browse_time = stats->histograms[MAFW_GRILO_STATS_BROWSE_TIME].sum / 1000;
+  g_string_append_printf (text, "browse-items-per-second %.1f\n",
+                          browse_time > 0 ?
+                          stats->counters[MAFW_GRILO_STATS_BROWSE_ITEMS] /
+                          browse_time : 0);
+
+  for (i = 0; i < MAFW_GRILO_STATS_N_HISTOGRAMS; i++)
+    {
+      Histogram *h = &stats->histograms[i];
+      gint last, j;
+
+      g_string_append_printf (text, "%s-count %" G_GUINT64_FORMAT "\n",
+                              histogram_names[i], h->count);
+      if (!h->count)
+        {
+          continue;
+        }
+
+      g_string_append_printf (text, "%s-mean-ms %.1f\n", histogram_names[i],
+                              h->sum / h->count);
+      g_string_append_printf (text, "%s-p50-ms %.1f\n", histogram_names[i],
+                              get_percentile (h, 0.5));
+      g_string_append_printf (text, "%s-p90-ms %.1f\n", histogram_names[i],
+                              get_percentile (h, 0.9));
+      g_string_append_printf (text, "%s-max-ms %.1f\n", histogram_names[i],
+                              h->max);
+
+      /* Bucket bounds and counts, up to the last one used */
+      for (last = N_BUCKETS - 1; !h->buckets[last]; last--);
+      g_string_append_printf (text, "%s-buckets", histogram_names[i]);
+      for (j = 0; j <= last; j++)
+        {
+          if (j < N_BUCKETS - 1)
+            {
+              g_string_append_printf (text, " %u:%" G_GUINT64_FORMAT,
+                                      1 << j, h->buckets[j]);
+            }
+          else
+            {
+              g_string_append_printf (text, " inf:%" G_GUINT64_FORMAT,
+                                      h->buckets[j]);
+            }
+        }
+      g_string_append_c (text, '\n');
+    }
+}
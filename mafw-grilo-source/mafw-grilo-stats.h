@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include <glib.h>
+
+#ifndef MAFW_GRILO_STATS_H
+#define MAFW_GRILO_STATS_H
+
+G_BEGIN_DECLS
+
+/* Runtime statistics of a source: counters, and latency histograms
+   with power of two buckets in milliseconds. They can be read as text,
+   one "name value" line per counter. */
+
+typedef enum
+  {
+    MAFW_GRILO_STATS_BROWSES_STARTED,
+    MAFW_GRILO_STATS_BROWSES_COMPLETED,
+    MAFW_GRILO_STATS_BROWSES_CANCELLED,
+    MAFW_GRILO_STATS_BROWSES_FAILED,
+    MAFW_GRILO_STATS_BROWSES_TIMED_OUT,
+    MAFW_GRILO_STATS_BROWSE_ITEMS,
+    MAFW_GRILO_STATS_SEARCHES_SUPERSEDED,
+    MAFW_GRILO_STATS_SEARCHES_REFINED,
+    MAFW_GRILO_STATS_METADATA_REQUESTS,
+    MAFW_GRILO_STATS_METADATA_OPERATIONS,
+    MAFW_GRILO_STATS_METADATA_TIMEOUTS,
+    MAFW_GRILO_STATS_LISTING_CACHE_HITS,
+    MAFW_GRILO_STATS_LISTING_CACHE_MISSES,
+    MAFW_GRILO_STATS_MEDIA_INDEX_HITS,
+    MAFW_GRILO_STATS_MEDIA_INDEX_PARTIAL_HITS,
+    MAFW_GRILO_STATS_MEDIA_INDEX_MISSES,
+    MAFW_GRILO_STATS_N_COUNTERS
+  } MafwGriloStatsCounter;
+
+typedef enum
+  {
+    MAFW_GRILO_STATS_BROWSE_FIRST_ITEM_TIME,
+    MAFW_GRILO_STATS_BROWSE_TIME,
+    MAFW_GRILO_STATS_METADATA_TIME,
+    MAFW_GRILO_STATS_N_HISTOGRAMS
+  } MafwGriloStatsHistogram;
+
+typedef struct _MafwGriloStats MafwGriloStats;
+
+MafwGriloStats *mafw_grilo_stats_new (void);
+void mafw_grilo_stats_free (MafwGriloStats *stats);
+void mafw_grilo_stats_reset (MafwGriloStats *stats);
+
+void mafw_grilo_stats_add (MafwGriloStats *stats,
+                           MafwGriloStatsCounter counter,
+                           guint amount);
+void mafw_grilo_stats_add_time (MafwGriloStats *stats,
+                                MafwGriloStatsHistogram histogram,
+                                gdouble seconds);
+
+void mafw_grilo_stats_print (MafwGriloStats *stats, GString *text);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_STATS_H */
@@ -0,0 +1,649 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <errno.h>
+#include <string.h>
+
+#include "mafw-grilo-thumbnailer.h"
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mafw-grilo-source"
+
+#define THUMBNAIL_SUFFIX ".png"
+
+/* When the cache grows past its size the oldest thumbnails go, until
+   it is this fraction of it */
+#define TRIM_RATIO 0.75
+
+/* What we remember about URIs we have seen, before starting over */
+#define MAX_KNOWN_THUMBNAILS 4096
+
+/* Pictures bigger than this are not thumbnails, we stop downloading
+   them there */
+#define MAX_THUMBNAIL_SOURCE_SIZE (4 * 1024 * 1024)
+#define READ_BUFFER_SIZE (16 * 1024)
+
+typedef enum
+  {
+    THUMBNAIL_PENDING = 1,
+    THUMBNAIL_CACHED,
+    THUMBNAIL_FAILED
+  } ThumbnailState;
+
+typedef struct
+{
+  ThumbnailState state;
+  gchar *local_uri;
+} Thumbnail;
+
+typedef struct
+{
+  MafwGriloThumbnailer *thumbnailer;
+  gchar *uri;
+  gchar *path;
+  guint size;
+} Fetch;
+
+typedef struct
+{
+  gchar *path;
+  time_t mtime;
+  goffset size;
+} CachedFile;
+
+struct _MafwGriloThumbnailer
+{
+  gchar *cache_dir;
+  guint size;
+  guint64 max_cache_size;
+  /* Bytes in the cache directory, -1 until we look */
+  gint64 cache_size;
+  guint max_running;
+  /* What we know of the URIs seen with the current size */
+  GHashTable *thumbnails;
+  GQueue waiting;
+  GList *running;
+  GCancellable *cancellable;
+  MafwGriloThumbnailerFunc func;
+  gpointer user_data;
+};
+
+static void
+free_thumbnail (gpointer data)
+{
+  Thumbnail *thumbnail = data;
+
+  g_free (thumbnail->local_uri);
+  g_slice_free (Thumbnail, thumbnail);
+}
+
+static void
+free_fetch (Fetch *fetch)
+{
+  g_free (fetch->uri);
+  g_free (fetch->path);
+  g_slice_free (Fetch, fetch);
+}
+
+static void
+free_waiting_fetch (gpointer data, gpointer user_data)
+{
+  free_fetch (data);
+}
+
+MafwGriloThumbnailer *
+mafw_grilo_thumbnailer_new (const gchar *cache_dir, guint size,
+                            guint64 max_cache_size, guint max_running,
+                            MafwGriloThumbnailerFunc func, gpointer user_data)
+{
+  MafwGriloThumbnailer *thumbnailer;
+
+  g_return_val_if_fail (cache_dir != NULL, NULL);
+  g_return_val_if_fail (size > 0, NULL);
+  g_return_val_if_fail (max_running > 0, NULL);
+
+  thumbnailer = g_new0 (MafwGriloThumbnailer, 1);
+  thumbnailer->cache_dir = g_strdup (cache_dir);
+  thumbnailer->size = size;
+  thumbnailer->max_cache_size = max_cache_size;
+  thumbnailer->cache_size = -1;
+  thumbnailer->max_running = max_running;
+  thumbnailer->thumbnails = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, free_thumbnail);
+  g_queue_init (&thumbnailer->waiting);
+  thumbnailer->cancellable = g_cancellable_new ();
+  thumbnailer->func = func;
+  thumbnailer->user_data = user_data;
+
+  return thumbnailer;
+}
+
+void
+mafw_grilo_thumbnailer_free (MafwGriloThumbnailer *thumbnailer)
+{
+  GList *link;
+
+  g_return_if_fail (thumbnailer != NULL);
+
+  /* Fetches on their way find out when they come back */
+  g_cancellable_cancel (thumbnailer->cancellable);
+  for (link = thumbnailer->running; link; link = g_list_next (link))
+    {
+      ((Fetch *) link->data)->thumbnailer = NULL;
+    }
+  g_list_free (thumbnailer->running);
+
+  g_queue_foreach (&thumbnailer->waiting, free_waiting_fetch, NULL);
+  g_queue_clear (&thumbnailer->waiting);
+  g_hash_table_destroy (thumbnailer->thumbnails);
+  g_object_unref (thumbnailer->cancellable);
+  g_free (thumbnailer->cache_dir);
+  g_free (thumbnailer);
+}
+
+void
+mafw_grilo_thumbnailer_set_size (MafwGriloThumbnailer *thumbnailer,
+                                 guint size)
+{
+  g_return_if_fail (thumbnailer != NULL);
+  g_return_if_fail (size > 0);
+
+  if (size == thumbnailer->size)
+    {
+      return;
+    }
+
+  /* Thumbnails of each size are cached apart, so everything we knew
+     is about the old one */
+  thumbnailer->size = size;
+  g_queue_foreach (&thumbnailer->waiting, free_waiting_fetch, NULL);
+  g_queue_clear (&thumbnailer->waiting);
+  g_hash_table_remove_all (thumbnailer->thumbnails);
+}
+
+guint
+mafw_grilo_thumbnailer_get_size (MafwGriloThumbnailer *thumbnailer)
+{
+  g_return_val_if_fail (thumbnailer != NULL, 0);
+
+  return thumbnailer->size;
+}
+
+void
+mafw_grilo_thumbnailer_set_max_cache_size (MafwGriloThumbnailer *thumbnailer,
+                                           guint64 max_cache_size)
+{
+  g_return_if_fail (thumbnailer != NULL);
+
+  /* It is enforced the next time something is stored */
+  thumbnailer->max_cache_size = max_cache_size;
+}
+
+static gchar *
+get_thumbnail_path (MafwGriloThumbnailer *thumbnailer, const gchar *uri)
+{
+  gchar *key, *hash, *filename, *path;
+
+  key = g_strdup_printf ("%u\n%s", thumbnailer->size, uri);
+  hash = g_compute_checksum_for_string (G_CHECKSUM_MD5, key, -1);
+  filename = g_strconcat (hash, THUMBNAIL_SUFFIX, NULL);
+  path = g_build_filename (thumbnailer->cache_dir, filename, NULL);
+
+  g_free (filename);
+  g_free (hash);
+  g_free (key);
+
+  return path;
+}
+
+static GList *
+list_cached_files (MafwGriloThumbnailer *thumbnailer)
+{
+  GDir *dir;
+  const gchar *name;
+  GList *files = NULL;
+
+  dir = g_dir_open (thumbnailer->cache_dir, 0, NULL);
+  if (!dir)
+    {
+      return NULL;
+    }
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      CachedFile *file;
+      struct stat buf;
+      gchar *path;
+
+      if (!g_str_has_suffix (name, THUMBNAIL_SUFFIX))
+        {
+          continue;
+        }
+
+      path = g_build_filename (thumbnailer->cache_dir, name, NULL);
+      if (g_stat (path, &buf) != 0)
+        {
+          g_free (path);
+          continue;
+        }
+
+      file = g_slice_new (CachedFile);
+      file->path = path;
+      file->mtime = buf.st_mtime;
+      file->size = buf.st_size;
+      files = g_list_prepend (files, file);
+    }
+
+  g_dir_close (dir);
+
+  return files;
+}
+
+static void
+free_cached_file (gpointer data, gpointer user_data)
+{
+  CachedFile *file = data;
+
+  g_free (file->path);
+  g_slice_free (CachedFile, file);
+}
+
+static gint
+compare_cached_files (gconstpointer a, gconstpointer b)
+{
+  const CachedFile *file_a = a, *file_b = b;
+
+  return file_a->mtime < file_b->mtime ? -1 :
+    file_a->mtime > file_b->mtime ? 1 : 0;
+}
+
+static gboolean
+is_cached_thumbnail (gpointer key, gpointer value, gpointer user_data)
+{
+  return ((Thumbnail *) value)->state == THUMBNAIL_CACHED;
+}
+
+static void
+trim_cache (MafwGriloThumbnailer *thumbnailer)
+{
+  GList *files, *link;
+  guint removed = 0;
+
+  files = g_list_sort (list_cached_files (thumbnailer),
+                       compare_cached_files);
+
+  /* Other sources keep their thumbnails in the same directory, so what
+     we counted ourselves is not to be trusted with deleting files */
+  thumbnailer->cache_size = 0;
+  for (link = files; link; link = g_list_next (link))
+    {
+      thumbnailer->cache_size += ((CachedFile *) link->data)->size;
+    }
+  if (thumbnailer->cache_size <= thumbnailer->max_cache_size)
+    {
+      g_list_foreach (files, free_cached_file, NULL);
+      g_list_free (files);
+      return;
+    }
+
+  /* The oldest go first */
+  for (link = files;
+       link && thumbnailer->cache_size >
+         thumbnailer->max_cache_size * TRIM_RATIO;
+       link = g_list_next (link))
+    {
+      CachedFile *file = link->data;
+
+      if (g_unlink (file->path) == 0)
+        {
+          thumbnailer->cache_size -= file->size;
+          removed++;
+        }
+    }
+
+  g_debug ("Removed %u thumbnails, %" G_GINT64_FORMAT " bytes left",
+           removed, thumbnailer->cache_size);
+
+  g_list_foreach (files, free_cached_file, NULL);
+  g_list_free (files);
+
+  /* We do not know which ones are still there */
+  g_hash_table_foreach_remove (thumbnailer->thumbnails, is_cached_thumbnail,
+                               NULL);
+}
+
+static void
+add_to_cache_size (MafwGriloThumbnailer *thumbnailer, goffset size)
+{
+  if (thumbnailer->cache_size < 0)
+    {
+      GList *files, *link;
+
+      /* The thumbnail is already there */
+      thumbnailer->cache_size = 0;
+      files = list_cached_files (thumbnailer);
+      for (link = files; link; link = g_list_next (link))
+        {
+          thumbnailer->cache_size += ((CachedFile *) link->data)->size;
+        }
+      g_list_foreach (files, free_cached_file, NULL);
+      g_list_free (files);
+    }
+  else
+    {
+      thumbnailer->cache_size += size;
+    }
+
+  if (thumbnailer->cache_size > thumbnailer->max_cache_size)
+    {
+      trim_cache (thumbnailer);
+    }
+}
+
+static void
+size_prepared_cb (GdkPixbufLoader *loader, gint width, gint height,
+                  gpointer user_data)
+{
+  gint size = GPOINTER_TO_INT (user_data);
+
+  /* Only ever smaller, keeping the aspect ratio. Most decoders scale
+     while decoding, so big pictures are cheap. */
+  if (width <= size && height <= size)
+    {
+      return;
+    }
+
+  if (width > height)
+    {
+      height = MAX ((gint64) height * size / width, 1);
+      width = size;
+    }
+  else
+    {
+      width = MAX ((gint64) width * size / height, 1);
+      height = size;
+    }
+
+  gdk_pixbuf_loader_set_size (loader, width, height);
+}
+
+/* Runs in a thread of its own, so that neither decoding nor saving
+   blocks the main loop. The picture is decoded as it comes, and we
+   give up as soon as it is too big to be a thumbnail. */
+static void
+fetch_thumbnail_thread (GTask *task, gpointer source_object,
+                        gpointer task_data, GCancellable *cancellable)
+{
+  Fetch *fetch = task_data;
+  GFile *file;
+  GFileInputStream *stream;
+  GdkPixbufLoader *loader;
+  GdkPixbuf *pixbuf = NULL;
+  guchar buffer[READ_BUFFER_SIZE];
+  gssize read;
+  gsize total = 0;
+  GError *error = NULL;
+  gchar *dir, *tmp_path;
+  struct stat buf;
+
+  file = g_file_new_for_uri (fetch->uri);
+  stream = g_file_read (file, cancellable, &error);
+  g_object_unref (file);
+  if (!stream)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  loader = gdk_pixbuf_loader_new ();
+  g_signal_connect (loader, "size-prepared", G_CALLBACK (size_prepared_cb),
+                    GINT_TO_POINTER (fetch->size));
+
+  while ((read = g_input_stream_read (G_INPUT_STREAM (stream), buffer,
+                                      sizeof (buffer), cancellable,
+                                      &error)) > 0)
+    {
+      total += read;
+      if (total > MAX_THUMBNAIL_SOURCE_SIZE)
+        {
+          g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                       "Bigger than %u bytes", MAX_THUMBNAIL_SOURCE_SIZE);
+          break;
+        }
+      if (!gdk_pixbuf_loader_write (loader, buffer, read, &error))
+        {
+          break;
+        }
+    }
+  g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+  g_object_unref (stream);
+
+  /* It has to be closed even if something failed */
+  gdk_pixbuf_loader_close (loader, error ? NULL : &error);
+  if (!error)
+    {
+      pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+      if (!pixbuf)
+        {
+          g_set_error (&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "No picture");
+        }
+    }
+
+  if (error)
+    {
+      g_object_unref (loader);
+      g_task_return_error (task, error);
+      return;
+    }
+
+  /* Written apart and moved in place, so that nobody sees half a
+     file */
+  dir = g_path_get_dirname (fetch->path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+  tmp_path = g_strconcat (fetch->path, ".tmp", NULL);
+  if (!gdk_pixbuf_save (pixbuf, tmp_path, "png", &error, NULL) ||
+      g_rename (tmp_path, fetch->path) != 0)
+    {
+      if (!error)
+        {
+          g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno),
+                       "%s", g_strerror (errno));
+        }
+      g_warning ("Could not store thumbnail %s: %s", fetch->uri,
+                 error->message);
+      g_unlink (tmp_path);
+      g_free (tmp_path);
+      g_object_unref (loader);
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_free (tmp_path);
+  g_object_unref (loader);
+
+  g_task_return_int (task, g_stat (fetch->path, &buf) == 0 ? buf.st_size : 0);
+}
+
+static void start_fetches (MafwGriloThumbnailer *thumbnailer);
+
+static void
+fetch_thumbnail_cb (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+  Fetch *fetch = user_data;
+  MafwGriloThumbnailer *thumbnailer = fetch->thumbnailer;
+  Thumbnail *thumbnail;
+  gchar *local_uri = NULL;
+  gboolean settled = FALSE;
+  gssize size;
+  GError *error = NULL;
+
+  size = g_task_propagate_int (G_TASK (result), &error);
+
+  if (!thumbnailer)
+    {
+      g_clear_error (&error);
+      free_fetch (fetch);
+      return;
+    }
+
+  thumbnailer->running = g_list_remove (thumbnailer->running, fetch);
+
+  if (error)
+    {
+      g_debug ("Could not make a thumbnail of %s: %s", fetch->uri,
+               error->message);
+    }
+  else
+    {
+      add_to_cache_size (thumbnailer, size);
+    }
+
+  /* Unless the size changed meanwhile, the URI has its answer */
+  thumbnail = g_hash_table_lookup (thumbnailer->thumbnails, fetch->uri);
+  if (thumbnail && thumbnail->state == THUMBNAIL_PENDING &&
+      fetch->size == thumbnailer->size)
+    {
+      if (!error)
+        {
+          thumbnail->state = THUMBNAIL_CACHED;
+          thumbnail->local_uri = g_filename_to_uri (fetch->path, NULL, NULL);
+          local_uri = g_strdup (thumbnail->local_uri);
+        }
+      else
+        {
+          thumbnail->state = THUMBNAIL_FAILED;
+        }
+      settled = TRUE;
+    }
+  g_clear_error (&error);
+
+  start_fetches (thumbnailer);
+
+  /* Last, whoever is told may well look thumbnails up again */
+  if (settled && thumbnailer->func)
+    {
+      thumbnailer->func (fetch->uri, local_uri, thumbnailer->user_data);
+    }
+
+  g_free (local_uri);
+  free_fetch (fetch);
+}
+
+static void
+start_fetches (MafwGriloThumbnailer *thumbnailer)
+{
+  while (g_list_length (thumbnailer->running) < thumbnailer->max_running &&
+         !g_queue_is_empty (&thumbnailer->waiting))
+    {
+      Fetch *fetch;
+      GTask *task;
+
+      fetch = g_queue_pop_head (&thumbnailer->waiting);
+      thumbnailer->running = g_list_prepend (thumbnailer->running, fetch);
+
+      /* The fetch is ours, the thread only reads it */
+      task = g_task_new (NULL, thumbnailer->cancellable, fetch_thumbnail_cb,
+                         fetch);
+      g_task_set_task_data (task, fetch, NULL);
+      g_task_run_in_thread (task, fetch_thumbnail_thread);
+      g_object_unref (task);
+    }
+}
+
+static gboolean
+is_settled_thumbnail (gpointer key, gpointer value, gpointer user_data)
+{
+  return ((Thumbnail *) value)->state != THUMBNAIL_PENDING;
+}
+
+/* Returns the URI of the local copy of the thumbnail, if we have it
+   already. Otherwise it is fetched, unless we failed before, and
+   @pending tells whether the thumbnailer function is going to be
+   called for it. */
+const gchar *
+mafw_grilo_thumbnailer_lookup (MafwGriloThumbnailer *thumbnailer,
+                               const gchar *uri, gboolean *pending)
+{
+  Thumbnail *thumbnail;
+  gchar *path;
+
+  g_return_val_if_fail (thumbnailer != NULL, NULL);
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  thumbnail = g_hash_table_lookup (thumbnailer->thumbnails, uri);
+  if (thumbnail)
+    {
+      if (pending)
+        {
+          *pending = thumbnail->state == THUMBNAIL_PENDING;
+        }
+      return thumbnail->state == THUMBNAIL_CACHED ?
+        thumbnail->local_uri : NULL;
+    }
+
+  if (g_hash_table_size (thumbnailer->thumbnails) >= MAX_KNOWN_THUMBNAILS)
+    {
+      g_hash_table_foreach_remove (thumbnailer->thumbnails,
+                                   is_settled_thumbnail, NULL);
+    }
+
+  thumbnail = g_slice_new0 (Thumbnail);
+  g_hash_table_insert (thumbnailer->thumbnails, g_strdup (uri), thumbnail);
+
+  path = get_thumbnail_path (thumbnailer, uri);
+  if (g_file_test (path, G_FILE_TEST_EXISTS))
+    {
+      thumbnail->state = THUMBNAIL_CACHED;
+      thumbnail->local_uri = g_filename_to_uri (path, NULL, NULL);
+      g_free (path);
+    }
+  else
+    {
+      Fetch *fetch;
+
+      thumbnail->state = THUMBNAIL_PENDING;
+
+      fetch = g_slice_new (Fetch);
+      fetch->thumbnailer = thumbnailer;
+      fetch->uri = g_strdup (uri);
+      fetch->path = path;
+      fetch->size = thumbnailer->size;
+      g_queue_push_tail (&thumbnailer->waiting, fetch);
+      start_fetches (thumbnailer);
+    }
+
+  if (pending)
+    {
+      *pending = thumbnail->state == THUMBNAIL_PENDING;
+    }
+
+  return thumbnail->state == THUMBNAIL_CACHED ? thumbnail->local_uri : NULL;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#include <glib.h>
+
+#ifndef MAFW_GRILO_THUMBNAILER_H
+#define MAFW_GRILO_THUMBNAILER_H
+
+G_BEGIN_DECLS
+
+/* The thumbnailer keeps downscaled copies of the thumbnails sources
+   give, in a directory bounded in size where files are named after a
+   hash of their URI. Thumbnails not there yet are fetched in the
+   background, a few at a time, and the function given is told when
+   each of them is done, with the URI of the local copy or NULL if it
+   failed. */
+
+typedef struct _MafwGriloThumbnailer MafwGriloThumbnailer;
+
+typedef void (*MafwGriloThumbnailerFunc) (const gchar *uri,
+                                          const gchar *local_uri,
+                                          gpointer user_data);
+
+MafwGriloThumbnailer *mafw_grilo_thumbnailer_new (const gchar *cache_dir,
+                                                  guint size,
+                                                  guint64 max_cache_size,
+                                                  guint max_running,
+                                                  MafwGriloThumbnailerFunc func,
+                                                  gpointer user_data);
+void mafw_grilo_thumbnailer_free (MafwGriloThumbnailer *thumbnailer);
+
+void mafw_grilo_thumbnailer_set_size (MafwGriloThumbnailer *thumbnailer,
+                                      guint size);
+guint mafw_grilo_thumbnailer_get_size (MafwGriloThumbnailer *thumbnailer);
+void mafw_grilo_thumbnailer_set_max_cache_size (MafwGriloThumbnailer *thumbnailer,
+                                                guint64 max_cache_size);
+
+const gchar *mafw_grilo_thumbnailer_lookup (MafwGriloThumbnailer *thumbnailer,
+                                            const gchar *uri,
+                                            gboolean *pending);
+
+G_END_DECLS
+
+#endif /* MAFW_GRILO_THUMBNAILER_H */
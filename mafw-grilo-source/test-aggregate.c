@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* Unit tests for the aggregate source, browsing a real source on top
+   of a fake grilo one. Run them with "make check". */
+
+/* The source is included, as in bench-source.c, to reach its private
+   functions */
+#include "mafw-grilo-source.c"
+
+#define MEMBER_UUID "grl_test"
+#define OTHER_MEMBER_UUID "grl_other"
+#define BOX_ID "box"
+#define N_TRACKS 4
+
+/* A grilo source whose root and whose box have a few of the tracks,
+   or that never answers */
+typedef GrlMediaSource TestGrlSource;
+typedef GrlMediaSourceClass TestGrlSourceClass;
+
+GType test_grl_source_get_type (void);
+
+G_DEFINE_TYPE (TestGrlSource, test_grl_source, GRL_TYPE_MEDIA_SOURCE);
+
+static GrlMedia *tracks[N_TRACKS];
+static guint root_browses = 0;
+static guint box_browses = 0;
+static guint stalled_browses = 0;
+
+static const GList *
+test_grl_source_supported_keys (GrlMetadataSource *source)
+{
+  static GList *keys = NULL;
+
+  if (!keys)
+    {
+      keys = grl_metadata_key_list_new (GRL_METADATA_KEY_ID,
+                                        GRL_METADATA_KEY_TITLE,
+                                        GRL_METADATA_KEY_URL,
+                                        GRL_METADATA_KEY_MIME,
+                                        NULL);
+    }
+
+  return keys;
+}
+
+static void
+test_grl_source_browse (GrlMediaSource *source, GrlMediaSourceBrowseSpec *bs)
+{
+  guint first, n_tracks, i;
+
+  if (g_object_get_data (G_OBJECT (source), "stalled"))
+    {
+      /* Until it is cancelled */
+      g_object_set_data (G_OBJECT (source), "stalled-browse", bs);
+      stalled_browses++;
+      return;
+    }
+
+  first = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (source), "first"));
+  n_tracks =
+    GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (source), "n-tracks"));
+
+  if (!bs->container || !grl_media_get_id (bs->container))
+    {
+      root_browses++;
+    }
+  else if (strcmp (grl_media_get_id (bs->container), BOX_ID) == 0)
+    {
+      box_browses++;
+    }
+  else
+    {
+      n_tracks = 0;
+    }
+
+  if (bs->skip >= n_tracks || bs->count == 0)
+    {
+      bs->callback (bs->source, bs->browse_id, NULL, 0, bs->user_data, NULL);
+      return;
+    }
+
+  /* The source does not take the media, they are ours */
+  for (i = bs->skip; i < n_tracks && i - bs->skip < bs->count; i++)
+    {
+      bs->callback (bs->source, bs->browse_id, tracks[first + i],
+                    MIN (n_tracks, bs->skip + bs->count) - i - 1,
+                    bs->user_data, NULL);
+    }
+}
+
+static void
+test_grl_source_cancel (GrlMediaSource *source, guint operation_id)
+{
+  GrlMediaSourceBrowseSpec *bs;
+
+  bs = g_object_get_data (G_OBJECT (source), "stalled-browse");
+  if (bs && bs->browse_id == operation_id)
+    {
+      g_object_set_data (G_OBJECT (source), "stalled-browse", NULL);
+      bs->callback (bs->source, bs->browse_id, NULL, 0, bs->user_data, NULL);
+    }
+}
+
+static void
+test_grl_source_class_init (TestGrlSourceClass *klass)
+{
+  GRL_METADATA_SOURCE_CLASS (klass)->supported_keys =
+    test_grl_source_supported_keys;
+  GRL_MEDIA_SOURCE_CLASS (klass)->browse = test_grl_source_browse;
+  GRL_MEDIA_SOURCE_CLASS (klass)->cancel = test_grl_source_cancel;
+}
+
+static void
+test_grl_source_init (TestGrlSource *source)
+{
+}
+
+typedef struct
+{
+  guint rows;
+  guint ends;
+  gboolean error;
+  /* The titles of the rows, each followed by ';' */
+  GString *titles;
+} BrowseResult;
+
+static void
+browse_cb (MafwSource *source, guint browse_id, gint remaining, guint index,
+           const gchar *object_id, GHashTable *metadata, gpointer user_data,
+           const GError *error)
+{
+  BrowseResult *result = user_data;
+  GValue *value;
+
+  if (object_id)
+    {
+      /* The rows are the members' own */
+      g_assert (g_str_has_prefix (object_id, MEMBER_UUID "::") ||
+                g_str_has_prefix (object_id, OTHER_MEMBER_UUID "::"));
+      result->rows++;
+
+      value = mafw_metadata_first (metadata, MAFW_METADATA_KEY_TITLE);
+      if (value)
+        {
+          if (!result->titles)
+            {
+              result->titles = g_string_new (NULL);
+            }
+          g_string_append (result->titles, g_value_get_string (value));
+          g_string_append_c (result->titles, ';');
+        }
+    }
+  if (error)
+    {
+      result->error = TRUE;
+    }
+  if (remaining == 0)
+    {
+      result->ends++;
+    }
+}
+
+/* The member gives n_tracks of the tracks from the first one, or
+   nothing ever with n_tracks 0 */
+static MafwGriloSource *
+new_member (const gchar *uuid, guint first, guint n_tracks)
+{
+  GObject *grl_source;
+  MafwGriloSource *member;
+
+  grl_source = g_object_new (test_grl_source_get_type (), NULL);
+  g_object_set_data (grl_source, "first", GUINT_TO_POINTER (first));
+  g_object_set_data (grl_source, "n-tracks", GUINT_TO_POINTER (n_tracks));
+  g_object_set_data (grl_source, "stalled", GINT_TO_POINTER (!n_tracks));
+  member = g_object_new (MAFW_TYPE_GRILO_SOURCE,
+                         "plugin", MAFW_GRILO_SOURCE_PLUGIN_NAME,
+                         "uuid", uuid,
+                         "name", "Test",
+                         "grl-plugin", grl_source,
+                         NULL);
+  probe_grl_source (member, GRL_OP_BROWSE);
+  g_object_unref (grl_source);
+
+  return member;
+}
+
+static void
+run_pending (void)
+{
+  while (g_main_context_iteration (NULL, FALSE));
+}
+
+static void
+wait_end (BrowseResult *result)
+{
+  while (!result->ends)
+    {
+      g_main_context_iteration (NULL, TRUE);
+    }
+}
+
+static guint
+browse_root (MafwGriloAggregateSource *aggregate, const gchar *sort_criteria,
+             BrowseResult *result)
+{
+  const gchar *const keys[] = { MAFW_METADATA_KEY_TITLE, NULL };
+  gchar *root_id;
+  guint browse_id;
+
+  root_id = g_strconcat (mafw_extension_get_uuid (MAFW_EXTENSION (aggregate)),
+                         "::", NULL);
+  browse_id = mafw_source_browse (MAFW_SOURCE (aggregate), root_id, FALSE,
+                                  NULL, sort_criteria, keys, 0, 0, browse_cb,
+                                  result);
+  g_free (root_id);
+  g_assert (browse_id != MAFW_SOURCE_INVALID_BROWSE_ID);
+
+  return browse_id;
+}
+
+static void
+free_member (MafwGriloAggregateSource *aggregate, MafwGriloSource *member)
+{
+  mafw_grilo_aggregate_source_remove_member (aggregate, MAFW_SOURCE (member));
+  g_object_unref (member);
+}
+
+static void
+test_browse_members (void)
+{
+  MafwGriloAggregateSource *aggregate;
+  MafwGriloSource *member;
+  BrowseResult result = { 0, };
+
+  aggregate = mafw_grilo_aggregate_source_new (MAFW_GRILO_SOURCE_PLUGIN_NAME);
+  member = new_member (MEMBER_UUID, 0, 3);
+  mafw_grilo_aggregate_source_add_member (aggregate, MAFW_SOURCE (member));
+  root_browses = 0;
+
+  browse_root (aggregate, NULL, &result);
+  wait_end (&result);
+
+  /* The member took the id we built for its root */
+  g_assert_cmpuint (root_browses, ==, 1);
+  g_assert_cmpuint (result.rows, ==, 3);
+  g_assert_cmpuint (result.ends, ==, 1);
+  g_assert (!result.error);
+
+  run_pending ();
+  g_string_free (result.titles, TRUE);
+  free_member (aggregate, member);
+  g_object_unref (aggregate);
+}
+
+static void
+test_same_url (void)
+{
+  MafwGriloAggregateSource *aggregate;
+  MafwGriloSource *member, *other_member;
+  BrowseResult result = { 0, };
+
+  /* Both have the tracks 1 and 2 */
+  aggregate = mafw_grilo_aggregate_source_new (MAFW_GRILO_SOURCE_PLUGIN_NAME);
+  member = new_member (MEMBER_UUID, 0, 3);
+  other_member = new_member (OTHER_MEMBER_UUID, 1, 3);
+  mafw_grilo_aggregate_source_add_member (aggregate, MAFW_SOURCE (member));
+  mafw_grilo_aggregate_source_add_member (aggregate,
+                                          MAFW_SOURCE (other_member));
+
+  browse_root (aggregate, NULL, &result);
+  wait_end (&result);
+
+  g_assert_cmpuint (result.rows, ==, N_TRACKS);
+  g_assert_cmpuint (result.ends, ==, 1);
+  g_assert (!result.error);
+
+  run_pending ();
+  g_string_free (result.titles, TRUE);
+  free_member (aggregate, other_member);
+  free_member (aggregate, member);
+  g_object_unref (aggregate);
+}
+
+static void
+test_sorted_merge (void)
+{
+  MafwGriloAggregateSource *aggregate;
+  MafwGriloSource *member, *other_member;
+  BrowseResult result = { 0, };
+
+  /* One after the other, they would give "Track 1;Track 0;Track 3;..." */
+  aggregate = mafw_grilo_aggregate_source_new (MAFW_GRILO_SOURCE_PLUGIN_NAME);
+  member = new_member (MEMBER_UUID, 0, 2);
+  other_member = new_member (OTHER_MEMBER_UUID, 2, 2);
+  mafw_grilo_aggregate_source_add_member (aggregate, MAFW_SOURCE (member));
+  mafw_grilo_aggregate_source_add_member (aggregate,
+                                          MAFW_SOURCE (other_member));
+
+  browse_root (aggregate, "-" MAFW_METADATA_KEY_TITLE, &result);
+  wait_end (&result);
+
+  g_assert_cmpuint (result.rows, ==, N_TRACKS);
+  g_assert (result.titles != NULL);
+  g_assert_cmpstr (result.titles->str, ==,
+                   "Track 3;Track 2;Track 1;Track 0;");
+
+  run_pending ();
+  g_string_free (result.titles, TRUE);
+  free_member (aggregate, other_member);
+  free_member (aggregate, member);
+  g_object_unref (aggregate);
+}
+
+static void
+test_stalled_member (void)
+{
+  MafwGriloAggregateSource *aggregate;
+  MafwGriloSource *member, *stalled_member;
+  BrowseResult result = { 0, };
+
+  aggregate = mafw_grilo_aggregate_source_new (MAFW_GRILO_SOURCE_PLUGIN_NAME);
+  mafw_extension_set_property_uint (MAFW_EXTENSION (aggregate),
+                                    "member-deadline", 1);
+  member = new_member (MEMBER_UUID, 0, 3);
+  stalled_member = new_member (OTHER_MEMBER_UUID, 0, 0);
+  mafw_grilo_aggregate_source_add_member (aggregate, MAFW_SOURCE (member));
+  mafw_grilo_aggregate_source_add_member (aggregate,
+                                          MAFW_SOURCE (stalled_member));
+  stalled_browses = 0;
+
+  browse_root (aggregate, NULL, &result);
+  wait_end (&result);
+
+  /* We went on with what the other member gave */
+  g_assert_cmpuint (stalled_browses, ==, 1);
+  g_assert_cmpuint (result.rows, ==, 3);
+  g_assert_cmpuint (result.ends, ==, 1);
+  g_assert (!result.error);
+
+  /* And gave up on the browse of the stalled one */
+  run_pending ();
+  g_assert_cmpuint (g_hash_table_size (stalled_member->priv->
+                                       browse_requests), ==, 0);
+
+  g_string_free (result.titles, TRUE);
+  free_member (aggregate, stalled_member);
+  free_member (aggregate, member);
+  g_object_unref (aggregate);
+}
+
+static void
+test_browse_below_root (void)
+{
+  MafwGriloAggregateSource *aggregate;
+  MafwGriloSource *member, *other_member;
+  BrowseResult result = { 0, };
+  const gchar *const keys[] = { MAFW_METADATA_KEY_TITLE, NULL };
+  GrlMedia *box;
+  gchar *prefix, *object_id;
+  gsize prefix_length;
+  guint browse_id;
+
+  aggregate = mafw_grilo_aggregate_source_new (MAFW_GRILO_SOURCE_PLUGIN_NAME);
+  member = new_member (MEMBER_UUID, 0, 3);
+  other_member = new_member (OTHER_MEMBER_UUID, 1, 3);
+  mafw_grilo_aggregate_source_add_member (aggregate, MAFW_SOURCE (member));
+  mafw_grilo_aggregate_source_add_member (aggregate,
+                                          MAFW_SOURCE (other_member));
+  box_browses = 0;
+  root_browses = 0;
+
+  box = grl_media_box_new ();
+  grl_media_set_id (box, BOX_ID);
+  prefix = mafw_grilo_object_id_new_prefix (OTHER_MEMBER_UUID,
+                                            &prefix_length);
+  object_id = mafw_grilo_object_id_encode (prefix, prefix_length, box, 0);
+
+  /* Only the member owning the box gets the browse */
+  browse_id = mafw_source_browse (MAFW_SOURCE (aggregate), object_id, FALSE,
+                                  NULL, NULL, keys, 0, 0, browse_cb, &result);
+  g_assert (browse_id != MAFW_SOURCE_INVALID_BROWSE_ID);
+  wait_end (&result);
+
+  g_assert_cmpuint (box_browses, ==, 1);
+  g_assert_cmpuint (root_browses, ==, 0);
+  g_assert_cmpuint (result.rows, ==, 3);
+  g_assert_cmpuint (result.ends, ==, 1);
+  g_assert (!result.error);
+  g_assert_cmpstr (result.titles->str, ==, "Track 1;Track 2;Track 3;");
+  run_pending ();
+
+  /* Cancelling ours cancels the one of the member */
+  g_string_free (result.titles, TRUE);
+  memset (&result, 0, sizeof (result));
+  browse_id = mafw_source_browse (MAFW_SOURCE (aggregate), object_id, FALSE,
+                                  NULL, NULL, keys, 0, 0, browse_cb, &result);
+  g_assert (mafw_source_cancel_browse (MAFW_SOURCE (aggregate), browse_id,
+                                       NULL));
+  run_pending ();
+
+  g_assert_cmpuint (result.rows, ==, 0);
+  g_assert_cmpuint (result.ends, ==, 0);
+  g_assert_cmpuint (g_hash_table_size (other_member->priv->
+                                       browse_requests), ==, 0);
+
+  g_free (object_id);
+  g_free (prefix);
+  g_object_unref (box);
+  free_member (aggregate, other_member);
+  free_member (aggregate, member);
+  g_object_unref (aggregate);
+}
+
+static void
+test_cancel (void)
+{
+  MafwGriloAggregateSource *aggregate;
+  MafwGriloSource *member;
+  BrowseResult result = { 0, };
+  guint browse_id;
+
+  aggregate = mafw_grilo_aggregate_source_new (MAFW_GRILO_SOURCE_PLUGIN_NAME);
+  member = new_member (MEMBER_UUID, 0, 3);
+  mafw_grilo_aggregate_source_add_member (aggregate, MAFW_SOURCE (member));
+
+  browse_id = browse_root (aggregate, NULL, &result);
+  g_assert (mafw_source_cancel_browse (MAFW_SOURCE (aggregate), browse_id,
+                                       NULL));
+  run_pending ();
+
+  /* Not even the end */
+  g_assert_cmpuint (result.rows, ==, 0);
+  g_assert_cmpuint (result.ends, ==, 0);
+
+  free_member (aggregate, member);
+  g_object_unref (aggregate);
+}
+
+int
+main (int argc, char **argv)
+{
+  guint i;
+  gint status;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  g_test_init (&argc, &argv, NULL);
+
+  /* Registers the grilo keys */
+  grl_plugin_registry_get_instance ();
+
+  for (i = 0; i < N_TRACKS; i++)
+    {
+      gchar *text;
+
+      tracks[i] = grl_media_audio_new ();
+      text = g_strdup_printf ("file:///tmp/track-%u.mp3", i);
+      grl_media_set_id (tracks[i], text);
+      grl_media_set_url (tracks[i], text);
+      g_free (text);
+      text = g_strdup_printf ("Track %u", i);
+      grl_media_set_title (tracks[i], text);
+      g_free (text);
+      grl_media_set_mime (tracks[i], "audio/mpeg");
+    }
+
+  g_test_add_func ("/aggregate/browse-members", test_browse_members);
+  g_test_add_func ("/aggregate/same-url", test_same_url);
+  g_test_add_func ("/aggregate/sorted-merge", test_sorted_merge);
+  g_test_add_func ("/aggregate/stalled-member", test_stalled_member);
+  g_test_add_func ("/aggregate/browse-below-root", test_browse_below_root);
+  g_test_add_func ("/aggregate/cancel", test_cancel);
+
+  status = g_test_run ();
+
+  for (i = 0; i < N_TRACKS; i++)
+    {
+      g_object_unref (tracks[i]);
+    }
+
+  return status;
+}
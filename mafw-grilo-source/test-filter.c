@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* Unit tests for the filter helpers. Run them with "make check". */
+
+#include "config.h"
+
+#include <glib.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-grilo-filter.h"
+
+static void
+assert_search_text (const gchar *filter_string, const gchar *expected)
+{
+  MafwFilter *filter;
+  gchar *text;
+
+  filter = mafw_filter_parse (filter_string);
+  g_assert (filter != NULL);
+
+  text = mafw_grilo_filter_get_search_text (filter);
+  g_assert_cmpstr (text, ==, expected);
+
+  g_free (text);
+  mafw_filter_free (filter);
+}
+
+static void
+test_search_text_simple (void)
+{
+  assert_search_text ("(title~foo)", "foo");
+  assert_search_text ("(artist=Foo Fighters)", "Foo Fighters");
+}
+
+static void
+test_search_text_non_text_keys (void)
+{
+  /* A search for these would leave out rows the filter accepts */
+  assert_search_text ("(mime=audio/*)", NULL);
+  assert_search_text ("(genre~rock)", NULL);
+  assert_search_text ("(duration>100)", NULL);
+  assert_search_text ("(!(title~foo))", NULL);
+}
+
+static void
+test_search_text_and (void)
+{
+  assert_search_text ("(&(mime=audio/*)(title~foo))", "foo");
+  assert_search_text ("(&(title~foo)(mime=audio/*))", "foo");
+  assert_search_text ("(&(mime=audio/*)(duration>100))", NULL);
+}
+
+static void
+test_search_text_or (void)
+{
+  assert_search_text ("(|(title~foo)(artist~foo))", "foo");
+  assert_search_text ("(|(title~foo)(artist~bar))", NULL);
+  assert_search_text ("(|(title~foo)(mime=foo))", NULL);
+}
+
+static void
+assert_matches (const gchar *filter_string, GHashTable *metadata,
+                gboolean expected)
+{
+  MafwFilter *filter;
+
+  filter = mafw_filter_parse (filter_string);
+  g_assert (filter != NULL);
+
+  g_assert_cmpint (mafw_grilo_filter_matches (filter, metadata), ==,
+                   expected);
+
+  mafw_filter_free (filter);
+}
+
+static GHashTable *
+new_metadata (void)
+{
+  GHashTable *metadata;
+
+  metadata = mafw_metadata_new ();
+  mafw_metadata_add_str (metadata, MAFW_METADATA_KEY_TITLE, "9");
+  mafw_metadata_add_int (metadata, MAFW_METADATA_KEY_DURATION, 90);
+  mafw_metadata_add_str (metadata, MAFW_METADATA_KEY_ARTIST, "Alpha");
+  mafw_metadata_add_str (metadata, MAFW_METADATA_KEY_ARTIST, "Beta");
+
+  return metadata;
+}
+
+static void
+test_matches_numbers (void)
+{
+  GHashTable *metadata = new_metadata ();
+
+  /* As strings "90" would go after "100" */
+  assert_matches ("(duration<100)", metadata, TRUE);
+  assert_matches ("(duration>100)", metadata, FALSE);
+  assert_matches ("(duration>89.5)", metadata, TRUE);
+  assert_matches ("(duration=90)", metadata, TRUE);
+  assert_matches ("(duration=91)", metadata, FALSE);
+
+  g_hash_table_unref (metadata);
+}
+
+static void
+test_matches_strings (void)
+{
+  GHashTable *metadata = new_metadata ();
+
+  /* Strings stay strings, even when they look like numbers */
+  assert_matches ("(title<10)", metadata, FALSE);
+  assert_matches ("(title>10)", metadata, TRUE);
+  assert_matches ("(title=9)", metadata, TRUE);
+  assert_matches ("(title=9.0)", metadata, FALSE);
+
+  /* Only the approximate match ignores the case */
+  assert_matches ("(artist=alpha)", metadata, FALSE);
+  assert_matches ("(artist~alpha)", metadata, TRUE);
+  assert_matches ("(artist~lph)", metadata, TRUE);
+
+  g_hash_table_unref (metadata);
+}
+
+static void
+test_matches_several_values (void)
+{
+  GHashTable *metadata = new_metadata ();
+
+  /* Any of the values is enough */
+  assert_matches ("(artist=Alpha)", metadata, TRUE);
+  assert_matches ("(artist=Beta)", metadata, TRUE);
+  assert_matches ("(artist=Gamma)", metadata, FALSE);
+  assert_matches ("(artist<Alpha)", metadata, FALSE);
+  assert_matches ("(artist>Alpha)", metadata, TRUE);
+
+  g_hash_table_unref (metadata);
+}
+
+static void
+test_matches_exists (void)
+{
+  GHashTable *metadata = new_metadata ();
+
+  assert_matches ("(title?)", metadata, TRUE);
+  assert_matches ("(album?)", metadata, FALSE);
+  assert_matches ("(!(album?))", metadata, TRUE);
+  assert_matches ("(!(title=9))", metadata, FALSE);
+
+  /* Keys the row does not have match nothing, but their negation */
+  assert_matches ("(album=9)", metadata, FALSE);
+  assert_matches ("(!(album=9))", metadata, TRUE);
+  assert_matches ("(&(title?)(!(album?)))", metadata, TRUE);
+  assert_matches ("(|(album?)(duration>100))", metadata, FALSE);
+
+  g_assert (mafw_grilo_filter_matches (NULL, metadata));
+
+  g_hash_table_unref (metadata);
+}
+
+int
+main (int argc, char **argv)
+{
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/filter/search-text/simple", test_search_text_simple);
+  g_test_add_func ("/filter/search-text/non-text-keys",
+                   test_search_text_non_text_keys);
+  g_test_add_func ("/filter/search-text/and", test_search_text_and);
+  g_test_add_func ("/filter/search-text/or", test_search_text_or);
+  g_test_add_func ("/filter/matches/numbers", test_matches_numbers);
+  g_test_add_func ("/filter/matches/strings", test_matches_strings);
+  g_test_add_func ("/filter/matches/several-values",
+                   test_matches_several_values);
+  g_test_add_func ("/filter/matches/exists", test_matches_exists);
+
+  return g_test_run ();
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2010 Igalia S.L.
+ *
+ * Contact: Xabier Rodríguez Calvar <xrcalvar@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* Unit tests for the object id codec. Run them with "make check". */
+
+#include "config.h"
+
+#include <glib.h>
+#include <grilo.h>
+
+#include "mafw-grilo-object-id.h"
+
+#define SOURCE_UUID "grl_test"
+
+static void
+test_decode_root (void)
+{
+  GrlMedia *grl_media;
+  guint skip = 42;
+
+  /* As MAFW builds it */
+  g_assert (mafw_grilo_object_id_decode (SOURCE_UUID "::", &grl_media,
+                                         &skip));
+  g_assert (grl_media == NULL);
+  g_assert_cmpuint (skip, ==, 0);
+
+  /* As we build it */
+  g_assert (mafw_grilo_object_id_decode (SOURCE_UUID "::0:", &grl_media,
+                                         &skip));
+  g_assert (grl_media == NULL);
+  g_assert_cmpuint (skip, ==, 0);
+
+  g_assert (mafw_grilo_object_id_decode (SOURCE_UUID "::64:", &grl_media,
+                                         &skip));
+  g_assert (grl_media == NULL);
+  g_assert_cmpuint (skip, ==, 64);
+}
+
+static void
+test_round_trip (void)
+{
+  GrlMedia *grl_media, *decoded;
+  gchar *prefix, *object_id;
+  gsize prefix_length;
+  guint skip;
+
+  prefix = mafw_grilo_object_id_new_prefix (SOURCE_UUID, &prefix_length);
+  g_assert_cmpstr (prefix, ==, SOURCE_UUID "::");
+
+  object_id = mafw_grilo_object_id_encode (prefix, prefix_length, NULL, 0);
+  g_assert_cmpstr (object_id, ==, SOURCE_UUID "::0:");
+  g_free (object_id);
+
+  /* Media ids can have ':' of their own */
+  grl_media = grl_media_audio_new ();
+  grl_media_set_id (grl_media, "file:///tmp/a:b.mp3");
+  object_id = mafw_grilo_object_id_encode (prefix, prefix_length, grl_media,
+                                           128);
+
+  g_assert (mafw_grilo_object_id_decode (object_id, &decoded, &skip));
+  g_assert (decoded != NULL);
+  g_assert (G_OBJECT_TYPE (decoded) == G_OBJECT_TYPE (grl_media));
+  g_assert_cmpstr (grl_media_get_id (decoded), ==, "file:///tmp/a:b.mp3");
+  g_assert_cmpuint (skip, ==, 128);
+
+  g_object_unref (decoded);
+  g_object_unref (grl_media);
+  g_free (object_id);
+  g_free (prefix);
+}
+
+static void
+test_decode_invalid (void)
+{
+  static const gchar *invalid_ids[] = {
+    "",
+    SOURCE_UUID,
+    "::0:",
+    SOURCE_UUID "::x",
+    SOURCE_UUID "::0",
+    SOURCE_UUID "::99999999999:",
+    SOURCE_UUID "::0:GrlMediaAudio",
+    SOURCE_UUID "::0:NoSuchType:id",
+    NULL
+  };
+  GrlMedia *grl_media;
+  gint i;
+
+  g_assert (!mafw_grilo_object_id_decode (NULL, &grl_media, NULL));
+
+  for (i = 0; invalid_ids[i]; i++)
+    {
+      g_assert (!mafw_grilo_object_id_decode (invalid_ids[i], &grl_media,
+                                              NULL));
+      g_assert (grl_media == NULL);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/object-id/decode-root", test_decode_root);
+  g_test_add_func ("/object-id/round-trip", test_round_trip);
+  g_test_add_func ("/object-id/decode-invalid", test_decode_invalid);
+
+  return g_test_run ();
+}